@@ -0,0 +1,397 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Aging: many cycles of scattered deletes, updates resizing rows and inserts of new keys on one
+ * database, as years of churn would do to it. Every few cycles the state of the database is
+ * reported as '<tag_base>.cycle_<N>.*': free pages, file size, fragmentation (the share of pages
+ * not following their predecessor in b-tree order, as sqlite3_analyzer counts it) and the time a
+ * fixed query set takes, also relative to the fresh database ('slowdown'). The aged database is
+ * then recovered and the same is reported after recovery. The 'none' pass runs with auto_vacuum
+ * off and times VACUUM INTO (file-backed databases only) and VACUUM, the 'incremental' pass
+ * with auto_vacuum=INCREMENTAL and times incremental_vacuum(N) run until no free pages are left.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <limits.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "report.h"
+
+enum {
+    AGING_CYCLES = 20,
+    // state is reported every this many cycles
+    REPORT_CYCLES = 5,
+    // rows deleted, updated and inserted per cycle, in permilles of the table size
+    CHURN_PERMILLE = 200,
+    INCREMENTAL_VACUUM_PAGES = 100,
+    RANGE_QUERIES = 100,
+};
+
+// deletes and updates hit rows chosen by a per-cycle salt, scattering them over the table
+static const char *const DELETE_SQL =
+    "DELETE FROM t1 WHERE (a * 2654435761 + ?1) % 1000 < ?2;";
+static const char *const UPDATE_SQL =
+    "UPDATE t1 SET c = substr(c || ' ' || c || ' ' || c, 1, (a + ?1) % 150 + 10) "
+    "WHERE (a * 40503 + ?1) % 1000 < ?2;";
+
+static bool query_value(sqlite3 *db, const char *sql, double *value)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool ok = db_prepare(db, &stmt, sql) && sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *value = sqlite3_column_double(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+// pages of each b-tree visited in order, counting those not stored right after the previous one
+static bool query_fragmentation(sqlite3 *db, double *fragmentation)
+{
+    sqlite3_stmt *stmt = NULL;
+    char name[SQL_MAX] = "";
+    int prev_page = 0;
+    long n_pages = 0;
+    long n_gaps = 0;
+
+    // requires sqlite built with SQLITE_ENABLE_DBSTAT_VTAB
+    if (sqlite3_prepare_v2(db, "SELECT name, pageno FROM dbstat ORDER BY name, path;", -1, &stmt,
+                NULL) != SQLITE_OK) {
+        BLTS_DEBUG("%s: dbstat not available: %s\n", __FUNCTION__, sqlite3_errmsg(db));
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *row_name = (const char *)sqlite3_column_text(stmt, 0);
+        int page = sqlite3_column_int(stmt, 1);
+
+        if (strcmp(name, row_name) != 0) {
+            snprintf(name, sizeof(name), "%s", row_name);
+        } else {
+            ++n_pages;
+            if (page != prev_page + 1) {
+                ++n_gaps;
+            }
+        }
+        prev_page = page;
+    }
+    sqlite3_finalize(stmt);
+
+    *fragmentation = n_pages != 0 ? 100.0 * n_gaps / n_pages : 0;
+    return true;
+}
+
+// a full scan and index range scans over the whole key range
+static bool time_queries(sqlite3 *db, double *elapsed)
+{
+    sqlite3_stmt *stmt = NULL;
+    int i;
+
+    uint64_t start = histogram_now();
+
+    if (!db_exec(db, "SELECT count(*), avg(length(c)) FROM t1;")) {
+        return false;
+    }
+
+    if (!db_prepare(db, &stmt, "SELECT count(*), avg(b) FROM t1 WHERE b >= ?1 AND b < ?2;")) {
+        return false;
+    }
+
+    for (i = 0; i < RANGE_QUERIES; ++i) {
+        int low = i * (1000000 / RANGE_QUERIES);
+        sqlite3_bind_int(stmt, 1, low);
+        sqlite3_bind_int(stmt, 2, low + 1000);
+        if (!db_step_reset(stmt)) {
+            sqlite3_finalize(stmt);
+            return false;
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    *elapsed = (histogram_now() - start) / 1e9;
+    return true;
+}
+
+// reports the state of the database, with fresh_query_time 0 it is the fresh one
+static bool report_state(const char *tag_base, sqlite3 *db, double *fresh_query_time)
+{
+    double value;
+    double fragmentation;
+
+    if (!query_value(db, "PRAGMA freelist_count;", &value)) {
+        return false;
+    }
+    report_extended_result(tag_base, "freelist_count", value, "");
+
+    if (!query_value(db, "SELECT page_count * page_size FROM pragma_page_count(), "
+                "pragma_page_size();", &value)) {
+        return false;
+    }
+    report_extended_result(tag_base, "db_size", value, "B");
+
+    if (query_fragmentation(db, &fragmentation)) {
+        report_extended_result(tag_base, "fragmentation", fragmentation, "%");
+    }
+
+    if (!time_queries(db, &value)) {
+        return false;
+    }
+    report_extended_result(tag_base, "query_time", value, "s");
+
+    if (*fresh_query_time == 0) {
+        *fresh_query_time = value;
+    } else {
+        report_extended_result(tag_base, "slowdown", value / *fresh_query_time, "");
+    }
+
+    return true;
+}
+
+static bool age_cycle(sqlite3 *db, sqlite3_stmt *delete, sqlite3_stmt *update,
+        sqlite3_stmt *insert, row_generator *rows, int n_rows, uint64_t *state)
+{
+    int salt = generator_random(state) % 1000000;
+    int i;
+
+    if (!db_begin_transaction(db)) {
+        return false;
+    }
+
+    sqlite3_bind_int(delete, 1, salt);
+    sqlite3_bind_int(delete, 2, CHURN_PERMILLE);
+    sqlite3_bind_int(update, 1, salt);
+    sqlite3_bind_int(update, 2, CHURN_PERMILLE);
+    if (!db_step_reset(delete) || !db_step_reset(update)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_rows; ++i) {
+        const generated_row *row = row_generator_next(rows);
+        sqlite3_bind_int(insert, 1, row->index);
+        sqlite3_bind_int(insert, 2, row->row.number);
+        sqlite3_bind_text(insert, 3, row->row.string, -1, SQLITE_STATIC);
+        if (!db_step_reset(insert)) {
+            goto fail;
+        }
+    }
+
+    return db_commit_transaction(db);
+
+fail:
+    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    return false;
+}
+
+static bool vacuum_into(const char *tag_base, sqlite3 *db, const char *db_file)
+{
+    char target[PATH_MAX];
+    char sql[SQL_MAX + PATH_MAX];
+    struct stat st;
+
+    snprintf(target, sizeof(target), "%s-vacuum", db_file);
+    unlink(target);
+    snprintf(sql, sizeof(sql), "VACUUM INTO '%s';", target);
+
+    uint64_t start = histogram_now();
+    if (!db_exec(db, sql)) {
+        return false;
+    }
+    double elapsed = (histogram_now() - start) / 1e9;
+
+    char into_tag_base[TAG_MAX];
+    format_tag(into_tag_base, tag_base, "vacuum_into");
+    report_extended_result(into_tag_base, "elapsed", elapsed, "s");
+    if (stat(target, &st) == 0) {
+        report_extended_result(into_tag_base, "db_size", st.st_size, "B");
+    }
+    unlink(target);
+
+    return true;
+}
+
+static bool vacuum(const char *tag_base, sqlite3 *db, double *fresh_query_time)
+{
+    char vacuum_tag_base[TAG_MAX];
+    format_tag(vacuum_tag_base, tag_base, "vacuum");
+
+    uint64_t start = histogram_now();
+    if (!db_exec(db, "VACUUM;")) {
+        return false;
+    }
+    report_extended_result(vacuum_tag_base, "elapsed", (histogram_now() - start) / 1e9, "s");
+
+    return report_state(vacuum_tag_base, db, fresh_query_time);
+}
+
+static bool incremental_vacuum(const char *tag_base, sqlite3 *db, double *fresh_query_time)
+{
+    char vacuum_tag_base[TAG_MAX];
+    char sql[SQL_MAX];
+    double free_pages;
+    bool ok = false;
+    histogram *steps = histogram_create();
+
+    format_tag(vacuum_tag_base, tag_base, "incremental_vacuum");
+    sql_sprintf(sql, "PRAGMA incremental_vacuum(%d);", INCREMENTAL_VACUUM_PAGES);
+
+    if (steps == NULL) {
+        goto fail;
+    }
+
+    uint64_t start = histogram_now();
+    do {
+        if (!db_exec_timed(db, sql, steps)
+                || !query_value(db, "PRAGMA freelist_count;", &free_pages)) {
+            goto fail;
+        }
+    } while (free_pages > 0);
+    double elapsed = (histogram_now() - start) / 1e9;
+
+    report_extended_result(vacuum_tag_base, "elapsed", elapsed, "s");
+    report_latencies(vacuum_tag_base, steps, 0);
+    report_extended_result(vacuum_tag_base, "steps", steps->count, "");
+
+    ok = report_state(vacuum_tag_base, db, fresh_query_time);
+
+fail:
+    histogram_destroy(steps);
+
+    return ok;
+}
+
+static int aging_pass(const char *tag_base, const char *db_file, int table_size,
+        bool incremental)
+{
+    BLTS_DEBUG("START %s(table_size=%d, incremental=%d)\n", __FUNCTION__, table_size,
+            incremental);
+
+    int retv = EXIT_FAILURE;
+    int cycle;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *delete = NULL;
+    sqlite3_stmt *update = NULL;
+    sqlite3_stmt *insert = NULL;
+    double fresh_query_time = 0;
+    uint64_t state = generator_seed();
+    int churn_rows = (long)table_size * CHURN_PERMILLE / 1000;
+
+    row_generator *rows = row_generator_create(table_size, AGING_CYCLES * churn_rows, NULL);
+
+    if (rows == NULL || !db_open_truncate(&db, db_file)) {
+        goto fail;
+    }
+
+    // must be set before the first table is created
+    if (!db_exec(db, incremental ? "PRAGMA auto_vacuum=INCREMENTAL;"
+                : "PRAGMA auto_vacuum=NONE;")) {
+        goto fail;
+    }
+
+    if (!db_create_table(db, "t1", table_size) || !db_create_index(db, "i1a on t1(a)")
+            || !db_create_index(db, "i1b on t1(b)")) {
+        goto fail;
+    }
+
+    if (!db_prepare(db, &delete, DELETE_SQL) || !db_prepare(db, &update, UPDATE_SQL)
+            || !db_prepare(db, &insert, "INSERT INTO t1 VALUES(?1, ?2, ?3);")) {
+        goto fail;
+    }
+
+    char cycle_tag_base[TAG_MAX];
+    format_tag(cycle_tag_base, tag_base, "cycle_0");
+    if (!report_state(cycle_tag_base, db, &fresh_query_time)) {
+        goto fail;
+    }
+
+    uint64_t churn_ns = 0;
+    for (cycle = 1; cycle <= AGING_CYCLES; ++cycle) {
+        uint64_t start = histogram_now();
+        if (!age_cycle(db, delete, update, insert, rows, churn_rows, &state)) {
+            goto fail;
+        }
+        churn_ns += histogram_now() - start;
+
+        if (cycle % REPORT_CYCLES == 0) {
+            char cycle_tag[32];
+            snprintf(cycle_tag, sizeof(cycle_tag), "cycle_%d", cycle);
+            format_tag(cycle_tag_base, tag_base, cycle_tag);
+            if (!report_state(cycle_tag_base, db, &fresh_query_time)) {
+                goto fail;
+            }
+        }
+    }
+
+    report_extended_result(tag_base, "churn_time", churn_ns / 1e9 - row_generator_overhead(rows),
+            "s");
+
+    if (incremental) {
+        if (!incremental_vacuum(tag_base, db, &fresh_query_time)) {
+            goto fail;
+        }
+    } else {
+        if (!db_is_in_memory(db_file) && !vacuum_into(tag_base, db, db_file)) {
+            goto fail;
+        }
+        if (!vacuum(tag_base, db, &fresh_query_time)) {
+            goto fail;
+        }
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    sqlite3_finalize(delete);
+    sqlite3_finalize(update);
+    sqlite3_finalize(insert);
+    db_close(db);
+    row_generator_destroy(rows);
+
+    return retv;
+}
+
+int test_aging(const char *tag_base, const char *db_file, int table_size)
+{
+    char pass_tag_base[TAG_MAX];
+    int retv = EXIT_SUCCESS;
+
+    format_tag(pass_tag_base, tag_base, "none");
+    if (aging_pass(pass_tag_base, db_file, table_size, false) != EXIT_SUCCESS) {
+        retv = EXIT_FAILURE;
+    }
+
+    format_tag(pass_tag_base, tag_base, "incremental");
+    if (aging_pass(pass_tag_base, db_file, table_size, true) != EXIT_SUCCESS) {
+        retv = EXIT_FAILURE;
+    }
+
+    return retv;
+}
@@ -0,0 +1,464 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Copying a whole database: online backups with sqlite3_backup_step() copying all pages at once
+ * or a few of them per step, the latter also while another connection keeps writing to the
+ * source, VACUUM INTO, and sqlite3_serialize()/sqlite3_deserialize() between the file and
+ * memory. The database is populated by db_create_table() at a quarter of, one and four times
+ * the table size, results are tagged '<tag_base>.rows_<N>.<copy>.*' and include the throughput
+ * in MB/s of database bytes copied. Writers running during a backup report how long they were
+ * blocked by it. In-memory databases are copied to a file in the temporary directory instead of
+ * next to the database, and the concurrent backup, needing a second connection, is skipped.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "generator.h"
+#include "histogram.h"
+#include "report.h"
+
+enum {
+    // pages sqlite3_backup_step() copies at a time while the writer runs
+    CONCURRENT_STEP_PAGES = 64,
+    // transactions of the writer, spread out so that the backup may make progress between them
+    WRITER_TRANSACTIONS = 50,
+    WRITER_INTERVAL_US = 10000,
+    // how long the writer waits for a lock, and the backup for a step, before giving up
+    WRITER_BUSY_TIMEOUT_US = 60 * 1000 * 1000,
+    BACKUP_BUSY_TIMEOUT_US = 60 * 1000 * 1000,
+    BUSY_RETRY_DELAY_US = 100,
+};
+
+// pages copied per sqlite3_backup_step(), -1 copies all of them in one step
+static const int step_pages[] = { -1, 256, 16 };
+
+// table sizes, in quarters of the configured one
+static const int size_quarters[] = { 1, 4, 16 };
+
+typedef struct {
+    const char *db_file;
+    pthread_t thread;
+    histogram *latencies;
+    // set by the busy handler when a statement first finds the database locked
+    uint64_t busy_since;
+    uint64_t blocked_ns;
+    uint64_t blocked_max_ns;
+    int n_blocked;
+    bool failed;
+} writer;
+
+typedef struct {
+    int n_steps;
+    // times sqlite3_backup_remaining() grew, the backup starting over after a write by another
+    // connection
+    int n_restarts;
+} backup_stats;
+
+static bool query_db_size(sqlite3 *db, double *size)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool ok = db_prepare(db, &stmt, "SELECT page_count * page_size FROM pragma_page_count(), "
+            "pragma_page_size();") && sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *size = sqlite3_column_double(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+static void report_copy(const char *tag_base, const char *tag, double elapsed, double size)
+{
+    char copy_tag_base[TAG_MAX];
+    format_tag(copy_tag_base, tag_base, tag);
+
+    report_extended_result(copy_tag_base, "elapsed", elapsed, "s");
+    if (elapsed > 0) {
+        report_extended_result(copy_tag_base, "throughput", size / 1e6 / elapsed, "MB/s");
+    }
+}
+
+static int writer_busy_handler(void *arg, int n_calls)
+{
+    writer *w = arg;
+
+    if (n_calls == 0) {
+        w->busy_since = histogram_now();
+    }
+    if ((long)n_calls * BUSY_RETRY_DELAY_US >= WRITER_BUSY_TIMEOUT_US) {
+        return 0;
+    }
+
+    usleep(BUSY_RETRY_DELAY_US);
+    return 1;
+}
+
+// accounts the time since the busy handler was first called for the last statement
+static void writer_unblocked(writer *w)
+{
+    if (w->busy_since == 0) {
+        return;
+    }
+
+    uint64_t blocked = histogram_now() - w->busy_since;
+    w->blocked_ns += blocked;
+    if (blocked > w->blocked_max_ns) {
+        w->blocked_max_ns = blocked;
+    }
+    ++w->n_blocked;
+    w->busy_since = 0;
+}
+
+static void *writer_main(void *arg)
+{
+    writer *w = arg;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *update = NULL;
+    uint64_t state = generator_seed();
+    int i;
+
+    w->failed = true;
+
+    if (!db_open(&db, w->db_file)) {
+        goto fail;
+    }
+    sqlite3_busy_handler(db, writer_busy_handler, w);
+
+    if (!db_prepare(db, &update, "UPDATE t1 SET b = b + 1 WHERE rowid = ?1;")) {
+        goto fail;
+    }
+
+    for (i = 0; i < WRITER_TRANSACTIONS; ++i) {
+        uint64_t start = histogram_now();
+
+        sqlite3_bind_int(update, 1, 1 + generator_random(&state) % 1000);
+        bool ok = db_begin_transaction(db) && db_step_reset(update)
+            && db_commit_transaction(db);
+        writer_unblocked(w);
+        if (!ok) {
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            goto fail;
+        }
+
+        histogram_record(w->latencies, histogram_now() - start);
+        usleep(WRITER_INTERVAL_US);
+    }
+
+    w->failed = false;
+
+fail:
+    sqlite3_finalize(update);
+    db_close(db);
+
+    return NULL;
+}
+
+// copies db to a new database at dest_file, pages per step
+static bool backup(sqlite3 *db, const char *dest_file, int pages, backup_stats *stats)
+{
+    sqlite3 *dest = NULL;
+    int remaining = INT_MAX;
+    uint64_t busy_start = 0;
+    int rc;
+
+    memset(stats, 0, sizeof(backup_stats));
+
+    if (!db_open_truncate(&dest, dest_file)) {
+        db_close(dest);
+        return false;
+    }
+
+    sqlite3_backup *b = sqlite3_backup_init(dest, "main", db, "main");
+    if (b == NULL) {
+        BLTS_ERROR("%s: sqlite3_backup_init() failed: %s\n", __FUNCTION__, sqlite3_errmsg(dest));
+        db_close(dest);
+        return false;
+    }
+
+    do {
+        rc = sqlite3_backup_step(b, pages);
+        ++stats->n_steps;
+
+        if (sqlite3_backup_remaining(b) > remaining) {
+            ++stats->n_restarts;
+        }
+        remaining = sqlite3_backup_remaining(b);
+
+        // the locks are released between steps, let writers have them
+        if (rc == SQLITE_OK) {
+            busy_start = 0;
+            sched_yield();
+        } else if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            if (busy_start == 0) {
+                busy_start = histogram_now();
+            } else if (histogram_now() - busy_start >= BACKUP_BUSY_TIMEOUT_US * 1000ULL) {
+                break;
+            }
+            usleep(BUSY_RETRY_DELAY_US);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    sqlite3_backup_finish(b);
+    if (rc != SQLITE_DONE) {
+        BLTS_ERROR("%s: sqlite3_backup_step() failed: %s\n", __FUNCTION__, sqlite3_errstr(rc));
+    }
+    db_close(dest);
+
+    return rc == SQLITE_DONE;
+}
+
+static bool backup_pass(const char *tag_base, sqlite3 *db, const char *dest_file, int pages,
+        double size)
+{
+    backup_stats stats;
+    char tag[32];
+
+    if (pages < 0) {
+        snprintf(tag, sizeof(tag), "backup_all");
+    } else {
+        snprintf(tag, sizeof(tag), "backup_%d", pages);
+    }
+
+    uint64_t start = histogram_now();
+    if (!backup(db, dest_file, pages, &stats)) {
+        return false;
+    }
+    double elapsed = (histogram_now() - start) / 1e9;
+
+    char backup_tag_base[TAG_MAX];
+    format_tag(backup_tag_base, tag_base, tag);
+    report_copy(tag_base, tag, elapsed, size);
+    report_extended_result(backup_tag_base, "steps", stats.n_steps, "");
+
+    return db_remove(dest_file);
+}
+
+// backs up in small steps while a writer updates the source on a connection of its own
+static bool concurrent_backup_pass(const char *tag_base, sqlite3 *db, const char *db_file,
+        const char *dest_file, double size)
+{
+    bool retv = false;
+    backup_stats stats;
+    writer w = { .db_file = db_file, .latencies = histogram_create() };
+
+    if (w.latencies == NULL) {
+        return false;
+    }
+
+    int rc = pthread_create(&w.thread, NULL, writer_main, &w);
+    if (rc != 0) {
+        BLTS_ERROR("%s: pthread_create() failed: %s\n", __FUNCTION__, strerror(rc));
+        histogram_destroy(w.latencies);
+        return false;
+    }
+
+    uint64_t start = histogram_now();
+    bool backed_up = backup(db, dest_file, CONCURRENT_STEP_PAGES, &stats);
+    double elapsed = (histogram_now() - start) / 1e9;
+
+    pthread_join(w.thread, NULL);
+
+    if (!backed_up || w.failed) {
+        goto fail;
+    }
+
+    char concurrent_tag_base[TAG_MAX];
+    format_tag(concurrent_tag_base, tag_base, "backup_concurrent");
+    report_copy(tag_base, "backup_concurrent", elapsed, size);
+    report_extended_result(concurrent_tag_base, "steps", stats.n_steps, "");
+    report_extended_result(concurrent_tag_base, "restarts", stats.n_restarts, "");
+
+    char writer_tag_base[TAG_MAX];
+    format_tag(writer_tag_base, concurrent_tag_base, "writer");
+    report_latencies(writer_tag_base, w.latencies, 0);
+    report_extended_result(writer_tag_base, "blocked", w.blocked_ns / 1e9, "s");
+    report_extended_result(writer_tag_base, "blocked_max", w.blocked_max_ns / 1e6, "ms");
+    report_extended_result(writer_tag_base, "blocked_transactions", w.n_blocked, "");
+
+    retv = db_remove(dest_file);
+
+fail:
+    histogram_destroy(w.latencies);
+
+    return retv;
+}
+
+static bool vacuum_into_pass(const char *tag_base, sqlite3 *db, const char *dest_file,
+        double size)
+{
+    char sql[SQL_MAX + PATH_MAX];
+    snprintf(sql, sizeof(sql), "VACUUM INTO '%s';", dest_file);
+
+    if (!db_remove(dest_file)) {
+        return false;
+    }
+
+    uint64_t start = histogram_now();
+    if (!db_exec(db, sql)) {
+        return false;
+    }
+    report_copy(tag_base, "vacuum_into", (histogram_now() - start) / 1e9, size);
+
+    return db_remove(dest_file);
+}
+
+// file to memory and back: serializes the database, deserializes the image into an in-memory
+// connection and backs that up to a file
+static bool serialize_pass(const char *tag_base, sqlite3 *db, const char *dest_file)
+{
+    bool retv = false;
+    sqlite3 *memory = NULL;
+    sqlite3_int64 size;
+    backup_stats stats;
+
+    uint64_t start = histogram_now();
+    unsigned char *image = sqlite3_serialize(db, "main", &size, 0);
+    if (image == NULL) {
+        BLTS_ERROR("%s: sqlite3_serialize() failed\n", __FUNCTION__);
+        goto fail;
+    }
+    report_copy(tag_base, "serialize", (histogram_now() - start) / 1e9, size);
+
+    if (!db_open_truncate(&memory, ":memory:")) {
+        goto fail;
+    }
+
+    // deserializing adopts the buffer, the copy made first is the expensive part
+    start = histogram_now();
+    unsigned char *copy = sqlite3_malloc64(size);
+    if (copy == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        goto fail;
+    }
+    memcpy(copy, image, size);
+    int rc = sqlite3_deserialize(memory, "main", copy, size, size,
+            SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s: sqlite3_deserialize() failed: %s\n", __FUNCTION__, sqlite3_errstr(rc));
+        goto fail;
+    }
+    report_copy(tag_base, "deserialize", (histogram_now() - start) / 1e9, size);
+
+    start = histogram_now();
+    if (!backup(memory, dest_file, -1, &stats)) {
+        goto fail;
+    }
+    report_copy(tag_base, "memory_to_file", (histogram_now() - start) / 1e9, size);
+
+    retv = db_remove(dest_file);
+
+fail:
+    db_close(memory);
+    sqlite3_free(image);
+
+    return retv;
+}
+
+static bool size_pass(const char *tag_base, const char *db_file, const char *dest_file,
+        int n_rows)
+{
+    static const fixture t1_i1b = { { "t1" }, { "i1b on t1(b)" } };
+    bool retv = false;
+    sqlite3 *db = NULL;
+    double size;
+    unsigned i;
+
+    char size_tag[32];
+    char size_tag_base[TAG_MAX];
+    snprintf(size_tag, sizeof(size_tag), "rows_%d", n_rows);
+    format_tag(size_tag_base, tag_base, size_tag);
+
+    if (!db_open_fixture(&db, db_file, &t1_i1b, n_rows) || !query_db_size(db, &size)) {
+        goto fail;
+    }
+    report_extended_result(size_tag_base, "db_size", size, "B");
+
+    for (i = 0; i < sizeof(step_pages) / sizeof(step_pages[0]); ++i) {
+        if (!backup_pass(size_tag_base, db, dest_file, step_pages[i], size)) {
+            goto fail;
+        }
+    }
+
+    if (db_is_in_memory(db_file)) {
+        BLTS_DEBUG("%s: backup_concurrent requires a file-backed database, skipped\n",
+                __FUNCTION__);
+    } else if (!concurrent_backup_pass(size_tag_base, db, db_file, dest_file, size)) {
+        goto fail;
+    }
+
+    if (!vacuum_into_pass(size_tag_base, db, dest_file, size)) {
+        goto fail;
+    }
+
+    if (!serialize_pass(size_tag_base, db, dest_file)) {
+        goto fail;
+    }
+
+    retv = true;
+
+fail:
+    db_close(db);
+
+    return retv;
+}
+
+int test_backup(const char *tag_base, const char *db_file, int table_size)
+{
+    BLTS_DEBUG("START %s(table_size=%d)\n", __FUNCTION__, table_size);
+
+    char dest_file[PATH_MAX];
+    unsigned i;
+
+    int n_written;
+    if (db_is_in_memory(db_file)) {
+        const char *tmp_dir = getenv("TMPDIR");
+        n_written = snprintf(dest_file, PATH_MAX, "%s/blts-sqlite-perf-%d-backup",
+                tmp_dir != NULL ? tmp_dir : P_tmpdir, (int)getpid());
+    } else {
+        n_written = snprintf(dest_file, PATH_MAX, "%s-backup", db_file);
+    }
+    if (n_written >= PATH_MAX) {
+        BLTS_ERROR("%s: PATH_MAX exceeded\n", db_file);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < sizeof(size_quarters) / sizeof(size_quarters[0]); ++i) {
+        long n_rows = (long)table_size * size_quarters[i] / 4;
+        if (!size_pass(tag_base, db_file, dest_file, n_rows > 0 ? n_rows : 1)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
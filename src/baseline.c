@@ -0,0 +1,316 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "baseline.h"
+#include "report.h"
+
+typedef struct {
+    char tag[TAG_MAX];
+    char unit[UNIT_MAX];
+    int n;
+    double mean;
+    double stddev;
+} baseline_entry;
+
+typedef struct {
+    baseline_entry *entries;
+    int n_entries;
+    int capacity;
+} baseline_entries;
+
+static baseline_entries baseline = { NULL, 0, 0 };
+static baseline_entries current = { NULL, 0, 0 };
+static double regression_threshold = 0;
+static int n_regressions = 0;
+
+static baseline_entry *add_entry(baseline_entries *entries)
+{
+    if (entries->n_entries == entries->capacity) {
+        int new_capacity = entries->capacity ? entries->capacity * 2 : 64;
+        baseline_entry *new_entries = realloc(entries->entries,
+                new_capacity * sizeof(baseline_entry));
+        if (new_entries == NULL) {
+            return NULL;
+        }
+        entries->entries = new_entries;
+        entries->capacity = new_capacity;
+    }
+
+    baseline_entry *entry = &entries->entries[entries->n_entries++];
+    memset(entry, 0, sizeof(baseline_entry));
+
+    return entry;
+}
+
+static const baseline_entry *find_entry(const baseline_entries *entries, const char *full_tag)
+{
+    int i;
+    for (i = entries->n_entries - 1; i >= 0; --i) {
+        if (strcmp(entries->entries[i].tag, full_tag) == 0) {
+            return &entries->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+// 1 if higher values are better, -1 if lower, 0 if the result is not compared
+static int direction(const char *full_tag, const char *unit)
+{
+    // these measure the benchmark itself or are derived from other results
+    if (strstr(full_tag, "generator_overhead") != NULL
+            || strstr(full_tag, "parse_overhead") != NULL) {
+        return 0;
+    }
+
+    if (strcmp(unit, "s") == 0 || strcmp(unit, "ms") == 0 || strcmp(unit, "us") == 0) {
+        return -1;
+    }
+    // operation rates and throughputs
+    if (strcmp(unit, "1/s") == 0 || strcmp(unit, "MB/s") == 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// whole-run times and rates are steady enough to be compared by the threshold alone, unlike
+// tail latencies or counters of a single run
+static bool is_comparable_alone(const char *full_tag, const char *unit)
+{
+    static const char elapsed[] = ".elapsed";
+    size_t length = strlen(full_tag);
+
+    return strcmp(unit, "1/s") == 0 || strcmp(unit, "MB/s") == 0
+        || (length >= sizeof(elapsed) - 1
+                && strcmp(full_tag + length - (sizeof(elapsed) - 1), elapsed) == 0);
+}
+
+static bool is_significant(const baseline_entry *base, const sample_stats *stats)
+{
+    // without variance information the threshold decides alone
+    if (base->n < 2 || stats->n < 2) {
+        return true;
+    }
+
+    double base_var = base->stddev * base->stddev / base->n;
+    double var = stats->stddev * stats->stddev / stats->n;
+    if (base_var + var == 0) {
+        return true;
+    }
+
+    double t = fabs(stats->mean - base->mean) / sqrt(base_var + var);
+    double df = (base_var + var) * (base_var + var)
+        / (base_var * base_var / (base->n - 1) + var * var / (stats->n - 1));
+
+    return t > t_critical_95(df);
+}
+
+// position of the value of '"key": ' in line, NULL if absent
+static const char *json_field(const char *line, const char *key)
+{
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+
+    const char *value = strstr(line, pattern);
+    return value != NULL ? value + strlen(pattern) : NULL;
+}
+
+// parses a result line the way json.c writes them, one per line; false for other lines and
+// results without a value
+static bool parse_json_entry(const char *line, baseline_entry *entry)
+{
+    static const char result_start[] = "    {\"tag\": \"";
+
+    if (strncmp(line, result_start, sizeof(result_start) - 1) != 0
+            || sscanf(line + sizeof(result_start) - 1, "%255[^\"]", entry->tag) != 1) {
+        return false;
+    }
+
+    const char *unit = json_field(line, "unit");
+    const char *value = json_field(line, "value");
+    if (unit == NULL || value == NULL || sscanf(value, "%lf", &entry->mean) != 1) {
+        return false;
+    }
+    if (sscanf(unit, "\"%15[^\"]", entry->unit) != 1) {
+        entry->unit[0] = '\0';
+    }
+
+    // single results have neither
+    const char *iterations = json_field(line, "iterations");
+    const char *stddev = json_field(line, "stddev");
+    entry->n = iterations != NULL ? atoi(iterations) : 1;
+    entry->stddev = stddev != NULL ? strtod(stddev, NULL) : 0;
+
+    return entry->n >= 1;
+}
+
+bool baseline_load(const char *path, double threshold)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        BLTS_ERROR("%s: Failed to open baseline: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[TAG_MAX + 256];
+    int line_num = 0;
+    bool json = false;
+    bool continued = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        // the values of results saved by -json may not fit, the rest of such lines is skipped
+        bool continuation = continued;
+        continued = strchr(line, '\n') == NULL;
+        if (continuation) {
+            continue;
+        }
+
+        if (++line_num == 1) {
+            json = line[0] == '{';
+        }
+
+        baseline_entry entry;
+        memset(&entry, 0, sizeof(entry));
+
+        if (json) {
+            if (!parse_json_entry(line, &entry)) {
+                continue;
+            }
+        } else if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        } else {
+            int n_fields = sscanf(line, "%255[^,],%d,%lf,%lf,%15[^,\n]", entry.tag, &entry.n,
+                &entry.mean, &entry.stddev, entry.unit);
+            if (n_fields < 4 || entry.n < 1) {
+                BLTS_ERROR("%s:%d: Invalid baseline entry\n", path, line_num);
+                fclose(file);
+                return false;
+            }
+        }
+
+        baseline_entry *added = add_entry(&baseline);
+        if (added == NULL) {
+            fclose(file);
+            return false;
+        }
+        *added = entry;
+    }
+
+    fclose(file);
+
+    regression_threshold = threshold;
+    BLTS_DEBUG("Loaded %d baseline results from %s\n", baseline.n_entries, path);
+
+    return true;
+}
+
+void baseline_check(const char *full_tag, const char *unit, const sample_stats *stats)
+{
+    baseline_entry *entry = add_entry(&current);
+    if (entry != NULL) {
+        snprintf(entry->tag, TAG_MAX, "%s", full_tag);
+        snprintf(entry->unit, UNIT_MAX, "%s", unit);
+        entry->n = stats->n;
+        entry->mean = stats->mean;
+        entry->stddev = stats->stddev;
+    }
+
+    if (baseline.n_entries == 0) {
+        return;
+    }
+
+    int better = direction(full_tag, unit);
+    if (better == 0) {
+        return;
+    }
+
+    const baseline_entry *base = find_entry(&baseline, full_tag);
+    if (base == NULL) {
+        BLTS_DEBUG("%s: Not in baseline\n", full_tag);
+        return;
+    }
+    if (base->mean == 0) {
+        return;
+    }
+    if ((base->n < 2 || stats->n < 2) && !is_comparable_alone(full_tag, unit)) {
+        return;
+    }
+
+    double change = (stats->mean - base->mean) / base->mean;
+    if (fabs(change) <= regression_threshold || !is_significant(base, stats)) {
+        return;
+    }
+
+    if (change * better < 0) {
+        BLTS_ERROR("%s: Regression: %g %s, baseline %g %s (%+.1f%%)\n", full_tag, stats->mean,
+                unit, base->mean, unit, change * 100);
+        ++n_regressions;
+    } else {
+        BLTS_DEBUG("%s: Improvement: %g %s, baseline %g %s (%+.1f%%)\n", full_tag, stats->mean,
+                unit, base->mean, unit, change * 100);
+    }
+}
+
+int baseline_regressions(void)
+{
+    return n_regressions;
+}
+
+bool baseline_save(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        BLTS_ERROR("%s: Failed to open baseline: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fprintf(file, "# tag,n,mean,stddev,unit\n");
+
+    int i;
+    for (i = 0; i < current.n_entries; ++i) {
+        const baseline_entry *entry = &current.entries[i];
+        fprintf(file, "%s,%d,%.17g,%.17g,%s\n", entry->tag, entry->n, entry->mean,
+                entry->stddev, entry->unit);
+    }
+
+    if (fclose(file) != 0) {
+        BLTS_ERROR("%s: Failed to write baseline: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void baseline_clear(void)
+{
+    free(baseline.entries);
+    free(current.entries);
+    memset(&baseline, 0, sizeof(baseline));
+    memset(&current, 0, sizeof(current));
+    n_regressions = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdbool.h>
+
+#include "stats.h"
+
+/*
+ * Comparison of results against a baseline saved by an earlier run.
+ *
+ * The baseline is a CSV file with one 'tag,n,mean,stddev,unit' line per result, or the
+ * document written by -json, whose results without a value are ignored. Results in
+ * seconds and microseconds are expected not to grow, results per second not to drop, by more
+ * than the threshold (relative to the baseline mean). When both runs did multiple iterations,
+ * the change must also be significant by Welch's t-test at the 95% level. Otherwise only
+ * '.elapsed' times and rates are compared, other results of single runs vary too much.
+ */
+
+bool baseline_load(const char *path, double threshold);
+
+// compares a result with the baseline, if loaded, and remembers it for baseline_save()
+void baseline_check(const char *full_tag, const char *unit, const sample_stats *stats);
+
+// number of regressions found by baseline_check() so far
+int baseline_regressions(void);
+
+// writes all results passed to baseline_check() so that they can be loaded by baseline_load()
+bool baseline_save(const char *path);
+
+void baseline_clear(void);
+
+#endif // BASELINE_H
@@ -0,0 +1,614 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Large records: blobs of each of the given sizes inserted, read and updated whole through
+ * sqlite3_bind_blob() and sqlite3_column_blob(), and incrementally through sqlite3_blob_open(),
+ * including inserting zeroblob() placeholders written in chunks afterwards and rewriting a small
+ * part of each blob in place. About n_bytes of blobs (at least MIN_BLOB_ROWS of them) are stored
+ * per size, results are tagged '<tag_base>.<size>.<phase>.*' along with the number of overflow
+ * pages the blobs took. Wide rows of WIDE_COLUMNS columns are inserted and read by their first or
+ * last column under '<tag_base>.wide.<phase>.*'.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+
+enum {
+    MIN_BLOB_ROWS = 4,
+    // incremental I/O is done in chunks of this size
+    BLOB_CHUNK = 64 * 1024,
+    // rewritten in the middle of each blob by the incremental_update phase
+    PARTIAL_UPDATE_BYTES = 4096,
+    WIDE_COLUMNS = 100,
+};
+
+typedef struct {
+    histogram *latencies;
+    uint64_t start;
+    uint64_t bytes;
+    // spent generating test data during the phase, not part of its elapsed time
+    uint64_t generator_ns;
+} phase;
+
+static void phase_start(phase *p, sqlite3 *db)
+{
+    histogram_reset(p->latencies);
+    p->bytes = 0;
+    p->generator_ns = 0;
+    db_reset_status(db);
+    io_accounting_start();
+    p->start = histogram_now();
+}
+
+static void phase_stop(const char *tag_base, const char *tag, phase *p, sqlite3 *db)
+{
+    double elapsed = (histogram_now() - p->start - p->generator_ns) / 1e9;
+    io_accounting_stop();
+
+    char phase_tag_base[TAG_MAX];
+    format_tag(phase_tag_base, tag_base, tag);
+
+    report_extended_result(phase_tag_base, "elapsed", elapsed, "s");
+    if (p->generator_ns > 0) {
+        report_extended_result(phase_tag_base, "generator_overhead", p->generator_ns / 1e9, "s");
+    }
+    if (p->bytes > 0 && elapsed > 0) {
+        report_extended_result(phase_tag_base, "throughput", p->bytes / 1e6 / elapsed, "MB/s");
+    }
+    report_latencies(phase_tag_base, p->latencies, elapsed);
+    report_io_accounting(phase_tag_base);
+    db_report_status(phase_tag_base, db);
+}
+
+static void record_op(phase *p, uint64_t start, uint64_t bytes)
+{
+    histogram_record(p->latencies, histogram_now() - start);
+    p->bytes += bytes;
+}
+
+// requires sqlite built with SQLITE_ENABLE_DBSTAT_VTAB, not reported otherwise
+static void report_overflow_pages(const char *tag_base, sqlite3 *db, const char *table)
+{
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_prepare_v2(db, "SELECT count(*) FROM dbstat WHERE name = ?1 "
+                "AND pagetype = 'overflow';", -1, &stmt, NULL) != SQLITE_OK) {
+        BLTS_DEBUG("%s: dbstat not available: %s\n", __FUNCTION__, sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return;
+    }
+
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        report_extended_result(tag_base, "overflow_pages", sqlite3_column_int64(stmt, 0), "");
+    }
+    sqlite3_finalize(stmt);
+}
+
+// stamps the blob with its row so that rows differ
+static void stamp(unsigned char *data, int size, int id)
+{
+    memcpy(data, &id, size < (int)sizeof(id) ? size : (int)sizeof(id));
+}
+
+static bool insert(const char *tag_base, sqlite3 *db, phase *p, unsigned char *data, int size,
+        int n_rows)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool retv = false;
+    int i;
+
+    if (!db_prepare(db, &stmt, "INSERT INTO b VALUES(?1, ?2);")) {
+        return false;
+    }
+
+    phase_start(p, db);
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t start = histogram_now();
+        stamp(data, size, i);
+        sqlite3_bind_int(stmt, 1, i);
+        sqlite3_bind_blob(stmt, 2, data, size, SQLITE_STATIC);
+        if (!db_step_reset(stmt)) {
+            goto fail;
+        }
+        record_op(p, start, size);
+    }
+
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+    phase_stop(tag_base, "insert", p, db);
+
+    retv = true;
+
+fail:
+    if (!retv) {
+        io_accounting_stop();
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+// inserts zeroblob() placeholders and fills them in chunks through sqlite3_blob_write()
+static bool zeroblob_insert(const char *tag_base, sqlite3 *db, phase *p, unsigned char *data,
+        int size, int n_rows)
+{
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_blob *blob = NULL;
+    bool retv = false;
+    int i, offset;
+
+    if (!db_exec(db, "CREATE TABLE z(id INTEGER PRIMARY KEY, data BLOB);")
+            || !db_prepare(db, &stmt, "INSERT INTO z VALUES(?1, zeroblob(?2));")) {
+        return false;
+    }
+
+    phase_start(p, db);
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t start = histogram_now();
+        sqlite3_bind_int(stmt, 1, i);
+        sqlite3_bind_int(stmt, 2, size);
+        if (!db_step_reset(stmt)) {
+            goto fail;
+        }
+
+        int rc = blob == NULL ? sqlite3_blob_open(db, "main", "z", "data", i, 1, &blob)
+            : sqlite3_blob_reopen(blob, i);
+        for (offset = 0; rc == SQLITE_OK && offset < size; offset += BLOB_CHUNK) {
+            int n = size - offset < BLOB_CHUNK ? size - offset : BLOB_CHUNK;
+            rc = sqlite3_blob_write(blob, data + offset, n, offset);
+        }
+        if (rc != SQLITE_OK) {
+            BLTS_ERROR("%s: Writing blob %d failed: %s\n", __FUNCTION__, i, sqlite3_errmsg(db));
+            goto fail;
+        }
+        record_op(p, start, size);
+    }
+
+    sqlite3_blob_close(blob);
+    blob = NULL;
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+    phase_stop(tag_base, "zeroblob_insert", p, db);
+
+    retv = true;
+
+fail:
+    sqlite3_blob_close(blob);
+    if (!retv) {
+        io_accounting_stop();
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+// reads each row in random order, whole with sqlite3_column_blob()
+static bool read_whole(const char *tag_base, sqlite3 *db, phase *p, int n_rows)
+{
+    sqlite3_stmt *stmt = NULL;
+    uint64_t state = generator_seed();
+    bool retv = false;
+    int i;
+
+    if (!db_prepare(db, &stmt, "SELECT data FROM b WHERE id = ?1;")) {
+        return false;
+    }
+
+    phase_start(p, db);
+
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t start = histogram_now();
+        sqlite3_bind_int(stmt, 1, generator_random(&state) % n_rows);
+        if (sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_blob(stmt, 0) == NULL) {
+            BLTS_ERROR("%s: Reading blob failed: %s\n", __FUNCTION__, sqlite3_errmsg(db));
+            io_accounting_stop();
+            goto fail;
+        }
+        int n = sqlite3_column_bytes(stmt, 0);
+        sqlite3_reset(stmt);
+        record_op(p, start, n);
+    }
+
+    phase_stop(tag_base, "read", p, db);
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+// reads each row in random order in chunks through sqlite3_blob_read()
+static bool incremental_read(const char *tag_base, sqlite3 *db, phase *p, unsigned char *data,
+        int size, int n_rows)
+{
+    sqlite3_blob *blob = NULL;
+    uint64_t state = generator_seed();
+    int rc = SQLITE_OK;
+    int i, offset;
+
+    phase_start(p, db);
+
+    for (i = 0; i < n_rows && rc == SQLITE_OK; ++i) {
+        uint64_t start = histogram_now();
+        int id = generator_random(&state) % n_rows;
+
+        rc = blob == NULL ? sqlite3_blob_open(db, "main", "b", "data", id, 0, &blob)
+            : sqlite3_blob_reopen(blob, id);
+        for (offset = 0; rc == SQLITE_OK && offset < size; offset += BLOB_CHUNK) {
+            int n = size - offset < BLOB_CHUNK ? size - offset : BLOB_CHUNK;
+            rc = sqlite3_blob_read(blob, data + offset, n, offset);
+        }
+        record_op(p, start, size);
+    }
+
+    sqlite3_blob_close(blob);
+
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s: Reading blob failed: %s\n", __FUNCTION__, sqlite3_errstr(rc));
+        io_accounting_stop();
+        return false;
+    }
+
+    phase_stop(tag_base, "incremental_read", p, db);
+    return true;
+}
+
+// rewrites each row whole with an UPDATE
+static bool update(const char *tag_base, sqlite3 *db, phase *p, unsigned char *data, int size,
+        int n_rows)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool retv = false;
+    int i;
+
+    if (!db_prepare(db, &stmt, "UPDATE b SET data = ?1 WHERE id = ?2;")) {
+        return false;
+    }
+
+    phase_start(p, db);
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t start = histogram_now();
+        stamp(data, size, n_rows + i);
+        sqlite3_bind_blob(stmt, 1, data, size, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, i);
+        if (!db_step_reset(stmt)) {
+            goto fail;
+        }
+        record_op(p, start, size);
+    }
+
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+    phase_stop(tag_base, "update", p, db);
+
+    retv = true;
+
+fail:
+    if (!retv) {
+        io_accounting_stop();
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+// rewrites PARTIAL_UPDATE_BYTES in the middle of each row in place
+static bool incremental_update(const char *tag_base, sqlite3 *db, phase *p, unsigned char *data,
+        int size, int n_rows)
+{
+    sqlite3_blob *blob = NULL;
+    int n = size < PARTIAL_UPDATE_BYTES ? size : PARTIAL_UPDATE_BYTES;
+    int rc = SQLITE_OK;
+    int i;
+
+    phase_start(p, db);
+    if (!db_begin_transaction(db)) {
+        io_accounting_stop();
+        return false;
+    }
+
+    for (i = 0; i < n_rows && rc == SQLITE_OK; ++i) {
+        uint64_t start = histogram_now();
+
+        rc = blob == NULL ? sqlite3_blob_open(db, "main", "b", "data", i, 1, &blob)
+            : sqlite3_blob_reopen(blob, i);
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_blob_write(blob, data, n, (size - n) / 2);
+        }
+        record_op(p, start, n);
+    }
+
+    sqlite3_blob_close(blob);
+
+    if (rc != SQLITE_OK || !db_commit_transaction(db)) {
+        BLTS_ERROR("%s: Writing blob failed: %s\n", __FUNCTION__, sqlite3_errstr(rc));
+        io_accounting_stop();
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        return false;
+    }
+
+    phase_stop(tag_base, "incremental_update", p, db);
+    return true;
+}
+
+static void format_size(char *tag, size_t tag_size, int size)
+{
+    if (size % (1024 * 1024) == 0) {
+        snprintf(tag, tag_size, "blob_%dm", size / (1024 * 1024));
+    } else if (size % 1024 == 0) {
+        snprintf(tag, tag_size, "blob_%dk", size / 1024);
+    } else {
+        snprintf(tag, tag_size, "blob_%d", size);
+    }
+}
+
+static bool blob_pass(const char *tag_base, const char *db_file, phase *p, int size, long n_bytes)
+{
+    bool retv = false;
+    sqlite3 *db = NULL;
+    uint64_t state = generator_seed();
+    int i;
+
+    long n_rows = n_bytes / size > MIN_BLOB_ROWS ? n_bytes / size : MIN_BLOB_ROWS;
+
+    char size_tag[32];
+    char size_tag_base[TAG_MAX];
+    format_size(size_tag, sizeof(size_tag), size);
+    format_tag(size_tag_base, tag_base, size_tag);
+
+    unsigned char *data = malloc(size);
+    if (data == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        return false;
+    }
+    for (i = 0; i < size; ++i) {
+        data[i] = generator_random(&state);
+    }
+
+    if (!db_open_truncate(&db, db_file)
+            || !db_exec(db, "CREATE TABLE b(id INTEGER PRIMARY KEY, data BLOB);")) {
+        goto fail;
+    }
+
+    if (!insert(size_tag_base, db, p, data, size, n_rows)) {
+        goto fail;
+    }
+    report_overflow_pages(size_tag_base, db, "b");
+
+    if (!zeroblob_insert(size_tag_base, db, p, data, size, n_rows)
+            || !read_whole(size_tag_base, db, p, n_rows)
+            || !incremental_read(size_tag_base, db, p, data, size, n_rows)
+            || !update(size_tag_base, db, p, data, size, n_rows)
+            || !incremental_update(size_tag_base, db, p, data, size, n_rows)) {
+        goto fail;
+    }
+
+    retv = true;
+
+fail:
+    db_close(db);
+    free(data);
+
+    return retv;
+}
+
+// appends to a growing SQL statement
+static bool append(char **sql, const char *text)
+{
+    size_t length = *sql != NULL ? strlen(*sql) : 0;
+    char *new_sql = realloc(*sql, length + strlen(text) + 1);
+    if (new_sql == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        return false;
+    }
+
+    strcpy(new_sql + length, text);
+    *sql = new_sql;
+    return true;
+}
+
+// builds the CREATE TABLE and INSERT statements of the wide table, columns alternate between
+// integers and strings
+static bool wide_sql(char **create_sql, char **insert_sql)
+{
+    char column[32];
+    int i;
+
+    bool ok = append(create_sql, "CREATE TABLE w(") && append(insert_sql, "INSERT INTO w VALUES(");
+    for (i = 0; ok && i < WIDE_COLUMNS; ++i) {
+        snprintf(column, sizeof(column), "%sc%d %s", i ? ", " : "", i, i % 2 ? "TEXT" : "INTEGER");
+        ok = append(create_sql, column);
+        snprintf(column, sizeof(column), "%s?%d", i ? ", " : "", i + 1);
+        ok = ok && append(insert_sql, column);
+    }
+
+    return ok && append(create_sql, ");") && append(insert_sql, ");");
+}
+
+static bool wide_read(const char *tag_base, const char *tag, sqlite3 *db, phase *p, int column,
+        int n_rows)
+{
+    sqlite3_stmt *stmt = NULL;
+    uint64_t state = generator_seed();
+    char sql[SQL_MAX];
+    int i;
+
+    sql_sprintf(sql, "SELECT c%d FROM w WHERE rowid = ?1;", column);
+    if (!db_prepare(db, &stmt, sql)) {
+        return false;
+    }
+
+    phase_start(p, db);
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t start = histogram_now();
+        sqlite3_bind_int(stmt, 1, 1 + generator_random(&state) % n_rows);
+        if (!db_step_reset(stmt)) {
+            io_accounting_stop();
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        record_op(p, start, 0);
+    }
+    phase_stop(tag_base, tag, p, db);
+
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+static bool wide_pass(const char *tag_base, const char *db_file, phase *p, int n_rows)
+{
+    bool retv = false;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    char *create_sql = NULL;
+    char *insert_sql = NULL;
+    uint64_t state = generator_seed();
+    // the values of one row, generated before timing its insert
+    test_data_row values[WIDE_COLUMNS];
+    int i, j;
+
+    char wide_tag_base[TAG_MAX];
+    format_tag(wide_tag_base, tag_base, "wide");
+
+    if (!wide_sql(&create_sql, &insert_sql)) {
+        goto fail;
+    }
+
+    if (!db_open_truncate(&db, db_file) || !db_exec(db, create_sql)
+            || !db_prepare(db, &stmt, insert_sql)) {
+        goto fail;
+    }
+
+    phase_start(p, db);
+    if (!db_begin_transaction(db)) {
+        io_accounting_stop();
+        goto fail;
+    }
+
+    for (i = 0; i < n_rows; ++i) {
+        uint64_t generator_start = histogram_now();
+        for (j = 0; j < WIDE_COLUMNS; ++j) {
+            generate_test_row(&values[j], &state);
+        }
+
+        uint64_t start = histogram_now();
+        p->generator_ns += start - generator_start;
+        for (j = 0; j < WIDE_COLUMNS; ++j) {
+            if (j % 2) {
+                sqlite3_bind_text(stmt, j + 1, values[j].string, -1, SQLITE_TRANSIENT);
+            } else {
+                sqlite3_bind_int(stmt, j + 1, values[j].number);
+            }
+        }
+        if (!db_step_reset(stmt)) {
+            io_accounting_stop();
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            goto fail;
+        }
+        record_op(p, start, 0);
+    }
+
+    if (!db_commit_transaction(db)) {
+        io_accounting_stop();
+        goto fail;
+    }
+    phase_stop(wide_tag_base, "insert", p, db);
+    report_overflow_pages(wide_tag_base, db, "w");
+
+    // the record header is parsed up to the column read
+    if (!wide_read(wide_tag_base, "read_first", db, p, 0, n_rows)
+            || !wide_read(wide_tag_base, "read_last", db, p, WIDE_COLUMNS - 1, n_rows)) {
+        goto fail;
+    }
+
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+    db_close(db);
+    free(create_sql);
+    free(insert_sql);
+
+    return retv;
+}
+
+int test_blob(const char *tag_base, const char *db_file, const int *blob_sizes, int n_blob_sizes,
+        long n_bytes, int n_wide_rows)
+{
+    BLTS_DEBUG("START %s(n_blob_sizes=%d, n_bytes=%ld, n_wide_rows=%d)\n", __FUNCTION__,
+            n_blob_sizes, n_bytes, n_wide_rows);
+
+    int retv = EXIT_FAILURE;
+    phase p = { .latencies = histogram_create() };
+    int i;
+
+    if (p.latencies == NULL) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_blob_sizes; ++i) {
+        if (!blob_pass(tag_base, db_file, &p, blob_sizes[i], n_bytes)) {
+            goto fail;
+        }
+    }
+
+    if (!wide_pass(tag_base, db_file, &p, n_wide_rows)) {
+        goto fail;
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    histogram_destroy(p.latencies);
+
+    return retv;
+}
@@ -24,85 +24,104 @@
  */
 
 #define _GNU_SOURCE
-#include <assert.h>
 #include <blts_log.h>
-#include <blts_reporting.h>
 #include <blts_timing.h>
-#include <errno.h>
 #include <limits.h>
 #include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "perf.h"
+#include "report.h"
+
+test_options test_opts;
 
 /*
- * Intentionally SQL queries are not executed using prepared statements in actual test code. This
- * follows the approach chosen in the original sqlite benchmark where all queries are read from
- * files. The utility sql_sprintf() is to make SQL query building easier.
+ * By default SQL queries are intentionally not executed using prepared statements in actual test
+ * code. This follows the approach chosen in the original sqlite benchmark where all queries are
+ * read from files. The utility sql_sprintf() is to make SQL query building easier.
+ *
+ * With test_opts.prepared set, the tests executing a query in a loop use a single prepared
+ * statement instead, binding new parameters for each iteration, so the cost of SQL parsing can be
+ * told apart from the cost of the actual work.
+ *
+ * Data and SQL text for the loops come from a row_generator in small batches. Batches are refilled
+ * while the clock runs, the time spent doing so is subtracted from the elapsed time and reported
+ * as '<tag>.generator_overhead'.
  */
 
-enum { SQL_MAX = 256 };
+// the populated databases the tests start from
+static const fixture T1 = { { "t1" }, { NULL } };
+static const fixture T1_I1B = { { "t1" }, { "i1 on t1(b)" } };
+static const fixture T1_I1AB = { { "t1" }, { "i1a on t1(a)", "i1b on t1(b)" } };
+static const fixture T1_T2_I2AB = { { "t1", "t2" }, { "i2a on t2(a)", "i2b on t2(b)" } };
+static const fixture T1_T2_T3 = {
+    { "t1", "t2", "t3" }, { "i2a on t2(a)", "i2b on t2(b)", "i3 on t3(c)" }
+};
 
-static void sql_sprintf(char *str, const char *format, ...)
+static void format_insert(char *sql, int index, const test_data_row *row)
 {
-    va_list ap;
-    va_start(ap, format);
-    int n_written = vsnprintf(str, SQL_MAX, format, ap);
-    assert(n_written < SQL_MAX);
+    sql_sprintf(sql, "INSERT INTO t1 VALUES(%d, %d, '%s');", index, row->number, row->string);
 }
 
-/*
- * generate_test_data() allocates array of test_data_row instances filled with random values.
- */
-
-enum { TEST_DATA_STRING_MAX = 256 };
+static void format_select(char *sql, int index, const test_data_row *row)
+{
+    (void)row;
+    sql_sprintf(sql, "SELECT count(*), avg(b) FROM t1 WHERE b >= %d AND b < %d;",
+            index * 100, 1000 + index * 100);
+}
 
-typedef struct {
-    int number;
-    char string[TEST_DATA_STRING_MAX];
-} test_data_row;
+static void format_select_compare_strings(char *sql, int index, const test_data_row *row)
+{
+    (void)row;
+    sql_sprintf(sql, "SELECT count(*), avg(b) FROM t1 WHERE c LIKE '%%%s %s %s%%';",
+            digits[(index / 100) % 10],
+            digits[(index / 10) % 10],
+            digits[(index / 1) % 10]);
+}
 
-static test_data_row *generate_test_data(int n_rows);
+// only the LIKE pattern, for the prepared variant of the above
+static void format_compare_strings_pattern(char *sql, int index, const test_data_row *row)
+{
+    (void)row;
+    sql_sprintf(sql, "%%%s %s %s%%",
+            digits[(index / 100) % 10],
+            digits[(index / 10) % 10],
+            digits[(index / 1) % 10]);
+}
 
-static const char *digits[] = {
-    "zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"
-};
+static void format_update(char *sql, int index, const test_data_row *row)
+{
+    (void)row;
+    sql_sprintf(sql, "UPDATE t1 SET b=b*2 WHERE a >= %d AND a < %d;", index * 10, (index + 1) * 10);
+}
 
-/*
- * Logging-friendly encapsulation of common db manipulation routines.
- */
+static void format_update_strings(char *sql, int index, const test_data_row *row)
+{
+    sql_sprintf(sql, "UPDATE t1 SET c='%s' WHERE a = %d;", row->string, index);
+}
 
-typedef struct {
-    const char *function;
-    int file_line;
-} caller_info;
-#define CALLER_INFO ((caller_info){__FUNCTION__, __LINE__})
-
-#define db_open_truncate(db, db_file) db_open_truncate_(db, db_file, CALLER_INFO)
-#define db_close(db) db_close_(db, CALLER_INFO)
-#define db_create_table(db, name, n_rows) db_create_table_(db, name, n_rows, CALLER_INFO)
-#define db_create_index(db, spec) db_create_index_(db, spec, CALLER_INFO)
-#define db_exec(db, sql) db_exec_(db, sql, CALLER_INFO)
-#define db_begin_transaction(db) db_begin_transaction_(db, CALLER_INFO)
-#define db_commit_transaction(db) db_commit_transaction_(db, CALLER_INFO)
-
-static bool db_open_truncate_(sqlite3 **db, const char *db_file, caller_info caller);
-static void db_close_(sqlite3 *db, caller_info caller);
-static bool db_create_table_(sqlite3 *db, const char *name, int n_rows, caller_info caller);
-static bool db_create_index_(sqlite3 *db, const char *spec, caller_info caller);
-static bool db_exec_(sqlite3 *db, const char *sql, caller_info caller);
-static bool db_begin_transaction_(sqlite3 *db, caller_info caller);
-static bool db_commit_transaction_(sqlite3 *db, caller_info caller);
+// reports elapsed time excluding the time spent generating test data, the latter and the I/O
+// accounting of the timed section
+static double report_elapsed(const char *tag_base, const row_generator *g)
+{
+    double elapsed = timing_elapsed() - row_generator_overhead(g);
 
-/*
- * Other utilities
- */
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    if (g != NULL) {
+        report_extended_result(tag_base, "generator_overhead", row_generator_overhead(g), "s");
+    }
+    report_io_accounting(tag_base);
 
-// wrapper around blts_report_extended_result() combining tag_base with tag
-static int report_extended_result(const char *tag_base, char *tag, double value, char *unit);
+    return elapsed;
+}
 
 /*
  * Actual tests
@@ -115,21 +134,24 @@ int test_insert(const char *tag_base, const char *db_file, bool in_transaction,
             in_transaction, with_index, n_rows);
 
     int retv = EXIT_FAILURE;
-    int i;
+    const generated_row *row;
     sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    test_data_row *data = generate_test_data(n_rows);
+    row_generator *rows = row_generator_create(0, n_rows,
+            test_opts.prepared ? NULL : format_insert);
 
-    char (*inserts)[SQL_MAX] = calloc(n_rows, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_rows; ++i) {
-        sql_sprintf(inserts[i], "INSERT INTO t1 VALUES(%d, %d, '%s');", i, data[i].number,
-                data[i].string);
+    if (latencies == NULL || rows == NULL) {
+        goto fail;
     }
 
     if (!db_open_truncate(&db, db_file)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_create_table(db, "t1", 0)) {
@@ -144,10 +166,25 @@ int test_insert(const char *tag_base, const char *db_file, bool in_transaction,
         goto fail;
     }
 
-    for (i = 0; i < n_rows; ++i) {
-        if (!db_exec(db, inserts[i])) {
+    if (test_opts.prepared) {
+        if (!db_prepare(db, &stmt, "INSERT INTO t1 VALUES(?1, ?2, ?3);")) {
             goto fail;
         }
+
+        while ((row = row_generator_next(rows)) != NULL) {
+            sqlite3_bind_int(stmt, 1, row->index);
+            sqlite3_bind_int(stmt, 2, row->row.number);
+            sqlite3_bind_text(stmt, 3, row->row.string, -1, SQLITE_STATIC);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        }
+    } else {
+        while ((row = row_generator_next(rows)) != NULL) {
+            if (!db_exec_timed(db, row->sql, latencies)) {
+                goto fail;
+            }
+        }
     }
 
     if (in_transaction && !db_commit_transaction(db)) {
@@ -155,47 +192,47 @@ int test_insert(const char *tag_base, const char *db_file, bool in_transaction,
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, rows);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
 
     retv = EXIT_SUCCESS;
 
 fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
     db_close(db);
-    free(inserts);
-    free(data);
+    row_generator_destroy(rows);
 
     return retv;
 }
 
-int test_select(const char *tag_base, const char *db_file, int table_size, bool with_index,
-        int n_selects)
+// one timed pass of n_selects test_select() queries
+static bool select_pass(const char *tag_base, sqlite3 *db, int n_selects)
 {
-    BLTS_DEBUG("START %s(table_size=%d, with_index=%d, n_selects=%d)\n", __FUNCTION__, table_size,
-            with_index, n_selects);
-
-    int retv = EXIT_FAILURE;
+    bool retv = false;
     int i;
-    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    char (*selects)[SQL_MAX] = calloc(n_selects, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_selects; ++i) {
-        sql_sprintf(selects[i],  "SELECT count(*), avg(b) FROM t1 WHERE b >= %d AND b < %d;",
-                i * 100, 1000 + i * 100);
-    }
+    row_generator *queries = test_opts.prepared ? NULL
+        : row_generator_create(0, n_selects, format_select);
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (latencies == NULL || (!test_opts.prepared && queries == NULL)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
-        goto fail;
-    }
-
-    if (with_index && !db_create_index(db, "i1 on t1(b)")) {
+    if (test_opts.prepared && !db_prepare(db, &stmt,
+                "SELECT count(*), avg(b) FROM t1 WHERE b >= ?1 AND b < ?2;")) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
@@ -203,7 +240,13 @@ int test_select(const char *tag_base, const char *db_file, int table_size, bool
     }
 
     for (i = 0; i < n_selects; ++i) {
-        if (!db_exec(db, selects[i])) {
+        if (test_opts.prepared) {
+            sqlite3_bind_int(stmt, 1, i * 100);
+            sqlite3_bind_int(stmt, 2, 1000 + i * 100);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        } else if (!db_exec_timed(db, row_generator_next(queries)->sql, latencies)) {
             goto fail;
         }
     }
@@ -213,45 +256,48 @@ int test_select(const char *tag_base, const char *db_file, int table_size, bool
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, queries);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
 
-    retv = EXIT_SUCCESS;
+    retv = true;
 
 fail:
-    db_close(db);
-    free(selects);
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
+    row_generator_destroy(queries);
 
     return retv;
 }
 
-int test_select_compare_strings(const char *tag_base, const char *db_file, int table_size,
-        int n_selects)
+// one timed pass of n_selects test_select_compare_strings() queries
+static bool select_compare_strings_pass(const char *tag_base, sqlite3 *db, int n_selects)
 {
-    BLTS_DEBUG("START %s(table_size=%d, n_selects=%d)\n", __FUNCTION__, table_size, n_selects);
-
-    assert(n_selects < 1000);
-
-    int retv = EXIT_FAILURE;
+    bool retv = false;
     int i;
-    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    char (*selects)[SQL_MAX] = calloc(n_selects, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_selects; ++i) {
-        sql_sprintf(selects[i],  "SELECT count(*), avg(b) FROM t1 WHERE c LIKE '%%%s %s %s%%';",
-                digits[(i / 100) % 10],
-                digits[(i / 10) % 10],
-                digits[(i / 1) % 10]);
-    }
+    // patterns repeat after 1000 selects
+    row_generator *queries = row_generator_create(0, n_selects, test_opts.prepared
+            ? format_compare_strings_pattern
+            : format_select_compare_strings);
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (latencies == NULL || queries == NULL) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
+    if (test_opts.prepared && !db_prepare(db, &stmt,
+                "SELECT count(*), avg(b) FROM t1 WHERE c LIKE ?1;")) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
@@ -259,7 +305,12 @@ int test_select_compare_strings(const char *tag_base, const char *db_file, int t
     }
 
     for (i = 0; i < n_selects; ++i) {
-        if (!db_exec(db, selects[i])) {
+        if (test_opts.prepared) {
+            sqlite3_bind_text(stmt, 1, row_generator_next(queries)->sql, -1, SQLITE_STATIC);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        } else if (!db_exec_timed(db, row_generator_next(queries)->sql, latencies)) {
             goto fail;
         }
     }
@@ -269,14 +320,96 @@ int test_select_compare_strings(const char *tag_base, const char *db_file, int t
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, queries);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
+
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
+    row_generator_destroy(queries);
+
+    return retv;
+}
+
+// runs a read pass, or with test_opts.cold a cold and a warm one on the reopened database
+static bool read_passes(const char *tag_base, sqlite3 **db, const char *db_file,
+        bool (*pass)(const char *tag_base, sqlite3 *db, int n_selects), int n_selects)
+{
+    if (!test_opts.cold) {
+        return pass(tag_base, *db, n_selects);
+    }
+
+    if (!db_reopen_cold(db, db_file, tag_base)) {
+        return false;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    if (test_opts.mmap_fraction >= 0 && db_prepare(*db, &stmt, "PRAGMA mmap_size;")
+            && sqlite3_step(stmt) == SQLITE_ROW) {
+        report_extended_result(tag_base, "mmap_size", sqlite3_column_double(stmt, 0), "B");
+    }
+    sqlite3_finalize(stmt);
+
+    char cold_tag_base[TAG_MAX];
+    char warm_tag_base[TAG_MAX];
+    format_tag(cold_tag_base, tag_base, "cold");
+    format_tag(warm_tag_base, tag_base, "warm");
+
+    return pass(cold_tag_base, *db, n_selects) && pass(warm_tag_base, *db, n_selects);
+}
+
+int test_select(const char *tag_base, const char *db_file, int table_size, bool with_index,
+        int n_selects)
+{
+    BLTS_DEBUG("START %s(table_size=%d, with_index=%d, n_selects=%d)\n", __FUNCTION__, table_size,
+            with_index, n_selects);
+
+    int retv = EXIT_FAILURE;
+    sqlite3 *db = NULL;
+
+    if (!db_open_fixture(&db, db_file, with_index ? &T1_I1B : &T1, table_size)) {
+        goto fail;
+    }
+
+    if (!read_passes(tag_base, &db, db_file, select_pass, n_selects)) {
+        goto fail;
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    db_close(db);
+
+    return retv;
+}
+
+int test_select_compare_strings(const char *tag_base, const char *db_file, int table_size,
+        int n_selects)
+{
+    BLTS_DEBUG("START %s(table_size=%d, n_selects=%d)\n", __FUNCTION__, table_size, n_selects);
+
+    int retv = EXIT_FAILURE;
+    sqlite3 *db = NULL;
+
+    if (!db_open_fixture(&db, db_file, &T1, table_size)) {
+        goto fail;
+    }
+
+    if (!read_passes(tag_base, &db, db_file, select_compare_strings_pass, n_selects)) {
+        goto fail;
+    }
 
     retv = EXIT_SUCCESS;
 
 fail:
     db_close(db);
-    free(selects);
 
     return retv;
 }
@@ -288,14 +421,16 @@ int test_create_index(const char *tag_base, const char *db_file, int table_size)
     int retv = EXIT_FAILURE;
     sqlite3 *db = NULL;
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (!db_open_fixture(&db, db_file, &T1, table_size)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_exec(db, "CREATE INDEX i1a on t1(a);")) {
@@ -307,8 +442,11 @@ int test_create_index(const char *tag_base, const char *db_file, int table_size)
     }
 
     timing_stop();
+    io_accounting_stop();
 
     report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
 
     retv = EXIT_SUCCESS;
 
@@ -327,29 +465,31 @@ int test_update(const char *tag_base, const char *db_file, int table_size, bool
     int retv = EXIT_FAILURE;
     int i;
     sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    char (*updates)[SQL_MAX] = calloc(n_rows, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_rows; ++i) {
-        sql_sprintf(updates[i],  "UPDATE t1 SET b=b*2 WHERE a >= %d AND a < %d;",
-                i * 10, (i + 1) * 10);
-    }
+    row_generator *queries = test_opts.prepared ? NULL
+        : row_generator_create(0, n_rows, format_update);
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (latencies == NULL || (!test_opts.prepared && queries == NULL)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
+    if (!db_open_fixture(&db, db_file, with_index ? &T1_I1AB : &T1, table_size)) {
         goto fail;
     }
 
-    if (with_index && !db_create_index(db, "i1a on t1(a)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
-    if (with_index && !db_create_index(db, "i1b on t1(b)")) {
+    if (test_opts.prepared && !db_prepare(db, &stmt,
+                "UPDATE t1 SET b=b*2 WHERE a >= ?1 AND a < ?2;")) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
@@ -357,7 +497,13 @@ int test_update(const char *tag_base, const char *db_file, int table_size, bool
     }
 
     for (i = 0; i < n_rows; ++i) {
-        if (!db_exec(db, updates[i])) {
+        if (test_opts.prepared) {
+            sqlite3_bind_int(stmt, 1, i * 10);
+            sqlite3_bind_int(stmt, 2, (i + 1) * 10);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        } else if (!db_exec_timed(db, row_generator_next(queries)->sql, latencies)) {
             goto fail;
         }
     }
@@ -367,14 +513,21 @@ int test_update(const char *tag_base, const char *db_file, int table_size, bool
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, queries);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
 
     retv = EXIT_SUCCESS;
 
 fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
     db_close(db);
-    free(updates);
+    row_generator_destroy(queries);
 
     return retv;
 }
@@ -384,40 +537,46 @@ int test_update_strings(const char *tag_base, const char *db_file, int table_siz
     BLTS_DEBUG("START %s(table_size=%d, n_rows=%d)\n", __FUNCTION__, table_size, n_rows);
 
     int retv = EXIT_FAILURE;
-    int i;
+    const generated_row *row;
     sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    test_data_row *data = generate_test_data(n_rows);
-
-    char (*updates)[SQL_MAX] = calloc(n_rows, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_rows; ++i) {
-        sql_sprintf(updates[i],  "UPDATE t1 SET c='%s' WHERE a = %d;", data[i].string, i);
-    }
+    row_generator *rows = row_generator_create(0, n_rows,
+            test_opts.prepared ? NULL : format_update_strings);
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (latencies == NULL || rows == NULL) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
+    if (!db_open_fixture(&db, db_file, &T1_I1AB, table_size)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i1a on t1(a)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i1b on t1(b)")) {
+    if (test_opts.prepared && !db_prepare(db, &stmt, "UPDATE t1 SET c=?1 WHERE a = ?2;")) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
         goto fail;
     }
 
-    for (i = 0; i < n_rows; ++i) {
-        if (!db_exec(db, updates[i])) {
+    while ((row = row_generator_next(rows)) != NULL) {
+        if (test_opts.prepared) {
+            sqlite3_bind_text(stmt, 1, row->row.string, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, row->index);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        } else if (!db_exec_timed(db, row->sql, latencies)) {
             goto fail;
         }
     }
@@ -427,15 +586,21 @@ int test_update_strings(const char *tag_base, const char *db_file, int table_siz
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, rows);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
 
     retv = EXIT_SUCCESS;
 
 fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
     db_close(db);
-    free(updates);
-    free(data);
+    row_generator_destroy(rows);
 
     return retv;
 }
@@ -447,26 +612,16 @@ int test_insert_from_select(const char *tag_base, const char *db_file, int table
     int retv = EXIT_FAILURE;
     sqlite3 *db = NULL;
 
-    if (!db_open_truncate(&db, db_file)) {
-        goto fail;
-    }
-
-    if (!db_create_table(db, "t1", table_size)) {
+    if (!db_open_fixture(&db, db_file, &T1_T2_I2AB, table_size)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t2", table_size)) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i2a on t2(a)")) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i2b on t2(b)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
@@ -486,8 +641,11 @@ int test_insert_from_select(const char *tag_base, const char *db_file, int table
     }
 
     timing_stop();
+    io_accounting_stop();
 
     report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
 
     retv = EXIT_SUCCESS;
 
@@ -504,33 +662,35 @@ int test_delete(const char *tag_base, const char *db_file, int table_size, bool
     int retv = EXIT_FAILURE;
     sqlite3 *db = NULL;
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (!db_open_fixture(&db, db_file, &T1_I1AB, table_size)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
-        goto fail;
+    char delete_sql[SQL_MAX];
+    if (with_index) {
+        sql_sprintf(delete_sql, "DELETE FROM t1 WHERE a > 10 AND a < %d;", table_size / 5 * 4);
+    } else {
+        sql_sprintf(delete_sql, "DELETE FROM t1 WHERE c LIKE '%%50%%';");
     }
 
-    if (!db_create_index(db, "i1a on t1(a)")) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i1b on t1(b)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
-    if (!db_exec(db, with_index
-                ? "DELETE FROM t1 WHERE a > 10 AND a < 20000;"
-                : "DELETE FROM t1 WHERE c LIKE '%50%';")) {
+    if (!db_exec(db, delete_sql)) {
         goto fail;
     }
 
     timing_stop();
+    io_accounting_stop();
 
     report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
 
     retv = EXIT_SUCCESS;
 
@@ -547,30 +707,22 @@ int test_big_insert_after_big_delete(const char *tag_base, const char *db_file,
     int retv = EXIT_FAILURE;
     sqlite3 *db = NULL;
 
-    if (!db_open_truncate(&db, db_file)) {
-        goto fail;
-    }
-
-    if (!db_create_table(db, "t1", table_size)) {
-        goto fail;
-    }
-
-    if (!db_create_table(db, "t2", table_size)) {
+    if (!db_open_fixture(&db, db_file, &T1_T2_I2AB, table_size)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i2a on t2(a)")) {
+    char delete_sql[SQL_MAX];
+    sql_sprintf(delete_sql, "DELETE FROM t2 WHERE a > 10 AND A < %d;", table_size / 5 * 4);
+    if (!db_exec(db, delete_sql)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i2b on t2(b)")) {
-        goto fail;
-    }
-
-    if (!db_exec(db, "DELETE FROM t2 WHERE a > 10 AND A < 20000;")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_exec(db, "INSERT INTO t2 SELECT * FROM t1")) {
@@ -578,8 +730,11 @@ int test_big_insert_after_big_delete(const char *tag_base, const char *db_file,
     }
 
     timing_stop();
+    io_accounting_stop();
 
     report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
 
     retv = EXIT_SUCCESS;
 
@@ -595,33 +750,32 @@ int test_small_inserts_after_big_delete(const char *tag_base, const char *db_fil
     BLTS_DEBUG("START %s(table_size=%d, n_rows=%d)\n", __FUNCTION__, table_size, n_rows);
 
     int retv = EXIT_FAILURE;
-    int i;
+    const generated_row *row;
     sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
 
-    test_data_row *data = generate_test_data(n_rows);
-
-    char (*inserts)[SQL_MAX] = calloc(n_rows, sizeof(char[SQL_MAX]));
-    for (i = 0; i < n_rows; ++i) {
-        sql_sprintf(inserts[i], "INSERT INTO t1 VALUES(%d, %d, '%s');", i, data[i].number,
-                data[i].string);
-    }
+    row_generator *rows = row_generator_create(0, n_rows,
+            test_opts.prepared ? NULL : format_insert);
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (latencies == NULL || rows == NULL) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
+    if (!db_open_fixture(&db, db_file, &T1_I1AB, table_size)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i1a on t1(a)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
-    if (!db_create_index(db, "i1b on t1(b)")) {
+    if (test_opts.prepared && !db_prepare(db, &stmt, "INSERT INTO t1 VALUES(?1, ?2, ?3);")) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_begin_transaction(db)) {
@@ -632,8 +786,15 @@ int test_small_inserts_after_big_delete(const char *tag_base, const char *db_fil
         goto fail;
     }
 
-    for (i = 0; i < n_rows; ++i) {
-        if (!db_exec(db, inserts[i])) {
+    while ((row = row_generator_next(rows)) != NULL) {
+        if (test_opts.prepared) {
+            sqlite3_bind_int(stmt, 1, row->index);
+            sqlite3_bind_int(stmt, 2, row->row.number);
+            sqlite3_bind_text(stmt, 3, row->row.string, -1, SQLITE_STATIC);
+            if (!db_step_reset_timed(stmt, latencies)) {
+                goto fail;
+            }
+        } else if (!db_exec_timed(db, row->sql, latencies)) {
             goto fail;
         }
     }
@@ -643,15 +804,21 @@ int test_small_inserts_after_big_delete(const char *tag_base, const char *db_fil
     }
 
     timing_stop();
+    io_accounting_stop();
 
-    report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    double elapsed = report_elapsed(tag_base, rows);
+    report_latencies(tag_base, latencies, elapsed);
+    report_perf_counters_per_op(tag_base, latencies->count);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
 
     retv = EXIT_SUCCESS;
 
 fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
     db_close(db);
-    free(inserts);
-    free(data);
+    row_generator_destroy(rows);
 
     return retv;
 }
@@ -663,34 +830,16 @@ int test_drop_table(const char *tag_base, const char *db_file, int table_size)
     int retv = EXIT_FAILURE;
     sqlite3 *db = NULL;
 
-    if (!db_open_truncate(&db, db_file)) {
+    if (!db_open_fixture(&db, db_file, &T1_T2_T3, table_size)) {
         goto fail;
     }
 
-    if (!db_create_table(db, "t1", table_size)) {
-        goto fail;
-    }
-
-    if (!db_create_table(db, "t2", table_size)) {
-        goto fail;
-    }
-
-    if (!db_create_table(db, "t3", table_size)) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i2a on t2(a)")) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i2b on t2(b)")) {
-        goto fail;
-    }
-
-    if (!db_create_index(db, "i3 on t3(c)")) {
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
         goto fail;
     }
 
+    db_reset_status(db);
+    io_accounting_start();
     timing_start();
 
     if (!db_exec(db, "DROP TABLE t1")) {
@@ -706,8 +855,11 @@ int test_drop_table(const char *tag_base, const char *db_file, int table_size)
     }
 
     timing_stop();
+    io_accounting_stop();
 
     report_extended_result(tag_base, "elapsed", timing_elapsed(), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
 
     retv = EXIT_SUCCESS;
 
@@ -716,161 +868,3 @@ fail:
 
     return retv;
 }
-
-/*
- * Utility function
- */
-
-static test_data_row *generate_test_data(int n_rows)
-{
-    test_data_row *data = calloc(n_rows, sizeof(test_data_row));
-
-    int i;
-    for (i = 0; i < n_rows; ++i) {
-        data[i].number = random() % 1000000;
-        int n_written = snprintf(data[i].string, TEST_DATA_STRING_MAX, "%s %s %s %s %s %s",
-                digits[(data[i].number / 100000) % 10],
-                digits[(data[i].number / 10000) % 10],
-                digits[(data[i].number / 1000) % 10],
-                digits[(data[i].number / 100) % 10],
-                digits[(data[i].number / 10) % 10],
-                digits[(data[i].number / 1) % 10]);
-        assert(n_written < TEST_DATA_STRING_MAX);
-    }
-
-    return data;
-}
-
-static bool db_open_truncate_(sqlite3 **db, const char *db_file, caller_info caller)
-{
-    int rc;
-
-    if (access(db_file, F_OK) == 0) {
-        rc = unlink(db_file);
-        if (rc != 0) {
-            BLTS_ERROR("%s:%d: %s: unlink(\"%s\") failed: %s\n", __FILE__, caller.file_line,
-                    caller.function, db_file, strerror(errno));
-            return false;
-        }
-    }
-
-    rc = sqlite3_open_v2(db_file, db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0);
-    if (rc != SQLITE_OK) {
-        BLTS_ERROR("%s:%d: %s: sqlite3_open_v2(\"%s\") failed: %s\n", __FILE__, caller.file_line,
-                caller.function, db_file, sqlite3_errstr(rc));
-        return false;
-    }
-
-    return true;
-}
-
-static void db_close_(sqlite3 *db, caller_info caller)
-{
-    int rc;
-
-    rc = sqlite3_close(db);
-    if (rc != SQLITE_OK) {
-        BLTS_ERROR("%s:%d: %s: sqlite3_close() failed: %s\n", __FILE__, caller.file_line,
-                caller.function, sqlite3_errstr(rc));
-    }
-}
-
-static bool db_create_table_(sqlite3 *db, const char *name, int n_rows, caller_info caller)
-{
-    bool retv = false;
-    int rc = 0;
-    sqlite3_stmt *stmt = NULL;
-
-    test_data_row *data = generate_test_data(n_rows);
-
-    char create_table_sql[SQL_MAX];
-    sql_sprintf(create_table_sql, "CREATE TABLE %s (a INTEGER, b INTEGER, c VARCHAR(100));", name);
-    if (!db_exec_(db, create_table_sql, caller)) {
-        goto fail;
-    }
-
-    // create an empty table?
-    if (n_rows != 0) {
-        if (!db_exec_(db, "BEGIN", caller)) {
-            goto fail;
-        }
-
-        char insert_sql[SQL_MAX];
-        sql_sprintf(insert_sql, "INSERT INTO %s VALUES(?1, ?2, ?3);", name);
-        rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            BLTS_ERROR("%s:%d: %s: sqlite3_prepare(\"%s\") failed: %s\n", __FILE__,
-                    caller.file_line, caller.function, insert_sql, sqlite3_errstr(rc));
-            goto fail;
-        }
-
-        int i;
-        for (i = 0; i < n_rows; ++i) {
-            sqlite3_bind_int(stmt, 1, i);
-            sqlite3_bind_int(stmt, 2, data[i].number);
-            sqlite3_bind_text(stmt, 3, data[i].string, -1, SQLITE_STATIC);
-
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                BLTS_ERROR("%s:%d: %s: sqlite3_step(\"%s\") failed: %s\n", __FILE__,
-                        caller.file_line, caller.function, insert_sql, sqlite3_errstr(rc));
-                goto fail;
-            }
-        }
-
-        if (!db_exec_(db, "COMMIT", caller)) {
-            goto fail;
-        }
-    }
-
-    retv = true;
-
-fail:
-    sqlite3_finalize(stmt);
-    free(data);
-
-    return retv;
-}
-
-static bool db_create_index_(sqlite3 *db, const char *spec, caller_info caller)
-{
-    char sql[SQL_MAX];
-    sql_sprintf(sql, "CREATE INDEX %s;", spec);
-
-    return db_exec_(db, sql, caller);
-}
-
-static bool db_exec_(sqlite3 *db, const char *sql, caller_info caller)
-{
-    int rc;
-    char *errstr;
-
-    rc = sqlite3_exec(db, sql, NULL, NULL, &errstr);
-    if (rc != SQLITE_OK) {
-        BLTS_ERROR("%s:%d: %s: sqlite3_exec(\"%s\") failed: %s\n", __FILE__, caller.file_line,
-                caller.function, sql, sqlite3_errstr(rc));
-        sqlite3_free(errstr);
-        return false;
-    }
-
-    return true;
-}
-
-static bool db_begin_transaction_(sqlite3 *db, caller_info caller)
-{
-    return db_exec_(db, "BEGIN", caller);
-}
-
-static bool db_commit_transaction_(sqlite3 *db, caller_info caller)
-{
-    return db_exec_(db, "COMMIT", caller);
-}
-
-static int report_extended_result(const char *tag_base, char *tag, double value, char *unit)
-{
-    char full_tag[256];
-    int n_written = snprintf(full_tag, 256, "%s.%s", tag_base, tag);
-    assert(n_written < 256);
-
-    return blts_report_extended_result(full_tag, value, unit, 0);
-}
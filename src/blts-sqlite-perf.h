@@ -23,6 +23,47 @@
 
 #include <stdbool.h>
 
+/*
+ * PRAGMA values applied to each connection right after it is opened, NULL leaves the sqlite
+ * default in effect.
+ */
+typedef struct {
+    const char *journal_mode;
+    const char *synchronous;
+    const char *page_size;
+    const char *cache_size;
+    const char *mmap_size;
+    const char *temp_store;
+    const char *locking_mode;
+} db_config;
+
+/*
+ * Options affecting all the test_* functions. Set up by the CLI front-end before a test is
+ * executed.
+ */
+typedef struct {
+    // execute looped queries through reusable prepared statements instead of sqlite3_exec()
+    bool prepared;
+    db_config db;
+    // the read tests run their queries once on a database evicted from the OS page cache and
+    // reopened, reported as '<tag>.cold', then again as '<tag>.warm'
+    bool cold;
+    // when not negative, cold reopens set mmap_size to this fraction of the database file size
+    double mmap_fraction;
+    // when positive, the concurrent and oltp tests run for this many seconds instead of a fixed
+    // number of operations
+    double duration;
+    // when positive, the oltp test issues operations at this rate (1/s) instead of back to back
+    double rate;
+    // when positive, connections of the concurrent tests wait for locks up to this many
+    // milliseconds in a busy handler instead of getting SQLITE_BUSY right away
+    int busy_timeout;
+    // restore populated databases from copies instead of building them again, see fixture.h
+    bool fixture_cache;
+} test_options;
+
+extern test_options test_opts;
+
 int test_insert(const char *tag_base, const char *db_file, bool in_transaction, bool with_index,
         int n_rows);
 int test_select(const char *tag_base, const char *db_file, int table_size, bool with_index,
@@ -40,4 +81,68 @@ int test_small_inserts_after_big_delete(const char *tag_base, const char *db_fil
         int n_rows);
 int test_drop_table(const char *tag_base, const char *db_file, int table_size);
 
+// aging.c
+int test_aging(const char *tag_base, const char *db_file, int table_size);
+
+// backup.c
+int test_backup(const char *tag_base, const char *db_file, int table_size);
+
+// blob.c
+int test_blob(const char *tag_base, const char *db_file, const int *blob_sizes, int n_blob_sizes,
+        long n_bytes, int n_wide_rows);
+
+// bulk.c
+int test_bulk_insert_values(const char *tag_base, const char *db_file, int n_rows);
+int test_bulk_insert_batched(const char *tag_base, const char *db_file, int n_rows);
+int test_bulk_insert_json_each(const char *tag_base, const char *db_file, int n_rows);
+
+// checkpoint.c
+int test_checkpoint_autocheckpoint(const char *tag_base, const char *db_file, int n_transactions);
+int test_checkpoint_modes(const char *tag_base, const char *db_file, int n_transactions);
+
+// concurrency.c
+int test_concurrent(const char *tag_base, const char *db_file, int table_size, int n_readers,
+        int n_writers, int n_selects, int n_transactions);
+int test_multiprocess(const char *tag_base, const char *db_file, int table_size,
+        const int *process_counts, int n_process_counts, int n_readers, int n_writers,
+        int n_selects, int n_transactions);
+
+// fts.c
+int test_fts(const char *tag_base, const char *db_file, int table_size, int n_selects);
+
+// indexes.c
+int test_indexes(const char *tag_base, const char *db_file, int table_size, int n_selects);
+
+// oltp.c
+typedef enum {
+    OLTP_POINT_SELECT,
+    OLTP_RANGE_SELECT,
+    OLTP_UPDATE,
+    OLTP_INSERT,
+    OLTP_DELETE,
+    OLTP_OPS
+} oltp_op;
+
+extern const char *const oltp_op_names[OLTP_OPS];
+
+typedef enum {
+    OLTP_KEYS_UNIFORM,
+    OLTP_KEYS_ZIPFIAN,
+    OLTP_KEYS_LATEST
+} oltp_keys;
+
+typedef struct {
+    // relative frequencies of the operation types
+    int weights[OLTP_OPS];
+    oltp_keys keys;
+    // operations per transaction, 1 runs each in its own implicit transaction
+    int transaction_ops;
+} oltp_workload;
+
+int test_oltp(const char *tag_base, const char *db_file, int table_size, int n_ops,
+        const oltp_workload *workload);
+
+// startup.c
+int test_startup(const char *tag_base, const char *db_file, int n_opens);
+
 #endif // BLTS_SQLITE_PERF_H
@@ -0,0 +1,303 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Bulk-load strategies: populating an empty table with rows inserted several per statement,
+ * either as a multi-row VALUES list or extracted with json_each() from a single JSON array
+ * parameter, and committed after a given number of rows. Each configuration is reported under its
+ * own tag with the load rate as '<tag>.rows_per_sec' and the resulting database size as
+ * '<tag>.db_size'. Statements are always prepared, the point is to compare data layouts.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <blts_timing.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+
+typedef enum {
+    BULK_VALUES,
+    BULK_JSON_EACH,
+} bulk_source;
+
+// upper bound of one row formatted as a JSON array
+enum { JSON_ROW_MAX = 32 + sizeof(((test_data_row *)0)->string) };
+
+// rows loaded with one row per transaction, more would take too long on file-backed databases
+enum { SINGLE_ROW_TRANSACTIONS_ROWS = 1000 };
+
+static const int rows_per_statement_sweep[] = { 1, 10, 100, 500 };
+static const int rows_per_transaction_sweep[] = { 1, 100, 1000, 10000 };
+
+static const char *const JSON_EACH_INSERT_SQL =
+    "INSERT INTO t1 SELECT json_extract(value, '$[0]'), json_extract(value, '$[1]'), "
+    "json_extract(value, '$[2]') FROM json_each(?1);";
+
+// 'INSERT INTO t1 VALUES(?, ?, ?), ...' with n_rows tuples
+static char *values_insert_sql(int n_rows)
+{
+    static const char prefix[] = "INSERT INTO t1 VALUES";
+    static const char tuple[] = "(?, ?, ?),";
+    char *sql = malloc(sizeof(prefix) + n_rows * (sizeof(tuple) - 1));
+    int i;
+
+    if (sql == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    strcpy(sql, prefix);
+    char *end = sql + sizeof(prefix) - 1;
+    for (i = 0; i < n_rows; ++i) {
+        memcpy(end, tuple, sizeof(tuple) - 1);
+        end += sizeof(tuple) - 1;
+    }
+    end[-1] = ';';
+    *end = '\0';
+
+    return sql;
+}
+
+static bool prepare_values_insert(sqlite3 *db, sqlite3_stmt **stmt, int n_rows)
+{
+    char *sql = values_insert_sql(n_rows);
+    bool ok = sql != NULL && db_prepare(db, stmt, sql);
+    free(sql);
+
+    return ok;
+}
+
+static bool query_db_size(sqlite3 *db, double *size)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool ok = sqlite3_prepare_v2(db, "SELECT page_count * page_size FROM pragma_page_count(), "
+            "pragma_page_size();", -1, &stmt, NULL) == SQLITE_OK
+        && sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *size = sqlite3_column_double(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+static int bulk_insert(const char *tag_base, const char *db_file, int n_rows, bulk_source source,
+        int rows_per_statement, int rows_per_transaction)
+{
+    BLTS_DEBUG("START %s(source=%s, n_rows=%d, rows_per_statement=%d, rows_per_transaction=%d)\n",
+            __FUNCTION__, source == BULK_VALUES ? "values" : "json_each", n_rows,
+            rows_per_statement, rows_per_transaction);
+
+    int retv = EXIT_FAILURE;
+    const generated_row *row;
+    sqlite3 *db = NULL;
+    // the statement for full chunks of rows_per_statement rows and the one for the last chunk
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *tail_stmt = NULL;
+    int tail_rows = 0;
+    char *json = NULL;
+    histogram *latencies = histogram_create();
+
+    row_generator *rows = row_generator_create(0, n_rows, NULL);
+
+    if (latencies == NULL || rows == NULL) {
+        goto fail;
+    }
+
+    if (source == BULK_JSON_EACH) {
+        json = malloc(rows_per_statement * JSON_ROW_MAX + 2);
+        if (json == NULL) {
+            BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+            goto fail;
+        }
+    }
+
+    if (!db_open_truncate(&db, db_file) || !db_create_table(db, "t1", 0)) {
+        goto fail;
+    }
+
+    if (source == BULK_VALUES) {
+        if (!prepare_values_insert(db, &stmt, rows_per_statement)) {
+            goto fail;
+        }
+    } else if (!db_prepare(db, &stmt, JSON_EACH_INSERT_SQL)) {
+        goto fail;
+    }
+
+    db_reset_status(db);
+    io_accounting_start();
+    timing_start();
+
+    int n_inserted = 0;
+    int n_in_transaction = 0;
+    while (n_inserted < n_rows) {
+        int chunk = rows_per_statement;
+        if (chunk > n_rows - n_inserted) {
+            chunk = n_rows - n_inserted;
+        }
+        if (chunk > rows_per_transaction - n_in_transaction) {
+            chunk = rows_per_transaction - n_in_transaction;
+        }
+
+        sqlite3_stmt *chunk_stmt = stmt;
+        if (source == BULK_VALUES && chunk != rows_per_statement) {
+            if (chunk != tail_rows) {
+                sqlite3_finalize(tail_stmt);
+                tail_stmt = NULL;
+                tail_rows = chunk;
+                if (!prepare_values_insert(db, &tail_stmt, chunk)) {
+                    goto fail;
+                }
+            }
+            chunk_stmt = tail_stmt;
+        }
+
+        if (n_in_transaction == 0 && !db_begin_transaction(db)) {
+            goto fail;
+        }
+
+        int i;
+        char *json_end = json;
+        for (i = 0; i < chunk; ++i) {
+            row = row_generator_next(rows);
+            if (source == BULK_VALUES) {
+                sqlite3_bind_int(chunk_stmt, 3 * i + 1, row->index);
+                sqlite3_bind_int(chunk_stmt, 3 * i + 2, row->row.number);
+                // rows of a chunk may come from several generator batches
+                sqlite3_bind_text(chunk_stmt, 3 * i + 3, row->row.string, -1, SQLITE_TRANSIENT);
+            } else {
+                json_end += sprintf(json_end, "%c[%d,%d,\"%s\"]", i == 0 ? '[' : ',',
+                        row->index, row->row.number, row->row.string);
+            }
+        }
+        if (source == BULK_JSON_EACH) {
+            strcpy(json_end, "]");
+            sqlite3_bind_text(chunk_stmt, 1, json, json_end + 1 - json, SQLITE_STATIC);
+        }
+
+        if (!db_step_reset_timed(chunk_stmt, latencies)) {
+            goto fail;
+        }
+
+        n_inserted += chunk;
+        n_in_transaction += chunk;
+        if ((n_in_transaction == rows_per_transaction || n_inserted == n_rows)
+                && !db_commit_transaction(db)) {
+            goto fail;
+        }
+        if (n_in_transaction == rows_per_transaction) {
+            n_in_transaction = 0;
+        }
+    }
+
+    timing_stop();
+    io_accounting_stop();
+
+    double elapsed = timing_elapsed() - row_generator_overhead(rows);
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    report_extended_result(tag_base, "generator_overhead", row_generator_overhead(rows), "s");
+    report_io_accounting(tag_base);
+    report_latencies(tag_base, latencies, elapsed);
+    db_report_status(tag_base, db);
+    db_report_stmt_status(tag_base, stmt);
+    if (elapsed > 0) {
+        report_extended_result(tag_base, "rows_per_sec", n_rows / elapsed, "1/s");
+    }
+
+    double db_size;
+    if (query_db_size(db, &db_size)) {
+        report_extended_result(tag_base, "db_size", db_size, "B");
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(tail_stmt);
+    histogram_destroy(latencies);
+    db_close(db);
+    row_generator_destroy(rows);
+    free(json);
+
+    return retv;
+}
+
+static int bulk_statement_sweep(const char *tag_base, const char *db_file, int n_rows,
+        bulk_source source)
+{
+    int retv = EXIT_SUCCESS;
+    unsigned i;
+
+    for (i = 0; i < sizeof(rows_per_statement_sweep) / sizeof(rows_per_statement_sweep[0]); ++i) {
+        char tag[TAG_MAX];
+        char rows_tag[32];
+        snprintf(rows_tag, sizeof(rows_tag), "rows_%d", rows_per_statement_sweep[i]);
+        format_tag(tag, tag_base, rows_tag);
+
+        if (bulk_insert(tag, db_file, n_rows, source, rows_per_statement_sweep[i], n_rows)
+                != EXIT_SUCCESS) {
+            retv = EXIT_FAILURE;
+        }
+    }
+
+    return retv;
+}
+
+int test_bulk_insert_values(const char *tag_base, const char *db_file, int n_rows)
+{
+    return bulk_statement_sweep(tag_base, db_file, n_rows, BULK_VALUES);
+}
+
+int test_bulk_insert_json_each(const char *tag_base, const char *db_file, int n_rows)
+{
+    return bulk_statement_sweep(tag_base, db_file, n_rows, BULK_JSON_EACH);
+}
+
+int test_bulk_insert_batched(const char *tag_base, const char *db_file, int n_rows)
+{
+    int retv = EXIT_SUCCESS;
+    unsigned i;
+
+    for (i = 0; i < sizeof(rows_per_transaction_sweep) / sizeof(rows_per_transaction_sweep[0]);
+            ++i) {
+        int batch = rows_per_transaction_sweep[i];
+        char tag[TAG_MAX];
+        char batch_tag[32];
+        snprintf(batch_tag, sizeof(batch_tag), "batch_%d", batch);
+        format_tag(tag, tag_base, batch_tag);
+
+        int batch_rows = batch == 1 && n_rows > SINGLE_ROW_TRANSACTIONS_ROWS
+            ? SINGLE_ROW_TRANSACTIONS_ROWS : n_rows;
+        if (bulk_insert(tag, db_file, batch_rows, BULK_VALUES, 1, batch) != EXIT_SUCCESS) {
+            retv = EXIT_FAILURE;
+        }
+    }
+
+    return retv;
+}
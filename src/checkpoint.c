@@ -0,0 +1,415 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * WAL checkpoint stalls: a burst of small write transactions with checkpoints triggered, the way
+ * sqlite's default wal_autocheckpoint does, once a commit leaves the WAL holding a given number
+ * of pages. The checkpoint is run either inline, by the committing connection from its WAL hook,
+ * or by a background thread on its own connection. Besides the transaction latencies
+ * ('<tag_base>.latency_*'), latencies of transactions that ran or overlapped a checkpoint are
+ * reported as '<tag_base>.during_checkpoint.*', checkpoint durations as '<tag_base>.checkpoint.*'
+ * and the WAL file size, sampled after each transaction, as '<tag_base>.wal_size_*'. The test
+ * runs in WAL mode whatever journal mode is configured, and requires a file-backed database.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <blts_timing.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+
+enum {
+    TRANSACTION_ROWS = 10,
+    // RESTART and TRUNCATE checkpoints wait for the writer and the writer for them
+    BUSY_TIMEOUT_MS = 10000,
+    // sqlite's default wal_autocheckpoint
+    DEFAULT_CHECKPOINT_PAGES = 1000,
+};
+
+static const struct {
+    const char *tag;
+    int pages;
+} autocheckpoint_sweep[] = {
+    { "pages_off", INT_MAX },
+    { "pages_100", 100 },
+    { "pages_1000", 1000 },
+    { "pages_10000", 10000 },
+};
+
+static const struct {
+    const char *tag;
+    int mode;
+} checkpoint_modes[] = {
+    { "passive", SQLITE_CHECKPOINT_PASSIVE },
+    { "full", SQLITE_CHECKPOINT_FULL },
+    { "restart", SQLITE_CHECKPOINT_RESTART },
+    { "truncate", SQLITE_CHECKPOINT_TRUNCATE },
+};
+
+typedef struct {
+    // input
+    int mode;
+    int pages;
+    bool background;
+    sqlite3 *db;
+
+    // background checkpointer state
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool pending;
+    bool stop;
+    long n_started;
+    long n_finished;
+
+    // output
+    bool failed;
+    // set when an inline checkpoint ran during the current commit
+    bool checkpointed;
+    long n_busy;
+    histogram *durations;
+} checkpointer;
+
+// runs a checkpoint, SQLITE_BUSY (the checkpoint could not complete) is counted but not an error
+static void checkpoint(checkpointer *c, sqlite3 *db)
+{
+    uint64_t start = histogram_now();
+    int rc = sqlite3_wal_checkpoint_v2(db, NULL, c->mode, NULL, NULL);
+    histogram_record(c->durations, histogram_now() - start);
+
+    if (rc == SQLITE_BUSY) {
+        ++c->n_busy;
+    } else if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s: sqlite3_wal_checkpoint_v2() failed: %s\n", __FUNCTION__,
+                sqlite3_errmsg(db));
+        c->failed = true;
+    }
+}
+
+// replaces the default hook installed by wal_autocheckpoint, invoked after each commit
+static int wal_hook(void *arg, sqlite3 *db, const char *name, int n_pages)
+{
+    checkpointer *c = arg;
+    (void)name;
+
+    if (n_pages < c->pages) {
+        return SQLITE_OK;
+    }
+
+    if (c->background) {
+        pthread_mutex_lock(&c->mutex);
+        c->pending = true;
+        pthread_cond_signal(&c->cond);
+        pthread_mutex_unlock(&c->mutex);
+    } else {
+        checkpoint(c, db);
+        c->checkpointed = true;
+    }
+
+    return SQLITE_OK;
+}
+
+static void *checkpointer_main(void *arg)
+{
+    checkpointer *c = arg;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        while (!c->pending && !c->stop) {
+            pthread_cond_wait(&c->cond, &c->mutex);
+        }
+        if (c->stop) {
+            break;
+        }
+
+        c->pending = false;
+        ++c->n_started;
+        pthread_mutex_unlock(&c->mutex);
+
+        checkpoint(c, c->db);
+
+        pthread_mutex_lock(&c->mutex);
+        ++c->n_finished;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+static bool wal_size(const char *db_file, double *size)
+{
+    char wal_file[PATH_MAX];
+    struct stat st;
+
+    snprintf(wal_file, sizeof(wal_file), "%s-wal", db_file);
+    if (stat(wal_file, &st) != 0) {
+        *size = 0;
+        return false;
+    }
+
+    *size = st.st_size;
+    return true;
+}
+
+static bool write_transaction(sqlite3 *db, sqlite3_stmt *insert, row_generator *rows)
+{
+    int i;
+
+    if (!db_begin_transaction(db)) {
+        return false;
+    }
+
+    for (i = 0; i < TRANSACTION_ROWS; ++i) {
+        const generated_row *row = row_generator_next(rows);
+        sqlite3_bind_int(insert, 1, row->index);
+        sqlite3_bind_int(insert, 2, row->row.number);
+        sqlite3_bind_text(insert, 3, row->row.string, -1, SQLITE_STATIC);
+        if (!db_step_reset(insert)) {
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            return false;
+        }
+    }
+
+    return db_commit_transaction(db);
+}
+
+static int checkpoint_run(const char *tag_base, const char *db_file, int n_transactions,
+        int pages, int mode, bool background)
+{
+    BLTS_DEBUG("START %s(n_transactions=%d, pages=%d, mode=%d, background=%d)\n", __FUNCTION__,
+            n_transactions, pages, mode, background);
+
+    int retv = EXIT_FAILURE;
+    int i;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *insert = NULL;
+    histogram *writes = histogram_create();
+    histogram *during = histogram_create();
+    pthread_t thread;
+    bool thread_started = false;
+    double size = 0;
+    double size_max = 0;
+    double size_sum = 0;
+
+    checkpointer c;
+    memset(&c, 0, sizeof(checkpointer));
+    c.mode = mode;
+    c.pages = pages;
+    c.background = background;
+    c.durations = histogram_create();
+    pthread_mutex_init(&c.mutex, NULL);
+    pthread_cond_init(&c.cond, NULL);
+
+    row_generator *rows = row_generator_create(0, n_transactions * TRANSACTION_ROWS, NULL);
+
+    const char *journal_mode = test_opts.db.journal_mode;
+    test_opts.db.journal_mode = "wal";
+
+    if (writes == NULL || during == NULL || c.durations == NULL || rows == NULL) {
+        goto fail;
+    }
+
+    // nothing to checkpoint without WAL, which in-memory databases do not support
+    if (db_is_in_memory(db_file)) {
+        BLTS_DEBUG("%s: WAL requires a file-backed database, skipped\n", __FUNCTION__);
+        retv = EXIT_SUCCESS;
+        goto fail;
+    }
+
+    if (!db_open_truncate(&db, db_file) || !db_create_table(db, "t1", 0)) {
+        goto fail;
+    }
+
+    if (!db_prepare(db, &insert, "INSERT INTO t1 VALUES(?1, ?2, ?3);")) {
+        goto fail;
+    }
+
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    sqlite3_wal_hook(db, wal_hook, &c);
+
+    if (background) {
+        if (!db_open(&c.db, db_file)) {
+            goto fail;
+        }
+        sqlite3_busy_timeout(c.db, BUSY_TIMEOUT_MS);
+
+        int rc = pthread_create(&thread, NULL, checkpointer_main, &c);
+        if (rc != 0) {
+            BLTS_ERROR("%s: pthread_create() failed: %s\n", __FUNCTION__, strerror(rc));
+            goto fail;
+        }
+        thread_started = true;
+    }
+
+    db_reset_status(db);
+    io_accounting_start();
+    timing_start();
+
+    // time spent generating test data is excluded from both latencies and elapsed time
+    for (i = 0; i < n_transactions; ++i) {
+        long finished_before = 0;
+        bool active_before = false;
+        if (background) {
+            pthread_mutex_lock(&c.mutex);
+            finished_before = c.n_finished;
+            active_before = c.n_started > c.n_finished;
+            pthread_mutex_unlock(&c.mutex);
+        }
+        c.checkpointed = false;
+
+        uint64_t start = histogram_now();
+        uint64_t overhead_start = rows->overhead_ns;
+        // the background checkpointer's status is only looked at once it has stopped
+        if (!write_transaction(db, insert, rows) || (!background && c.failed)) {
+            goto fail;
+        }
+        uint64_t latency = histogram_now() - start - (rows->overhead_ns - overhead_start);
+        histogram_record(writes, latency);
+
+        bool overlapped = c.checkpointed;
+        if (background) {
+            pthread_mutex_lock(&c.mutex);
+            overlapped = active_before || c.n_started > finished_before;
+            pthread_mutex_unlock(&c.mutex);
+        }
+        if (overlapped) {
+            histogram_record(during, latency);
+        }
+
+        wal_size(db_file, &size);
+        size_sum += size;
+        if (size > size_max) {
+            size_max = size;
+        }
+    }
+
+    timing_stop();
+    io_accounting_stop();
+
+    if (thread_started) {
+        pthread_mutex_lock(&c.mutex);
+        c.stop = true;
+        pthread_cond_signal(&c.cond);
+        pthread_mutex_unlock(&c.mutex);
+        pthread_join(thread, NULL);
+        thread_started = false;
+    }
+
+    if (c.failed) {
+        goto fail;
+    }
+
+    double elapsed = timing_elapsed() - row_generator_overhead(rows);
+
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    report_extended_result(tag_base, "generator_overhead", row_generator_overhead(rows), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
+    report_latencies(tag_base, writes, elapsed);
+
+    char tag[TAG_MAX];
+    format_tag(tag, tag_base, "during_checkpoint");
+    report_latencies(tag, during, 0);
+    format_tag(tag, tag_base, "checkpoint");
+    report_latencies(tag, c.durations, 0);
+
+    report_extended_result(tag_base, "checkpoints", c.durations->count, "");
+    report_extended_result(tag_base, "checkpoint_busy", c.n_busy, "");
+    report_extended_result(tag_base, "wal_size_max", size_max, "B");
+    report_extended_result(tag_base, "wal_size_mean", n_transactions ? size_sum / n_transactions
+            : 0, "B");
+    report_extended_result(tag_base, "wal_size_final", size, "B");
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    if (thread_started) {
+        pthread_mutex_lock(&c.mutex);
+        c.stop = true;
+        pthread_cond_signal(&c.cond);
+        pthread_mutex_unlock(&c.mutex);
+        pthread_join(thread, NULL);
+    }
+    sqlite3_finalize(insert);
+    db_close(c.db);
+    db_close(db);
+    test_opts.db.journal_mode = journal_mode;
+    pthread_cond_destroy(&c.cond);
+    pthread_mutex_destroy(&c.mutex);
+    histogram_destroy(c.durations);
+    histogram_destroy(during);
+    histogram_destroy(writes);
+    row_generator_destroy(rows);
+
+    return retv;
+}
+
+int test_checkpoint_autocheckpoint(const char *tag_base, const char *db_file, int n_transactions)
+{
+    int retv = EXIT_SUCCESS;
+    unsigned i;
+
+    for (i = 0; i < sizeof(autocheckpoint_sweep) / sizeof(autocheckpoint_sweep[0]); ++i) {
+        char step_tag_base[TAG_MAX];
+        format_tag(step_tag_base, tag_base, autocheckpoint_sweep[i].tag);
+
+        if (checkpoint_run(step_tag_base, db_file, n_transactions, autocheckpoint_sweep[i].pages,
+                    SQLITE_CHECKPOINT_PASSIVE, false) != EXIT_SUCCESS) {
+            retv = EXIT_FAILURE;
+        }
+    }
+
+    return retv;
+}
+
+int test_checkpoint_modes(const char *tag_base, const char *db_file, int n_transactions)
+{
+    int retv = EXIT_SUCCESS;
+    unsigned i;
+    int background;
+
+    for (background = 0; background <= 1; ++background) {
+        for (i = 0; i < sizeof(checkpoint_modes) / sizeof(checkpoint_modes[0]); ++i) {
+            char step_tag_base[TAG_MAX];
+            char mode_tag[32];
+            snprintf(mode_tag, sizeof(mode_tag), "%s.%s", background ? "background" : "inline",
+                    checkpoint_modes[i].tag);
+            format_tag(step_tag_base, tag_base, mode_tag);
+
+            if (checkpoint_run(step_tag_base, db_file, n_transactions, DEFAULT_CHECKPOINT_PAGES,
+                        checkpoint_modes[i].mode, background) != EXIT_SUCCESS) {
+                retv = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return retv;
+}
@@ -23,32 +23,627 @@
 #include <blts_log.h>
 #include <errno.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "baseline.h"
 #include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "io.h"
+#include "jobs.h"
+#include "json.h"
+#include "memory.h"
+#include "report.h"
+#include "script.h"
+
+typedef enum
+{
+    EXEC_TEXT,
+    EXEC_PREPARED,
+    EXEC_BOTH
+} exec_mode;
+
+static int exec_test(void* user_ptr, int test_num);
+
+static blts_cli_testcase builtin_test_cases[] =
+{
+    { "insert_no_transaction", exec_test, 160000 },
+    { "insert", exec_test, 20000 },
+    { "insert_indexed", exec_test, 20000 },
+    { "select", exec_test, 20000 },
+    { "select_compare_strings", exec_test, 40000 },
+
+    { "create_index", exec_test, 20000 },
+    { "select_indexed", exec_test, 20000 },
+    { "update", exec_test, 100000 },
+    { "update_indexed", exec_test, 80000 },
+    { "update_strings_indexed", exec_test, 20000 },
+
+    { "insert_from_select", exec_test, 20000 },
+    { "delete", exec_test, 20000 },
+    { "delete_indexed", exec_test, 20000 },
+    { "big_insert_after_big_delete", exec_test, 20000 },
+    { "small_inserts_after_big_delete", exec_test, 20000 },
+
+    { "drop_table", exec_test, 20000 },
+    { "concurrent_readers", exec_test, 60000 },
+    { "concurrent_writers", exec_test, 60000 },
+    { "concurrent_readers_writers", exec_test, 60000 },
+    { "bulk_insert_values", exec_test, 40000 },
+
+    { "bulk_insert_batched", exec_test, 160000 },
+    { "bulk_insert_json_each", exec_test, 40000 },
+    { "oltp", exec_test, 60000 },
+    { "checkpoint_autocheckpoint", exec_test, 120000 },
+    { "checkpoint_modes", exec_test, 240000 },
+
+    { "aging", exec_test, 120000 },
+    { "multiprocess", exec_test, 240000 },
+    { "fts", exec_test, 60000 },
+    { "indexes", exec_test, 120000 },
+    { "backup", exec_test, 120000 },
+    { "blob", exec_test, 120000 },
+    { "startup", exec_test, 120000 },
+
+    BLTS_CLI_END_OF_LIST
+};
+
+enum {
+    BUILTIN_CASES = sizeof(builtin_test_cases) / sizeof(builtin_test_cases[0]) - 1,
+    SCRIPTS_MAX = 32,
+    CASES_MAX = BUILTIN_CASES + SCRIPTS_MAX + 1,
+};
+
+// the built-in cases followed by one per -script, registered by register_scripts()
+static blts_cli_testcase test_cases[CASES_MAX];
+static workload_script *scripts[SCRIPTS_MAX];
+static int n_scripts;
+
+enum { SCRIPT_TIMEOUT = 60000, SCRIPT_SELECTS = 1000 };
+
+enum {
+    MATRIX_MAX = 32,
+    MATRIX_VALUE_MAX = 16,
+    ALLOCATORS_MAX = 3,
+    PROCESS_COUNTS_MAX = 16,
+    BLOB_SIZES_MAX = 8,
+};
+
+// one configuration of a matrix run, results are tagged '<case>.<journal_mode>[.<synchronous>]'
+typedef struct
+{
+    char journal_mode[MATRIX_VALUE_MAX];
+    char synchronous[MATRIX_VALUE_MAX];
+    char tag[2 * MATRIX_VALUE_MAX];
+} matrix_entry;
 
 typedef struct
 {
     char db_file[PATH_MAX];
+    exec_mode exec;
+    int n_readers;
+    int n_writers;
+    db_config db;
+    matrix_entry matrix[MATRIX_MAX];
+    int n_matrix;
+    double scale;
+    // overrides set with -rows/-selects, index 0 applies to all cases, others to test_num
+    int rows[CASES_MAX];
+    int selects[CASES_MAX];
+    int iterations;
+    int warmup;
+    bool has_seed;
+    unsigned seed;
+    char baseline_file[PATH_MAX];
+    char save_baseline_file[PATH_MAX];
+    char json_file[PATH_MAX];
+    bool memory_sweep;
+    bool mmap_sweep;
+    bool cold;
+    bool fixture_cache;
+    memory_config memory;
+    // compared when more than one is listed with -allocator
+    allocator allocators[ALLOCATORS_MAX];
+    int n_allocators;
+    double regression_threshold;
+    oltp_workload oltp;
+    double duration;
+    double rate;
+    int process_counts[PROCESS_COUNTS_MAX];
+    int n_process_counts;
+    int busy_timeout;
+    int jobs;
+    // percents, 0 only warns about interference between jobs
+    double jobs_max_interference;
+    int blob_sizes[BLOB_SIZES_MAX];
+    int n_blob_sizes;
 } test_execution_params;
 
+enum { DEFAULT_READERS = 4, DEFAULT_WRITERS = 2, MAX_THREADS = 256 };
+
+static const int DEFAULT_PROCESS_COUNTS[] = { 1, 2, 4, 8 };
+
+static const int DEFAULT_BLOB_SIZES[] = { 4096, 65536, 1024 * 1024, 4 * 1024 * 1024 };
+
+// bytes of blobs stored per size by the blob case, scaled with -rows and -scale
+enum { BLOB_BYTES = 32 * 1024 * 1024, BLOB_WIDE_ROWS = 2500 };
+
+enum { STARTUP_OPENS = 100 };
+
+// percents
+static const double DEFAULT_REGRESSION_THRESHOLD = 10;
+
+// the smallest page cache of -memory-sweep and the database size, per table row, the largest one
+// must hold (two tables or a table with two indexes, plus overhead)
+enum { MEMORY_SWEEP_MIN_KIB = 256, DB_BYTES_PER_ROW = 160 };
+
+// table size the default row counts of all cases are relative to
+enum { BASE_TABLE_SIZE = 25000 };
+
+static const char *const journal_modes[] = {
+    "delete", "truncate", "persist", "memory", "wal", "off", NULL
+};
+static const char *const synchronous_modes[] = { "off", "normal", "full", "extra", NULL };
+static const char *const temp_stores[] = { "default", "file", "memory", NULL };
+static const char *const locking_modes[] = { "normal", "exclusive", NULL };
+// indexed by allocator
+static const char *const allocator_names[] = { "system", "memsys5", "pool", NULL };
+
+static const char *const oltp_keys_names[] = { "uniform", "zipfian", "latest", NULL };
+
+// about what a typical application does, in percents
+static const oltp_workload DEFAULT_OLTP_WORKLOAD = {
+    .weights = { 70, 15, 10, 3, 2 },
+    .keys = OLTP_KEYS_UNIFORM,
+    .transaction_ops = 10,
+};
+
+// options setting a db_config field, integer valued unless the allowed values are listed
+static const struct
+{
+    const char *option;
+    size_t offset;
+    const char *const *allowed;
+} db_config_options[] =
+{
+    { "-journal-mode", offsetof(db_config, journal_mode), journal_modes },
+    { "-synchronous", offsetof(db_config, synchronous), synchronous_modes },
+    { "-page-size", offsetof(db_config, page_size), NULL },
+    { "-cache-size", offsetof(db_config, cache_size), NULL },
+    { "-mmap-size", offsetof(db_config, mmap_size), NULL },
+    { "-temp-store", offsetof(db_config, temp_store), temp_stores },
+    { "-locking-mode", offsetof(db_config, locking_mode), locking_modes },
+};
+
 static void help(const char* help_msg_base)
 {
     fprintf(stdout, help_msg_base,
-        "-f db-file"
+        "-f db-file [-exec text|prepared|both] [-readers N] [-writers N] [-journal-mode mode] "
+        "[-synchronous mode] [-page-size N] [-cache-size N] [-mmap-size N] [-temp-store mode] "
+        "[-locking-mode mode] [-matrix journal-mode[:synchronous],...] [-scale F] "
+        "[-rows [case=]N] [-selects [case=]N] [-iterations N] [-warmup N] [-seed N] "
+        "[-baseline file] [-save-baseline file] [-regression-threshold P] [-json file] "
+        "[-memory-sweep] [-heap KiB] [-lookaside size:count] "
+        "[-allocator system|memsys5|pool,...] [-mmap-sweep] [-cold] [-oltp-mix op:weight,...] "
+        "[-oltp-keys uniform|zipfian|latest] [-oltp-transaction N] [-duration S] [-rate N] "
+        "[-processes N,...] [-busy-timeout MS] [-script file] [-jobs N] [-jobs-max-interference P] "
+        "[-fixture-cache] "
+        "[-blob-sizes size,...]"
         ,
         "-f: Database file path to use (pass ':memory:' to test on an in-memory database instance)\n"
+        "-exec: How looped queries are executed: 'text' passes SQL text to sqlite3_exec() "
+        "(default), 'prepared' binds parameters to reusable prepared statements, 'both' runs "
+        "each such test both ways and reports the difference as '<case>.parse_overhead'\n"
+        "-readers: Number of reader threads in the concurrent_* cases (default 4)\n"
+        "-writers: Number of writer threads in the concurrent_* cases (default 2)\n"
+        "-journal-mode, -synchronous, -page-size, -cache-size, -mmap-size, -temp-store, "
+        "-locking-mode: Value of the PRAGMA of the same name applied to each connection right "
+        "after it is opened (default: sqlite default)\n"
+        "-matrix: Run each test case once per listed configuration, e.g. "
+        "'wal:normal,delete:full', tagging results '<case>.wal.normal.<tag>' etc. Overrides "
+        "-journal-mode and, where given, -synchronous\n"
+        "-scale: Multiply table sizes and row counts of all cases (default 25000 rows) by F\n"
+        "-rows: Table size to use, in the given case only when prefixed with 'case=' (may be "
+        "repeated). Row counts of the case are scaled proportionally\n"
+        "-selects: Number of queries in the select*, concurrent_*, oltp, fts and indexes cases, "
+        "and of opens in the startup case (default 100), in the given case only when prefixed "
+        "with 'case=' (may be repeated)\n"
+        "-iterations: Run each test case N times, each on a fresh database, and report the "
+        "mean of each result under its tag along with '<tag>.stddev', '<tag>.median', "
+        "'<tag>.min' and '<tag>.ci95' (half-width of the 95% confidence interval) (default 1)\n"
+        "-warmup: Run each test case N more times before the measured iterations, discarding "
+        "the results (default 0)\n"
+        "-jobs: Run up to N (at most one per CPU) of the iterations of each test case in "
+        "parallel, each in a process of its own pinned to a CPU and working on a database file "
+        "of its own ('<db-file>.job<slot>'), after running the first one alone. Reports "
+        "'<case>.jobs.solo_time' and '.parallel_time' (mean wall time of an iteration run alone "
+        "and in parallel), '.interference' (their difference in percents, warned about when "
+        "above the regression threshold), '.solo_involuntary_switches', "
+        "'.parallel_involuntary_switches' and '.speedup'\n"
+        "-jobs-max-interference: Fail test cases whose -jobs interference exceeds P percents, "
+        "without summarizing their results or comparing them with the baseline (default: only "
+        "warn)\n"
+        "-seed: Seed test data generation with N in each iteration so that all of them, and "
+        "runs using the same seed, work on identical data (default: seeded from time)\n"
+        "-baseline: Compare results with a baseline saved by an earlier run, by -save-baseline "
+        "or -json. A test case fails "
+        "when any of its times grows, or rates drops, by more than the regression threshold "
+        "and, when both runs did multiple iterations, the change is statistically significant "
+        "(otherwise only '.elapsed' times and rates are compared)\n"
+        "-save-baseline: Save results (the means when doing multiple iterations) to the given "
+        "file for use with -baseline\n"
+        "-regression-threshold: Relative change in percents tolerated by -baseline (default 10)\n"
+        "-json: Write the results along with a description of the environment (sqlite version "
+        "and configuration, storage, CPU, memory) as a JSON document to the given file\n"
+        "-memory-sweep: Run each test case with page caches of 256 KiB, doubling up to one the "
+        "whole database fits in, given both as a preallocated SQLITE_CONFIG_PAGECACHE buffer "
+        "and as PRAGMA cache_size. Results are tagged '<case>.cache_<N>k.<tag>' and include "
+        "'memory_highwater', 'pagecache_used' (pages) and 'pagecache_overflow' (bytes allocated "
+        "outside the buffer)\n"
+        "-heap: Size of the memsys5 heap, implies '-allocator memsys5' unless another is given "
+        "(default 65536)\n"
+        "-lookaside: Lookaside slot size and number of slots per connection "
+        "(SQLITE_CONFIG_LOOKASIDE)\n"
+        "-allocator: Memory allocator used by sqlite: 'system' malloc (default), 'memsys5' "
+        "(requires sqlite built with SQLITE_ENABLE_MEMSYS5) or 'pool', a per-thread size-class "
+        "pool. Listing several runs each test case with each one, tagging results "
+        "'<case>.<allocator>.<tag>' and adding 'allocations', 'peak_rss' and 'memory_highwater'\n"
+        "-mmap-sweep: Run the select, select_compare_strings and select_indexed cases with "
+        "mmap_size of 0, a quarter and all of the database file size, tagging results "
+        "'<case>.mmap_off', '<case>.mmap_partial' and '<case>.mmap_full'. The database is "
+        "evicted from the OS page cache (posix_fadvise(POSIX_FADV_DONTNEED)) after it is "
+        "populated, queries run once cold and once warm, tagged '.cold' and '.warm'. Requires a "
+        "file-backed database, use -rows to make it much larger than the page cache\n"
+        "-cold: Close the database after it is populated, evict it from the OS page cache "
+        "(also dropping clean caches system-wide when run as root) and reopen it for the timed "
+        "section of each case working on a populated database. Adds '<case>.open_time' and "
+        "'<case>.schema_time' spent reopening and, in cases timing individual queries, "
+        "'<tag>.first_row', the latency of the first "
+        "query; read cases run their queries once cold and once warm, tagged '.cold' and "
+        "'.warm'. Requires a file-backed database\n"
+        "-fixture-cache: Populate the tables (and indexes) each distinct set of them is made of "
+        "only once, save a copy of the database next to it ('<db-file>.fixture<N>', or in "
+        "memory for in-memory databases) and restore that copy whenever a test case asks for "
+        "the same tables of the same size again. Iterations then work on identical data even "
+        "without -seed\n"
+        "-oltp-mix: Relative frequencies of the operations of the oltp case: 'point_select' and "
+        "'range_select' (100 rows) by key, 'update' of a row, 'insert' of a new key and "
+        "'delete' of the oldest one (default 'point_select:70,range_select:15,update:10,"
+        "insert:3,delete:2'). Latencies are reported per operation as '<case>.<op>.*' and over "
+        "all of them as '<case>.latency_*' and '<case>.ops_per_sec'\n"
+        "-oltp-keys: Distribution of keys the oltp case operates on: 'uniform' (default), "
+        "'zipfian' (a few hot keys spread over the table) or 'latest' (skewed to recent inserts)\n"
+        "-oltp-transaction: Number of operations per transaction in the oltp case, 1 runs each "
+        "on its own (default 10)\n"
+        "-duration: Run the concurrent_*, oltp and multiprocess cases for S seconds instead of "
+        "a fixed number of operations\n"
+        "-rate: Run the oltp case open loop, starting N operations per second on schedule "
+        "however long the previous ones took. Latencies are measured from when each operation "
+        "was due, so that stalls show up in them, and '<case>.target_ops_per_sec' and "
+        "'<case>.rate_achieved' (percents of the target) are added\n"
+        "-processes: Numbers of worker processes the multiprocess case forks in turn, each "
+        "time split between readers and writers in the proportion of -readers to -writers "
+        "(default 1,2,4,8). Results are tagged '<case>.processes_<N>.<tag>'. Skipped on "
+        "in-memory databases\n"
+        "-busy-timeout: Let connections of the concurrent_* and multiprocess cases wait for "
+        "locks for up to MS milliseconds in a busy handler instead of retrying on SQLITE_BUSY "
+        "(default 0). Time spent waiting either way is reported as '<tag>.lock_wait'\n"
+        "-script: Add a test case running the SQL script in the file (may be repeated). Lines "
+        "'-- @setup', '-- @timed [label]' and '-- @teardown', each optionally followed by "
+        "'repeat=N|rows|selects' and 'transaction', start sections executed N times (once by "
+        "default; 'rows' and 'selects' follow -rows, -scale and -selects, default 25000 and "
+        "1000), in one transaction if told so. ':index', ':number' and ':string' are bound to "
+        "a generated row per repetition, ':random' to the index of an earlier one and ':rows' "
+        "to the table size. Timed sections are reported as '<case>.<label>.<tag>' ('timed' by "
+        "default). The case is named after the file, or by a '-- @name case' line\n"
+        "-blob-sizes: Sizes of the blobs stored by the blob case, in bytes or with a 'k' or 'm' "
+        "suffix (default '4k,64k,1m,4m'). About 32 MiB of blobs (scaled with -rows and -scale) "
+        "are inserted, read and updated per size, whole and through incremental blob I/O, "
+        "tagging results '<case>.blob_<size>.<phase>' with 'throughput' in MB/s and "
+        "'overflow_pages' (requires sqlite built with SQLITE_ENABLE_DBSTAT_VTAB)\n"
         );
 }
 
+static bool is_one_of(const char *value, const char *const *allowed)
+{
+    for (; *allowed != NULL; ++allowed) {
+        if (strcmp(value, *allowed) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool is_integer(const char *value)
+{
+    char *end;
+    strtoll(value, &end, 10);
+
+    return *value != '\0' && *end == '\0';
+}
+
+// parses '[case=]N' into the per-case overrides array
+static bool parse_case_override(int *overrides, const char *arg)
+{
+    int test_num = 0;
+    const char *value = arg;
+
+    const char *eq = strchr(arg, '=');
+    if (eq != NULL) {
+        for (test_num = 1; test_cases[test_num - 1].case_name != NULL; ++test_num) {
+            const char *name = test_cases[test_num - 1].case_name;
+            if (strlen(name) == (size_t)(eq - arg) && strncmp(name, arg, eq - arg) == 0) {
+                break;
+            }
+        }
+        if (test_cases[test_num - 1].case_name == NULL) {
+            BLTS_ERROR("%s: No such test case\n", arg);
+            return false;
+        }
+        value = eq + 1;
+    }
+
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 1 || n > INT_MAX) {
+        BLTS_ERROR("%s: Invalid count\n", arg);
+        return false;
+    }
+
+    overrides[test_num] = n;
+    return true;
+}
+
+static bool parse_matrix(test_execution_params *params, const char *spec)
+{
+    char buf[MATRIX_MAX * 2 * MATRIX_VALUE_MAX];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    char *saveptr;
+    char *entry;
+    for (entry = strtok_r(buf, ",", &saveptr); entry != NULL;
+            entry = strtok_r(NULL, ",", &saveptr)) {
+        if (params->n_matrix == MATRIX_MAX) {
+            BLTS_ERROR("%s: Too many configurations\n", spec);
+            return false;
+        }
+
+        matrix_entry *m = &params->matrix[params->n_matrix++];
+        char *synchronous = strchr(entry, ':');
+        if (synchronous != NULL) {
+            *synchronous++ = '\0';
+        }
+
+        if (!is_one_of(entry, journal_modes)) {
+            BLTS_ERROR("%s: Invalid journal mode\n", entry);
+            return false;
+        }
+        snprintf(m->journal_mode, MATRIX_VALUE_MAX, "%s", entry);
+        snprintf(m->tag, sizeof(m->tag), "%s", entry);
+
+        if (synchronous != NULL) {
+            if (!is_one_of(synchronous, synchronous_modes)) {
+                BLTS_ERROR("%s: Invalid synchronous mode\n", synchronous);
+                return false;
+            }
+            snprintf(m->synchronous, MATRIX_VALUE_MAX, "%s", synchronous);
+            snprintf(m->tag, sizeof(m->tag), "%s.%s", entry, synchronous);
+        }
+    }
+
+    return params->n_matrix > 0;
+}
+
+static bool parse_db_config_option(test_execution_params *params, const char *option,
+        const char *value, bool *matched)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(db_config_options) / sizeof(db_config_options[0]); ++i) {
+        if (strcmp(option, db_config_options[i].option) != 0) {
+            continue;
+        }
+
+        *matched = true;
+
+        if (db_config_options[i].allowed != NULL
+                ? !is_one_of(value, db_config_options[i].allowed)
+                : !is_integer(value)) {
+            BLTS_ERROR("%s: Invalid value for %s\n", value, option);
+            return false;
+        }
+
+        *(const char **)((char *)&params->db + db_config_options[i].offset) = value;
+        return true;
+    }
+
+    *matched = false;
+    return true;
+}
+
+// ratio of the case's table size to BASE_TABLE_SIZE, as set with -rows or -scale
+static double size_factor(const test_execution_params *params, int test_num)
+{
+    int rows = params->rows[test_num] ? params->rows[test_num] : params->rows[0];
+
+    return rows ? (double)rows / BASE_TABLE_SIZE : params->scale;
+}
+
+// scales a row count given relative to BASE_TABLE_SIZE
+static int case_rows(const test_execution_params *params, int test_num, int n_rows)
+{
+    double scaled = n_rows * size_factor(params, test_num) + 0.5;
+
+    return scaled < 1 ? 1 : scaled < INT_MAX ? (int)scaled : INT_MAX;
+}
+
+static int case_selects(const test_execution_params *params, int test_num, int n_selects)
+{
+    return params->selects[test_num] ? params->selects[test_num]
+        : params->selects[0] ? params->selects[0]
+        : n_selects;
+}
+
+static bool parse_count(const char *arg, int min, int *count)
+{
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < min || value > INT_MAX) {
+        BLTS_ERROR("%s: Invalid count\n", arg);
+        return false;
+    }
+
+    *count = value;
+    return true;
+}
+
+static bool parse_allocators(test_execution_params *params, const char *list)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    char *saveptr;
+    char *name;
+    for (name = strtok_r(buf, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+        int a;
+        for (a = 0; allocator_names[a] != NULL && strcmp(name, allocator_names[a]) != 0; ++a) {
+        }
+
+        if (allocator_names[a] == NULL || params->n_allocators == ALLOCATORS_MAX) {
+            BLTS_ERROR("%s: Invalid allocator list\n", list);
+            return false;
+        }
+        params->allocators[params->n_allocators++] = a;
+    }
+
+    return params->n_allocators > 0;
+}
+
+// parses 'op:weight,...', operations not listed are not executed
+static bool parse_oltp_mix(test_execution_params *params, const char *list)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    memset(params->oltp.weights, 0, sizeof(params->oltp.weights));
+
+    char *saveptr;
+    char *entry;
+    for (entry = strtok_r(buf, ",", &saveptr); entry != NULL;
+            entry = strtok_r(NULL, ",", &saveptr)) {
+        char *weight = strchr(entry, ':');
+        if (weight == NULL) {
+            BLTS_ERROR("%s: Invalid operation mix\n", list);
+            return false;
+        }
+        *weight++ = '\0';
+
+        int op;
+        for (op = 0; op < OLTP_OPS && strcmp(entry, oltp_op_names[op]) != 0; ++op) {
+        }
+
+        if (op == OLTP_OPS) {
+            BLTS_ERROR("%s: No such operation\n", entry);
+            return false;
+        }
+        if (!parse_count(weight, 0, &params->oltp.weights[op])) {
+            return false;
+        }
+    }
+
+    int op;
+    for (op = 0; op < OLTP_OPS && params->oltp.weights[op] == 0; ++op) {
+    }
+
+    if (op == OLTP_OPS) {
+        BLTS_ERROR("%s: Invalid operation mix\n", list);
+        return false;
+    }
+
+    return true;
+}
+
+// true for test cases that run for test_opts.duration when it is set
+static bool is_time_bounded_case(int test_num)
+{
+    return (test_num >= 17 && test_num <= 19) || test_num == 23 || test_num == 27;
+}
+
+static bool parse_process_counts(test_execution_params *params, const char *list)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    params->n_process_counts = 0;
+
+    char *saveptr;
+    char *count;
+    for (count = strtok_r(buf, ",", &saveptr); count != NULL;
+            count = strtok_r(NULL, ",", &saveptr)) {
+        if (params->n_process_counts == PROCESS_COUNTS_MAX) {
+            BLTS_ERROR("%s: Too many process counts\n", list);
+            return false;
+        }
+        if (!parse_count(count, 1, &params->process_counts[params->n_process_counts])) {
+            return false;
+        }
+        if (params->process_counts[params->n_process_counts++] > MAX_THREADS) {
+            BLTS_ERROR("%s: Too many processes\n", count);
+            return false;
+        }
+    }
+
+    return params->n_process_counts > 0;
+}
+
+static bool parse_blob_sizes(test_execution_params *params, const char *list)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    params->n_blob_sizes = 0;
+
+    char *saveptr;
+    char *size;
+    for (size = strtok_r(buf, ",", &saveptr); size != NULL; size = strtok_r(NULL, ",", &saveptr)) {
+        char *end;
+        long value = strtol(size, &end, 10);
+        long unit = *end == 'k' ? 1024 : *end == 'm' ? 1024 * 1024 : 1;
+        if (unit > 1) {
+            ++end;
+        }
+
+        // sqlite limits blobs to SQLITE_MAX_LENGTH, 1000000000 by default
+        if (params->n_blob_sizes == BLOB_SIZES_MAX || end == size || *end != '\0' || value < 1
+                || value > 1000000000 / unit) {
+            BLTS_ERROR("%s: Invalid blob size list\n", list);
+            return false;
+        }
+        params->blob_sizes[params->n_blob_sizes++] = value * unit;
+    }
+
+    return params->n_blob_sizes > 0;
+}
+
 static void *argument_processor(int argc, char **argv)
 {
     int i;
     test_execution_params* params = malloc(sizeof(test_execution_params));
     memset(params, 0, sizeof(test_execution_params));
+    params->n_readers = DEFAULT_READERS;
+    params->n_writers = DEFAULT_WRITERS;
+    params->scale = 1.0;
+    params->iterations = 1;
+    params->regression_threshold = DEFAULT_REGRESSION_THRESHOLD;
+    params->oltp = DEFAULT_OLTP_WORKLOAD;
+    params->n_process_counts = sizeof(DEFAULT_PROCESS_COUNTS) / sizeof(DEFAULT_PROCESS_COUNTS[0]);
+    memcpy(params->process_counts, DEFAULT_PROCESS_COUNTS, sizeof(DEFAULT_PROCESS_COUNTS));
+    params->n_blob_sizes = sizeof(DEFAULT_BLOB_SIZES) / sizeof(DEFAULT_BLOB_SIZES[0]);
+    memcpy(params->blob_sizes, DEFAULT_BLOB_SIZES, sizeof(DEFAULT_BLOB_SIZES));
 
     for (i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-f") == 0) {
@@ -61,8 +656,205 @@ static void *argument_processor(int argc, char **argv)
                 BLTS_ERROR("%s: PATH_MAX exceeded\n", argv[i]);
                 goto error;
             }
+        } else if (strcmp(argv[i], "-exec") == 0) {
+            if (++i >= argc) {
+                goto error;
+            }
+
+            if (strcmp(argv[i], "text") == 0) {
+                params->exec = EXEC_TEXT;
+            } else if (strcmp(argv[i], "prepared") == 0) {
+                params->exec = EXEC_PREPARED;
+            } else if (strcmp(argv[i], "both") == 0) {
+                params->exec = EXEC_BOTH;
+            } else {
+                BLTS_ERROR("%s: Invalid execution mode\n", argv[i]);
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-readers") == 0 || strcmp(argv[i], "-writers") == 0) {
+            int *n_threads = argv[i][1] == 'r' ? &params->n_readers : &params->n_writers;
+            if (++i >= argc) {
+                goto error;
+            }
+
+            char *end;
+            long value = strtol(argv[i], &end, 10);
+            if (*end != '\0' || value < 1 || value > MAX_THREADS) {
+                BLTS_ERROR("%s: Invalid number of threads\n", argv[i]);
+                goto error;
+            }
+            *n_threads = value;
+        } else if (strcmp(argv[i], "-scale") == 0) {
+            if (++i >= argc) {
+                goto error;
+            }
+
+            char *end;
+            params->scale = strtod(argv[i], &end);
+            if (*end != '\0' || !(params->scale > 0)) {
+                BLTS_ERROR("%s: Invalid scale factor\n", argv[i]);
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-rows") == 0) {
+            if (++i >= argc || !parse_case_override(params->rows, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-selects") == 0) {
+            if (++i >= argc || !parse_case_override(params->selects, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-iterations") == 0) {
+            if (++i >= argc || !parse_count(argv[i], 1, &params->iterations)) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-jobs") == 0) {
+            if (++i >= argc || !parse_count(argv[i], 1, &params->jobs)) {
+                goto error;
+            }
+            if (params->jobs > MAX_THREADS) {
+                BLTS_ERROR("%s: Too many jobs\n", argv[i]);
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-warmup") == 0) {
+            if (++i >= argc || !parse_count(argv[i], 0, &params->warmup)) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-seed") == 0) {
+            if (++i >= argc) {
+                goto error;
+            }
+
+            char *end;
+            unsigned long seed = strtoul(argv[i], &end, 10);
+            if (argv[i][0] == '\0' || *end != '\0' || seed > UINT_MAX) {
+                BLTS_ERROR("%s: Invalid seed\n", argv[i]);
+                goto error;
+            }
+            params->seed = seed;
+            params->has_seed = true;
+        } else if (strcmp(argv[i], "-baseline") == 0 || strcmp(argv[i], "-save-baseline") == 0
+                || strcmp(argv[i], "-json") == 0) {
+            char *file = argv[i][1] == 'b' ? params->baseline_file
+                : argv[i][1] == 's' ? params->save_baseline_file
+                : params->json_file;
+            if (++i >= argc) {
+                goto error;
+            }
+
+            int n_written = snprintf(file, PATH_MAX, "%s", argv[i]);
+            if (n_written >= PATH_MAX) {
+                BLTS_ERROR("%s: PATH_MAX exceeded\n", argv[i]);
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-regression-threshold") == 0
+                || strcmp(argv[i], "-jobs-max-interference") == 0) {
+            bool regression = strcmp(argv[i], "-regression-threshold") == 0;
+            if (++i >= argc) {
+                goto error;
+            }
+
+            char *end;
+            double value = strtod(argv[i], &end);
+            if (*end != '\0' || !(value >= 0)) {
+                BLTS_ERROR("%s: Invalid %s\n", argv[i],
+                        regression ? "regression threshold" : "interference");
+                goto error;
+            }
+            *(regression ? &params->regression_threshold : &params->jobs_max_interference) = value;
+        } else if (strcmp(argv[i], "-duration") == 0 || strcmp(argv[i], "-rate") == 0) {
+            bool duration = strcmp(argv[i], "-duration") == 0;
+            if (++i >= argc) {
+                goto error;
+            }
+
+            char *end;
+            double value = strtod(argv[i], &end);
+            if (*end != '\0' || !(value > 0)) {
+                BLTS_ERROR("%s: Invalid %s\n", argv[i], duration ? "duration" : "rate");
+                goto error;
+            }
+            *(duration ? &params->duration : &params->rate) = value;
+        } else if (strcmp(argv[i], "-processes") == 0) {
+            if (++i >= argc || !parse_process_counts(params, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-blob-sizes") == 0) {
+            if (++i >= argc || !parse_blob_sizes(params, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-busy-timeout") == 0) {
+            if (++i >= argc || !parse_count(argv[i], 0, &params->busy_timeout)) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-mmap-sweep") == 0) {
+            params->mmap_sweep = true;
+        } else if (strcmp(argv[i], "-fixture-cache") == 0) {
+            params->fixture_cache = true;
+        } else if (strcmp(argv[i], "-cold") == 0) {
+            params->cold = true;
+        } else if (strcmp(argv[i], "-oltp-mix") == 0) {
+            if (++i >= argc || !parse_oltp_mix(params, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-oltp-keys") == 0) {
+            if (++i >= argc) {
+                goto error;
+            }
+
+            int k;
+            for (k = 0; oltp_keys_names[k] != NULL && strcmp(argv[i], oltp_keys_names[k]) != 0;
+                    ++k) {
+            }
+
+            if (oltp_keys_names[k] == NULL) {
+                BLTS_ERROR("%s: Invalid key distribution\n", argv[i]);
+                goto error;
+            }
+            params->oltp.keys = k;
+        } else if (strcmp(argv[i], "-oltp-transaction") == 0) {
+            if (++i >= argc || !parse_count(argv[i], 1, &params->oltp.transaction_ops)) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-memory-sweep") == 0) {
+            params->memory_sweep = true;
+        } else if (strcmp(argv[i], "-heap") == 0) {
+            int kib;
+            if (++i >= argc || !parse_count(argv[i], 1, &kib)) {
+                goto error;
+            }
+            params->memory.heap_bytes = kib * 1024L;
+        } else if (strcmp(argv[i], "-allocator") == 0) {
+            if (++i >= argc || !parse_allocators(params, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-lookaside") == 0) {
+            if (++i >= argc) {
+                goto error;
+            }
+
+            memory_config *m = &params->memory;
+            char end;
+            if (sscanf(argv[i], "%d:%d%c", &m->lookaside_slot_size, &m->lookaside_slots, &end) != 2
+                    || m->lookaside_slot_size < 0 || m->lookaside_slots < 0) {
+                BLTS_ERROR("%s: Invalid lookaside configuration\n", argv[i]);
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-matrix") == 0) {
+            if (++i >= argc || !parse_matrix(params, argv[i])) {
+                goto error;
+            }
+        } else if (strcmp(argv[i], "-script") == 0) {
+            // loaded by register_scripts()
+            if (++i >= argc) {
+                goto error;
+            }
         } else {
-            goto error;
+            bool matched;
+            if (i + 1 >= argc || !parse_db_config_option(params, argv[i], argv[i + 1], &matched)
+                    || !matched) {
+                goto error;
+            }
+            ++i;
         }
     }
 
@@ -70,9 +862,66 @@ static void *argument_processor(int argc, char **argv)
         goto error;
     }
 
+    if (params->baseline_file[0] != '\0'
+            && !baseline_load(params->baseline_file, params->regression_threshold / 100)) {
+        goto error;
+    }
+
+    if (params->mmap_sweep && db_is_in_memory(params->db_file)) {
+        BLTS_ERROR("-mmap-sweep requires a file-backed database\n");
+        goto error;
+    }
+
+    if (params->cold && db_is_in_memory(params->db_file)) {
+        BLTS_ERROR("-cold requires a file-backed database\n");
+        goto error;
+    }
+
+    test_opts.db = params->db;
+    test_opts.cold = params->cold;
+    test_opts.mmap_fraction = -1;
+    test_opts.duration = params->duration;
+    test_opts.rate = params->rate;
+    test_opts.busy_timeout = params->busy_timeout;
+    test_opts.fixture_cache = params->fixture_cache;
+
+    if (!io_accounting_install()) {
+        goto error;
+    }
+
+    if (params->n_allocators == 1) {
+        params->memory.allocator = params->allocators[0];
+    } else if (params->n_allocators == 0 && params->memory.heap_bytes > 0) {
+        params->memory.allocator = ALLOCATOR_MEMSYS5;
+    }
+
+    if ((params->memory.allocator != ALLOCATOR_SYSTEM || params->memory.lookaside_slot_size > 0)
+            && !memory_configure(&params->memory)) {
+        goto error;
+    }
+
+    if (params->json_file[0] != '\0'
+            && !json_open(params->json_file, argc, argv, params->db_file)) {
+        goto error;
+    }
+
+    // most cases do O(n log n) work on their tables, some O(n^2); leave room for the latter
+    for (i = 1; test_cases[i - 1].case_name != NULL; ++i) {
+        double factor = size_factor(params, i);
+        double timeout = test_cases[i - 1].timeout * (double)(params->iterations + params->warmup);
+        if (factor > 1) {
+            timeout *= factor * factor;
+        }
+        if (is_time_bounded_case(i)) {
+            timeout += params->duration * 1000 * (params->iterations + params->warmup);
+        }
+        test_cases[i - 1].timeout = timeout < INT_MAX ? timeout : INT_MAX;
+    }
+
     return params;
 
 error:
+    baseline_clear();
     free(params);
     return NULL;
 }
@@ -81,103 +930,491 @@ static void teardown(void *user_ptr)
 {
     if (user_ptr) {
         test_execution_params* params = user_ptr;
+        if (params->save_baseline_file[0] != '\0') {
+            baseline_save(params->save_baseline_file);
+        }
         free(params);
     }
-}
 
-static int exec_test(void* user_ptr, int test_num);
+    fixture_cache_clear();
+    json_close();
+    clear_extended_results();
+    baseline_clear();
+}
 
-static blts_cli_testcase test_cases[] =
+// true for test cases that execute their queries in a loop (see test_options.prepared)
+static bool has_prepared_path(int test_num)
 {
-    { "insert_no_transaction", exec_test, 160000 },
-    { "insert", exec_test, 20000 },
-    { "insert_indexed", exec_test, 20000 },
-    { "select", exec_test, 20000 },
-    { "select_compare_strings", exec_test, 40000 },
-
-    { "create_index", exec_test, 20000 },
-    { "select_indexed", exec_test, 20000 },
-    { "update", exec_test, 100000 },
-    { "update_indexed", exec_test, 80000 },
-    { "update_strings_indexed", exec_test, 20000 },
-
-    { "insert_from_select", exec_test, 20000 },
-    { "delete", exec_test, 20000 },
-    { "delete_indexed", exec_test, 20000 },
-    { "big_insert_after_big_delete", exec_test, 20000 },
-    { "small_inserts_after_big_delete", exec_test, 20000 },
-
-    { "drop_table", exec_test, 20000 },
-
-    BLTS_CLI_END_OF_LIST
-};
+    switch(test_num)
+    {
+    case 1: case 2: case 3: case 4: case 5: case 7: case 8: case 9: case 10: case 15:
+    case 17: case 18: case 19: case 27:
+        return true;
+    default:
+        return false;
+    }
+}
 
-static int exec_test(void* user_ptr, int test_num)
+static int run_test(test_execution_params* params, int test_num, const char *tag_base)
 {
-    srand(time(NULL));
-
-    test_execution_params* params = user_ptr;
-    const char *tag_base = test_cases[test_num - 1].case_name;
+    const char *db_file = params->db_file;
+    int table_size = case_rows(params, test_num, BASE_TABLE_SIZE);
     int rc = 0;
 
     switch(test_num)
     {
     case 1:
-        rc = test_insert(tag_base, params->db_file, false, false, 1000);
+        rc = test_insert(tag_base, db_file, false, false, case_rows(params, test_num, 1000));
         break;
     case 2:
-        rc = test_insert(tag_base, params->db_file, true, false, 25000);
+        rc = test_insert(tag_base, db_file, true, false, table_size);
         break;
     case 3:
-        rc = test_insert(tag_base, params->db_file, true, true, 25000);
+        rc = test_insert(tag_base, db_file, true, true, table_size);
         break;
     case 4:
-        rc = test_select(tag_base, params->db_file, 25000, false, 100);
+        rc = test_select(tag_base, db_file, table_size, false,
+                case_selects(params, test_num, 100));
         break;
     case 5:
-        rc = test_select_compare_strings(tag_base, params->db_file, 25000, 100);
+        rc = test_select_compare_strings(tag_base, db_file, table_size,
+                case_selects(params, test_num, 100));
         break;
     case 6:
-        rc = test_create_index(tag_base, params->db_file, 25000);
+        rc = test_create_index(tag_base, db_file, table_size);
         break;
     case 7:
-        rc = test_select(tag_base, params->db_file, 25000, true, 5000);
+        rc = test_select(tag_base, db_file, table_size, true,
+                case_selects(params, test_num, 5000));
         break;
     case 8:
-        rc = test_update(tag_base, params->db_file, 25000, false, 1000);
+        rc = test_update(tag_base, db_file, table_size, false, case_rows(params, test_num, 1000));
         break;
     case 9:
-        rc = test_update(tag_base, params->db_file, 25000, true, 25000);
+        rc = test_update(tag_base, db_file, table_size, true, table_size);
         break;
     case 10:
-        rc = test_update_strings(tag_base, params->db_file, 25000, 25000);
+        rc = test_update_strings(tag_base, db_file, table_size, table_size);
         break;
     case 11:
-        rc = test_insert_from_select(tag_base, params->db_file, 25000);
+        rc = test_insert_from_select(tag_base, db_file, table_size);
         break;
     case 12:
-        rc = test_delete(tag_base, params->db_file, 25000, false);
+        rc = test_delete(tag_base, db_file, table_size, false);
         break;
     case 13:
-        rc = test_delete(tag_base, params->db_file, 25000, true);
+        rc = test_delete(tag_base, db_file, table_size, true);
         break;
     case 14:
-        rc = test_big_insert_after_big_delete(tag_base, params->db_file, 25000);
+        rc = test_big_insert_after_big_delete(tag_base, db_file, table_size);
         break;
     case 15:
-        rc = test_small_inserts_after_big_delete(tag_base, params->db_file, 25000, 12000);
+        rc = test_small_inserts_after_big_delete(tag_base, db_file, table_size,
+                case_rows(params, test_num, 12000));
         break;
     case 16:
-        rc = test_drop_table(tag_base, params->db_file, 25000);
+        rc = test_drop_table(tag_base, db_file, table_size);
+        break;
+    case 17:
+        rc = test_concurrent(tag_base, db_file, table_size, params->n_readers, 0,
+                case_selects(params, test_num, 5000), 0);
+        break;
+    case 18:
+        rc = test_concurrent(tag_base, db_file, table_size, 0, params->n_writers, 0,
+                case_rows(params, test_num, 500));
+        break;
+    case 19:
+        rc = test_concurrent(tag_base, db_file, table_size, params->n_readers, params->n_writers,
+                case_selects(params, test_num, 5000), case_rows(params, test_num, 500));
+        break;
+    case 20:
+        rc = test_bulk_insert_values(tag_base, db_file, table_size);
+        break;
+    case 21:
+        rc = test_bulk_insert_batched(tag_base, db_file, table_size);
+        break;
+    case 22:
+        rc = test_bulk_insert_json_each(tag_base, db_file, table_size);
+        break;
+    case 23:
+        rc = test_oltp(tag_base, db_file, table_size, case_selects(params, test_num, 20000),
+                &params->oltp);
+        break;
+    case 24:
+        rc = test_checkpoint_autocheckpoint(tag_base, db_file, case_rows(params, test_num, 5000));
+        break;
+    case 25:
+        rc = test_checkpoint_modes(tag_base, db_file, case_rows(params, test_num, 5000));
+        break;
+    case 26:
+        rc = test_aging(tag_base, db_file, table_size);
+        break;
+    case 27:
+        rc = test_multiprocess(tag_base, db_file, table_size, params->process_counts,
+                params->n_process_counts, params->n_readers, params->n_writers,
+                case_selects(params, test_num, 5000), case_rows(params, test_num, 500));
+        break;
+    case 28:
+        rc = test_fts(tag_base, db_file, table_size, case_selects(params, test_num, 1000));
+        break;
+    case 29:
+        rc = test_indexes(tag_base, db_file, table_size, case_selects(params, test_num, 200));
+        break;
+    case 30:
+        rc = test_backup(tag_base, db_file, table_size);
+        break;
+    case 31:
+        rc = test_blob(tag_base, db_file, params->blob_sizes, params->n_blob_sizes,
+                case_rows(params, test_num, BLOB_BYTES),
+                case_rows(params, test_num, BLOB_WIDE_ROWS));
+        break;
+    case 32:
+        rc = test_startup(tag_base, db_file, case_selects(params, test_num, STARTUP_OPENS));
         break;
     default:
-        rc = -EINVAL;
+        if (test_num > BUILTIN_CASES && test_num <= BUILTIN_CASES + n_scripts) {
+            rc = test_script(tag_base, db_file, scripts[test_num - BUILTIN_CASES - 1], table_size,
+                    case_selects(params, test_num, SCRIPT_SELECTS));
+        } else {
+            rc = -EINVAL;
+        }
         break;
     }
 
     return rc;
 }
 
+// runs the test in the execution mode(s) selected with '-exec'
+static int exec_case(test_execution_params* params, int test_num, const char *tag_base)
+{
+    int rc = 0;
+
+    if (params->exec != EXEC_BOTH || !has_prepared_path(test_num)) {
+        test_opts.prepared = params->exec == EXEC_PREPARED && has_prepared_path(test_num);
+        return run_test(params, test_num, tag_base);
+    }
+
+    test_opts.prepared = false;
+    rc = run_test(params, test_num, tag_base);
+    if (rc != 0) {
+        return rc;
+    }
+
+    char prepared_tag_base[TAG_MAX];
+    format_tag(prepared_tag_base, tag_base, "prepared");
+
+    test_opts.prepared = true;
+    rc = run_test(params, test_num, prepared_tag_base);
+    test_opts.prepared = false;
+    if (rc != 0) {
+        return rc;
+    }
+
+    char text_tag[TAG_MAX];
+    char prepared_tag[TAG_MAX];
+    format_tag(text_tag, tag_base, "elapsed");
+    format_tag(prepared_tag, prepared_tag_base, "elapsed");
+
+    double text_elapsed, prepared_elapsed;
+    if (find_extended_result(text_tag, &text_elapsed)
+            && find_extended_result(prepared_tag, &prepared_elapsed)) {
+        report_extended_result(tag_base, "parse_overhead", text_elapsed - prepared_elapsed, "s");
+    }
+
+    return rc;
+}
+
+// true for the test cases running read-only queries against a populated database
+static bool is_read_case(int test_num)
+{
+    return test_num == 4 || test_num == 5 || test_num == 7;
+}
+
+// runs read cases once per mmap window, cold and warm, when '-mmap-sweep' is given
+static int exec_mmap_sweep(test_execution_params* params, int test_num, const char *tag_base)
+{
+    static const struct {
+        const char *tag;
+        double fraction;
+    } windows[] = {
+        { "mmap_off", 0 },
+        { "mmap_partial", 0.25 },
+        { "mmap_full", 1 },
+    };
+
+    if (!params->mmap_sweep || !is_read_case(test_num)) {
+        return exec_case(params, test_num, tag_base);
+    }
+
+    int rc = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+        char window_tag_base[TAG_MAX];
+        format_tag(window_tag_base, tag_base, windows[i].tag);
+
+        test_opts.cold = true;
+        test_opts.mmap_fraction = windows[i].fraction;
+        int window_rc = exec_case(params, test_num, window_tag_base);
+        test_opts.cold = params->cold;
+        test_opts.mmap_fraction = -1;
+
+        if (window_rc != 0 && rc == 0) {
+            rc = window_rc;
+        }
+    }
+
+    return rc;
+}
+
+// runs the test once per page cache size when '-memory-sweep' is given
+static int exec_memory_sweep(test_execution_params* params, int test_num, const char *tag_base)
+{
+    if (!params->memory_sweep) {
+        return exec_mmap_sweep(params, test_num, tag_base);
+    }
+
+    long fit_kib = (long)case_rows(params, test_num, BASE_TABLE_SIZE) * DB_BYTES_PER_ROW / 1024;
+    const char *cache_size = test_opts.db.cache_size;
+    int rc = 0;
+    long kib;
+
+    for (kib = MEMORY_SWEEP_MIN_KIB; ; kib *= 2) {
+        memory_config config = params->memory;
+        config.pagecache_bytes = kib * 1024;
+        config.page_size = test_opts.db.page_size ? atoi(test_opts.db.page_size) : 4096;
+        if (!memory_configure(&config)) {
+            rc = -1;
+            break;
+        }
+
+        // negative cache_size is in KiB
+        char step_cache_size[32];
+        snprintf(step_cache_size, sizeof(step_cache_size), "-%ld", kib);
+        test_opts.db.cache_size = step_cache_size;
+
+        char step[32];
+        char step_tag_base[TAG_MAX];
+        snprintf(step, sizeof(step), "cache_%ldk", kib);
+        format_tag(step_tag_base, tag_base, step);
+
+        int step_rc = exec_mmap_sweep(params, test_num, step_tag_base);
+        report_memory_usage(step_tag_base);
+        if (step_rc != 0 && rc == 0) {
+            rc = step_rc;
+        }
+
+        if (kib >= fit_kib) {
+            break;
+        }
+    }
+
+    test_opts.db.cache_size = cache_size;
+    if (!memory_configure(&params->memory) && rc == 0) {
+        rc = -1;
+    }
+
+    return rc;
+}
+
+// runs the test once per allocator when more than one is given with '-allocator'
+static int exec_allocators(test_execution_params* params, int test_num, const char *tag_base)
+{
+    if (params->n_allocators < 2) {
+        return exec_memory_sweep(params, test_num, tag_base);
+    }
+
+    allocator configured = params->memory.allocator;
+    int rc = 0;
+    int i;
+
+    for (i = 0; i < params->n_allocators; ++i) {
+        params->memory.allocator = params->allocators[i];
+
+        char allocator_tag_base[TAG_MAX];
+        format_tag(allocator_tag_base, tag_base, allocator_names[params->allocators[i]]);
+
+        // the sweep reconfigures memory on its own
+        if (!params->memory_sweep && !memory_configure(&params->memory)) {
+            rc = rc ? rc : -1;
+            continue;
+        }
+
+        int allocator_rc = exec_memory_sweep(params, test_num, allocator_tag_base);
+        if (!params->memory_sweep) {
+            report_memory_usage(allocator_tag_base);
+        }
+        if (allocator_rc != 0 && rc == 0) {
+            rc = allocator_rc;
+        }
+    }
+
+    params->memory.allocator = configured;
+    if (!memory_configure(&params->memory) && rc == 0) {
+        rc = -1;
+    }
+
+    return rc;
+}
+
+// runs the test once in each configuration given with '-matrix'
+static int exec_iteration(test_execution_params* params, int test_num)
+{
+    const char *case_name = test_cases[test_num - 1].case_name;
+    int rc = 0;
+    int i;
+
+    if (params->has_seed) {
+        srandom(params->seed);
+    }
+
+    if (params->n_matrix == 0) {
+        return exec_allocators(params, test_num, case_name);
+    }
+
+    // a failing configuration should not hide results of the others
+    for (i = 0; i < params->n_matrix; ++i) {
+        const matrix_entry *m = &params->matrix[i];
+
+        test_opts.db.journal_mode = m->journal_mode;
+        if (m->synchronous[0] != '\0') {
+            test_opts.db.synchronous = m->synchronous;
+        }
+
+        char tag_base[TAG_MAX];
+        format_tag(tag_base, case_name, m->tag);
+
+        int matrix_rc = exec_allocators(params, test_num, tag_base);
+        if (matrix_rc != 0 && rc == 0) {
+            rc = matrix_rc;
+        }
+
+        test_opts.db = params->db;
+    }
+
+    return rc;
+}
+
+typedef struct
+{
+    test_execution_params *params;
+    int test_num;
+} job_context;
+
+static bool format_job_db_file(char *job_db_file, const char *db_file, int slot)
+{
+    int n_written = snprintf(job_db_file, PATH_MAX, "%s.job%d", db_file, slot);
+    if (n_written >= PATH_MAX) {
+        BLTS_ERROR("%s: PATH_MAX exceeded\n", db_file);
+        return false;
+    }
+
+    return true;
+}
+
+// runs an iteration in a child process of -jobs, on a database file of its own
+static int exec_job(void *ctx, int run, int slot)
+{
+    job_context *job = ctx;
+    char *db_file = job->params->db_file;
+    (void)run;
+
+    if (!db_is_in_memory(db_file)) {
+        char job_db_file[PATH_MAX];
+        if (!format_job_db_file(job_db_file, db_file, slot)) {
+            return -1;
+        }
+        snprintf(db_file, PATH_MAX, "%s", job_db_file);
+    }
+
+    int rc = exec_iteration(job->params, job->test_num);
+    fixture_cache_clear();
+
+    return rc;
+}
+
+static void remove_job_files(const test_execution_params *params)
+{
+    int slot;
+
+    for (slot = 0; !db_is_in_memory(params->db_file) && slot < params->jobs; ++slot) {
+        char job_db_file[PATH_MAX];
+        if (format_job_db_file(job_db_file, params->db_file, slot)) {
+            db_remove(job_db_file);
+        }
+    }
+}
+
+static int exec_test(void* user_ptr, int test_num)
+{
+    srand(time(NULL));
+
+    test_execution_params* params = user_ptr;
+    int n_regressions = baseline_regressions();
+    bool parallel = params->jobs > 1 && params->iterations > 1;
+    jobs_stats jobs = { 0 };
+    int rc = 0;
+    int i;
+
+    if (params->iterations == 1 && params->warmup == 0) {
+        rc = exec_iteration(params, test_num);
+        goto check_baseline;
+    }
+
+    begin_collecting_results();
+
+    for (i = 0; i < params->warmup; ++i) {
+        rc = exec_iteration(params, test_num);
+        discard_collected_results();
+        if (rc != 0) {
+            goto done;
+        }
+    }
+
+    if (parallel) {
+        job_context ctx = { params, test_num };
+        rc = jobs_run(params->jobs, params->iterations, exec_job, &ctx, &jobs);
+        remove_job_files(params);
+        goto done;
+    }
+
+    for (i = 0; i < params->iterations; ++i) {
+        rc = exec_iteration(params, test_num);
+        if (rc != 0) {
+            BLTS_ERROR("Iteration %d of %d failed\n", i + 1, params->iterations);
+            goto done;
+        }
+    }
+
+done:
+    if (parallel && rc == 0 && jobs_interference(&jobs) > params->regression_threshold) {
+        BLTS_ERROR("%s: Runs done in parallel took %.0f%% longer than the one done alone, their "
+                "results are likely affected by interference\n",
+                test_cases[test_num - 1].case_name, jobs_interference(&jobs));
+
+        // timings skewed by the runs slowing each other down are not fit for comparison either
+        if (params->jobs_max_interference > 0
+                && jobs_interference(&jobs) > params->jobs_max_interference) {
+            rc = -1;
+        }
+    }
+
+    // results of partial runs are still reported, but not summarized
+    end_collecting_results(rc == 0);
+    if (parallel) {
+        report_jobs(test_cases[test_num - 1].case_name, &jobs);
+    }
+
+check_baseline:
+    if (rc == 0 && baseline_regressions() > n_regressions) {
+        BLTS_ERROR("%s: Performance regressed against baseline\n",
+                test_cases[test_num - 1].case_name);
+        rc = -1;
+    }
+
+    return rc;
+}
+
 static blts_cli cli =
 {
     .test_cases = test_cases,
@@ -187,7 +1424,55 @@ static blts_cli cli =
     .blts_cli_teardown = teardown
 };
 
+// adds a test case for each '-script', before blts_cli_main() looks up the cases to run
+static bool register_scripts(int argc, char **argv)
+{
+    int n_cases = BUILTIN_CASES;
+    int i, j;
+
+    memcpy(test_cases, builtin_test_cases, sizeof(builtin_test_cases));
+
+    for (i = 1; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "-script") != 0) {
+            continue;
+        }
+
+        if (n_scripts == SCRIPTS_MAX) {
+            BLTS_ERROR("%s: Too many scripts\n", argv[i + 1]);
+            return false;
+        }
+
+        workload_script *script = script_load(argv[++i]);
+        if (script == NULL) {
+            return false;
+        }
+        scripts[n_scripts++] = script;
+
+        for (j = 0; j < n_cases; ++j) {
+            if (strcmp(test_cases[j].case_name, script->name) == 0) {
+                BLTS_ERROR("%s: Test case '%s' already exists\n", script->path, script->name);
+                return false;
+            }
+        }
+
+        test_cases[n_cases++] = (blts_cli_testcase){ script->name, exec_test, SCRIPT_TIMEOUT };
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
-    return blts_cli_main(&cli, argc, argv);
+    int rc = EXIT_FAILURE;
+    int i;
+
+    if (register_scripts(argc, argv)) {
+        rc = blts_cli_main(&cli, argc, argv);
+    }
+
+    for (i = 0; i < n_scripts; ++i) {
+        script_destroy(scripts[i]);
+    }
+
+    return rc;
 }
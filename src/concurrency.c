@@ -0,0 +1,636 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Concurrency engine: reader threads run the test_select() query mix while writer threads run
+ * short insert/update transactions, each thread on its own connection to the same database. All
+ * threads are released at once by a start gate (a barrier that can also be cancelled) so the
+ * measured interval covers only the concurrent part. By default SQLITE_BUSY is not hidden behind
+ * a busy handler: it is counted and the statement is retried after a short delay. With
+ * test_opts.busy_timeout a busy handler waits for the lock within sqlite instead, counting the
+ * operations it waited in. Either way the time spent waiting is reported as lock_wait and is
+ * part of the operation latency, and a statement still locked out after the busy timeout (or
+ * DEFAULT_RETRY_TIMEOUT_MS) fails the worker.
+ * With test_opts.duration each thread keeps running operations until the time is up.
+ *
+ * In the multi-process variant the workers are forked processes instead, sharing the start gate,
+ * their results and histograms through an anonymous shared mapping. That exercises the POSIX
+ * advisory locks and the shared-memory WAL index the way separate applications on one database
+ * do; it requires a file-backed database and is skipped on in-memory ones.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+
+enum {
+    BUSY_RETRY_DELAY_US = 100,
+    // how long a statement is retried for when test_opts.busy_timeout is not set
+    DEFAULT_RETRY_TIMEOUT_MS = 30000,
+    WRITER_TRANSACTION_ROWS = 10,
+};
+
+// ':memory:' would give each connection a private database, use a shared in-memory one instead
+static const char *const SHARED_MEMORY_DB_FILE = "file:/blts-sqlite-perf-concurrent?vfs=memdb";
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int n_waiting;
+    bool open;
+    bool cancelled;
+} start_gate;
+
+typedef struct {
+    // input
+    int index;
+    bool writer;
+    const char *db_file;
+    int table_size;
+    int n_ops;
+    start_gate *gate;
+    row_generator *rows;
+
+    // output
+    bool ok;
+    long n_busy;
+    long n_locked;
+    // time spent between a statement first failing with SQLITE_BUSY/SQLITE_LOCKED and completing,
+    // or sleeping in the busy handler
+    uint64_t lock_wait_ns;
+    double elapsed;
+    histogram *latencies;
+} worker;
+
+static double now_seconds(void)
+{
+    return histogram_now() / 1e9;
+}
+
+// a shared gate can be passed by forked processes when it lives in shared memory
+static void gate_init(start_gate *gate, bool shared)
+{
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t cond_attr;
+
+    memset(gate, 0, sizeof(start_gate));
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_condattr_init(&cond_attr);
+    if (shared) {
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    }
+    pthread_mutex_init(&gate->mutex, &mutex_attr);
+    pthread_cond_init(&gate->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+}
+
+static void gate_destroy(start_gate *gate)
+{
+    pthread_cond_destroy(&gate->cond);
+    pthread_mutex_destroy(&gate->mutex);
+}
+
+// blocks until the gate is opened, returns false if it was cancelled instead
+static bool gate_pass(start_gate *gate)
+{
+    pthread_mutex_lock(&gate->mutex);
+    ++gate->n_waiting;
+    pthread_cond_broadcast(&gate->cond);
+    while (!gate->open) {
+        pthread_cond_wait(&gate->cond, &gate->mutex);
+    }
+    bool cancelled = gate->cancelled;
+    pthread_mutex_unlock(&gate->mutex);
+
+    return !cancelled;
+}
+
+// waits for n_threads to arrive at the gate and releases them all at once
+static void gate_open(start_gate *gate, int n_threads, bool cancel)
+{
+    pthread_mutex_lock(&gate->mutex);
+    while (gate->n_waiting < n_threads) {
+        pthread_cond_wait(&gate->cond, &gate->mutex);
+    }
+    gate->open = true;
+    gate->cancelled = cancel;
+    pthread_cond_broadcast(&gate->cond);
+    pthread_mutex_unlock(&gate->mutex);
+}
+
+// executes stmt, or sql if stmt is NULL, retrying while the database is locked for up to
+// test_opts.busy_timeout (DEFAULT_RETRY_TIMEOUT_MS when not set)
+static bool exec_retry(worker *w, sqlite3 *db, sqlite3_stmt *stmt, const char *sql)
+{
+    int rc;
+    uint64_t busy_start = 0;
+    uint64_t timeout_ns = (test_opts.busy_timeout > 0 ? test_opts.busy_timeout
+            : DEFAULT_RETRY_TIMEOUT_MS) * 1000000ULL;
+
+    for (;;) {
+        if (stmt != NULL) {
+            do {
+                rc = sqlite3_step(stmt);
+            } while (rc == SQLITE_ROW);
+            sqlite3_reset(stmt);
+        } else {
+            rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        }
+
+        if (rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+            break;
+        }
+
+        if (busy_start == 0) {
+            busy_start = histogram_now();
+        } else if (histogram_now() - busy_start >= timeout_ns) {
+            break;
+        }
+        ++*(rc == SQLITE_BUSY ? &w->n_busy : &w->n_locked);
+        usleep(BUSY_RETRY_DELAY_US);
+    }
+
+    if (busy_start != 0) {
+        w->lock_wait_ns += histogram_now() - busy_start;
+    }
+
+    if (rc != SQLITE_DONE && rc != SQLITE_OK) {
+        BLTS_ERROR("%s: %s %d: \"%s\" failed: %s\n", __FUNCTION__, w->writer ? "writer" : "reader",
+                w->index, stmt != NULL ? sqlite3_sql(stmt) : sql, sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+// with test_opts.busy_timeout, waits for locks within sqlite the way sqlite3_busy_timeout() does
+static int busy_handler(void *arg, int n_calls)
+{
+    worker *w = arg;
+
+    if (n_calls == 0) {
+        ++w->n_busy;
+    }
+    if ((long)n_calls * BUSY_RETRY_DELAY_US >= test_opts.busy_timeout * 1000L) {
+        return 0;
+    }
+
+    uint64_t start = histogram_now();
+    usleep(BUSY_RETRY_DELAY_US);
+    w->lock_wait_ns += histogram_now() - start;
+
+    return 1;
+}
+
+static bool reader_op(worker *w, sqlite3 *db, sqlite3_stmt *select, int op)
+{
+    int low = (((long long)w->index * w->n_ops + op) * 100) % 1000000;
+
+    if (test_opts.prepared) {
+        sqlite3_bind_int(select, 1, low);
+        sqlite3_bind_int(select, 2, low + 1000);
+        return exec_retry(w, db, select, NULL);
+    }
+
+    char sql[SQL_MAX];
+    sql_sprintf(sql, "SELECT count(*), avg(b) FROM t1 WHERE b >= %d AND b < %d;", low, low + 1000);
+    return exec_retry(w, db, NULL, sql);
+}
+
+static void format_insert(char *sql, int index, const test_data_row *row)
+{
+    sql_sprintf(sql, "INSERT INTO t1 VALUES(%d, %d, '%s');", index, row->number, row->string);
+}
+
+static bool writer_op(worker *w, sqlite3 *db, sqlite3_stmt *insert, sqlite3_stmt *update)
+{
+    char sql[SQL_MAX];
+    int i;
+
+    if (!exec_retry(w, db, NULL, "BEGIN IMMEDIATE")) {
+        return false;
+    }
+
+    int low = 0;
+    for (i = 0; i < WRITER_TRANSACTION_ROWS; ++i) {
+        const generated_row *row = row_generator_next(w->rows);
+        low = (row->row.number % w->table_size) / 10 * 10;
+
+        if (test_opts.prepared) {
+            sqlite3_bind_int(insert, 1, row->index);
+            sqlite3_bind_int(insert, 2, row->row.number);
+            sqlite3_bind_text(insert, 3, row->row.string, -1, SQLITE_STATIC);
+            if (!exec_retry(w, db, insert, NULL)) {
+                goto fail;
+            }
+        } else if (!exec_retry(w, db, NULL, row->sql)) {
+            goto fail;
+        }
+    }
+
+    if (test_opts.prepared) {
+        sqlite3_bind_int(update, 1, low);
+        sqlite3_bind_int(update, 2, low + 10);
+        if (!exec_retry(w, db, update, NULL)) {
+            goto fail;
+        }
+    } else {
+        sql_sprintf(sql, "UPDATE t1 SET b=b*2 WHERE a >= %d AND a < %d;", low, low + 10);
+        if (!exec_retry(w, db, NULL, sql)) {
+            goto fail;
+        }
+    }
+
+    return exec_retry(w, db, NULL, "COMMIT");
+
+fail:
+    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    return false;
+}
+
+static void *worker_main(void *arg)
+{
+    worker *w = arg;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *select = NULL;
+    sqlite3_stmt *insert = NULL;
+    sqlite3_stmt *update = NULL;
+    int i;
+
+    // all threads must reach the gate even on failure, or it would never open
+    bool ready = db_open(&db, w->db_file);
+    if (ready && test_opts.busy_timeout > 0) {
+        sqlite3_busy_handler(db, busy_handler, w);
+    }
+    if (ready && test_opts.prepared) {
+        ready = w->writer
+            ? db_prepare(db, &insert, "INSERT INTO t1 VALUES(?1, ?2, ?3);")
+                && db_prepare(db, &update, "UPDATE t1 SET b=b*2 WHERE a >= ?1 AND a < ?2;")
+            : db_prepare(db, &select, "SELECT count(*), avg(b) FROM t1 WHERE b >= ?1 AND b < ?2;");
+    }
+
+    if (!gate_pass(w->gate) || !ready) {
+        goto fail;
+    }
+
+    double start = now_seconds();
+    double deadline = start + test_opts.duration;
+
+    // time spent generating test data is excluded from both latencies and elapsed time
+    for (i = 0; test_opts.duration > 0 ? now_seconds() < deadline : i < w->n_ops; ++i) {
+        uint64_t op_start = histogram_now();
+        uint64_t overhead_start = w->rows != NULL ? w->rows->overhead_ns : 0;
+        bool op_ok = w->writer
+            ? writer_op(w, db, insert, update)
+            : reader_op(w, db, select, i);
+        uint64_t overhead = w->rows != NULL ? w->rows->overhead_ns - overhead_start : 0;
+        histogram_record(w->latencies, histogram_now() - op_start - overhead);
+
+        if (!op_ok) {
+            goto fail;
+        }
+    }
+
+    w->elapsed = now_seconds() - start - row_generator_overhead(w->rows);
+    w->ok = true;
+
+fail:
+    sqlite3_finalize(select);
+    sqlite3_finalize(insert);
+    sqlite3_finalize(update);
+    db_close(db);
+
+    return NULL;
+}
+
+// reports each worker and the aggregate over all of them, the latter over the time span it took
+// the slowest worker to complete
+static void report_workers(const char *tag_base, const char *role, worker *workers, int n_workers)
+{
+    char tag[TAG_MAX];
+    char name[64];
+    int i;
+
+    if (n_workers == 0) {
+        return;
+    }
+
+    histogram *all = histogram_create();
+    long n_busy = 0;
+    long n_locked = 0;
+    uint64_t lock_wait_ns = 0;
+    double elapsed = 0;
+
+    if (all == NULL) {
+        return;
+    }
+
+    for (i = 0; i < n_workers; ++i) {
+        snprintf(name, sizeof(name), "%s%d", role, i);
+        format_tag(tag, tag_base, name);
+        report_latencies(tag, workers[i].latencies, workers[i].elapsed);
+        report_extended_result(tag, "busy", workers[i].n_busy, "");
+        report_extended_result(tag, "locked", workers[i].n_locked, "");
+        report_extended_result(tag, "lock_wait", workers[i].lock_wait_ns / 1e9, "s");
+
+        histogram_merge(all, workers[i].latencies);
+        n_busy += workers[i].n_busy;
+        n_locked += workers[i].n_locked;
+        lock_wait_ns += workers[i].lock_wait_ns;
+        if (workers[i].elapsed > elapsed) {
+            elapsed = workers[i].elapsed;
+        }
+    }
+
+    snprintf(name, sizeof(name), "%ss", role);
+    format_tag(tag, tag_base, name);
+    report_latencies(tag, all, elapsed);
+    report_extended_result(tag, "busy", n_busy, "");
+    report_extended_result(tag, "locked", n_locked, "");
+    report_extended_result(tag, "lock_wait", lock_wait_ns / 1e9, "s");
+    if (elapsed > 0) {
+        report_extended_result(tag, "busy_per_sec", n_busy / elapsed, "1/s");
+        report_extended_result(tag, "locked_per_sec", n_locked / elapsed, "1/s");
+    }
+
+    histogram_destroy(all);
+}
+
+// allocates shared memory when the workers are processes, unlike malloc() visible to all of them
+static void *workers_alloc(size_t size, bool shared)
+{
+    if (!shared) {
+        return calloc(1, size);
+    }
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p != MAP_FAILED ? p : NULL;
+}
+
+static void workers_free(void *p, size_t size, bool shared)
+{
+    if (!shared) {
+        free(p);
+    } else if (p != NULL) {
+        munmap(p, size);
+    }
+}
+
+// runs the workers in threads or in forked processes, returns the number started
+static int start_workers(worker *workers, int n_workers, bool processes, pthread_t *threads,
+        pid_t *pids)
+{
+    int n_started;
+
+    for (n_started = 0; n_started < n_workers; ++n_started) {
+        if (processes) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                worker_main(&workers[n_started]);
+                _exit(EXIT_SUCCESS);
+            } else if (pid < 0) {
+                BLTS_ERROR("%s: fork() failed: %s\n", __FUNCTION__, strerror(errno));
+                break;
+            }
+            pids[n_started] = pid;
+        } else {
+            int rc = pthread_create(&threads[n_started], NULL, worker_main, &workers[n_started]);
+            if (rc != 0) {
+                BLTS_ERROR("%s: pthread_create() failed: %s\n", __FUNCTION__, strerror(rc));
+                break;
+            }
+        }
+    }
+
+    return n_started;
+}
+
+static void join_workers(int n_started, bool processes, pthread_t *threads, pid_t *pids)
+{
+    int i;
+
+    for (i = 0; i < n_started; ++i) {
+        if (processes) {
+            waitpid(pids[i], NULL, 0);
+        } else {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static int run_workers(const char *tag_base, const char *db_file, int table_size, int n_readers,
+        int n_writers, int n_selects, int n_transactions, bool processes)
+{
+    BLTS_DEBUG("START %s(table_size=%d, n_readers=%d, n_writers=%d, n_selects=%d, "
+            "n_transactions=%d, processes=%d)\n", __FUNCTION__, table_size, n_readers, n_writers,
+            n_selects, n_transactions, processes);
+
+    int retv = EXIT_FAILURE;
+    int i;
+    sqlite3 *db = NULL;
+    int n_workers = n_readers + n_writers;
+    int n_started = 0;
+    bool gate_ready = false;
+
+    if (strcmp(db_file, ":memory:") == 0) {
+        db_file = SHARED_MEMORY_DB_FILE;
+    }
+
+    size_t workers_size = n_workers * sizeof(worker);
+    size_t histograms_size = n_workers * sizeof(histogram);
+    worker *workers = workers_alloc(workers_size, processes);
+    histogram *histograms = workers_alloc(histograms_size, processes);
+    start_gate *gate = workers_alloc(sizeof(start_gate), processes);
+    pthread_t *threads = calloc(n_workers, sizeof(pthread_t));
+    pid_t *pids = calloc(n_workers, sizeof(pid_t));
+
+    if (workers == NULL || histograms == NULL || gate == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        goto fail;
+    }
+
+    gate_init(gate, processes);
+    gate_ready = true;
+
+    if (processes && db_is_in_memory(db_file)) {
+        BLTS_ERROR("%s: Processes require a file-backed database\n", __FUNCTION__);
+        goto fail;
+    }
+
+    for (i = 0; i < n_workers; ++i) {
+        worker *w = &workers[i];
+        w->writer = i >= n_readers;
+        w->index = w->writer ? i - n_readers : i;
+        w->db_file = db_file;
+        w->table_size = table_size;
+        w->n_ops = w->writer ? n_transactions : n_selects;
+        w->gate = gate;
+        w->latencies = &histograms[i];
+        histogram_reset(w->latencies);
+        if (w->writer) {
+            // keep keys of rows inserted by different writers distinct
+            int n_rows = test_opts.duration > 0 ? (INT_MAX - table_size) / n_writers
+                : n_transactions * WRITER_TRANSACTION_ROWS;
+            w->rows = row_generator_create(table_size + w->index * n_rows, n_rows,
+                    test_opts.prepared ? NULL : format_insert);
+            if (w->rows == NULL) {
+                goto fail;
+            }
+        }
+    }
+
+    // this connection also keeps the shared in-memory database alive
+    if (!db_open_truncate(&db, db_file)) {
+        goto fail;
+    }
+
+    if (!db_create_table(db, "t1", table_size)) {
+        goto fail;
+    }
+
+    if (!db_create_index(db, "i1 on t1(b)")) {
+        goto fail;
+    }
+
+    // a forked child must not inherit open connections, sqlite keeps per-process lock state
+    if (processes) {
+        db_close(db);
+        db = NULL;
+    }
+
+    n_started = start_workers(workers, n_workers, processes, threads, pids);
+
+    // I/O of child processes is not visible to this one
+    if (!processes) {
+        io_accounting_start();
+    }
+    gate_open(gate, n_started, n_started < n_workers);
+
+    double start = now_seconds();
+
+    join_workers(n_started, processes, threads, pids);
+
+    double elapsed = now_seconds() - start;
+    if (!processes) {
+        io_accounting_stop();
+    }
+
+    if (n_started < n_workers) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_workers; ++i) {
+        if (!workers[i].ok) {
+            goto fail;
+        }
+    }
+
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    if (!processes) {
+        report_io_accounting(tag_base);
+    }
+    report_workers(tag_base, "reader", workers, n_readers);
+    report_workers(tag_base, "writer", &workers[n_readers], n_writers);
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    db_close(db);
+    if (workers != NULL) {
+        for (i = 0; i < n_workers; ++i) {
+            row_generator_destroy(workers[i].rows);
+        }
+    }
+    if (gate_ready) {
+        gate_destroy(gate);
+    }
+    workers_free(gate, sizeof(start_gate), processes);
+    workers_free(histograms, histograms_size, processes);
+    workers_free(workers, workers_size, processes);
+    free(pids);
+    free(threads);
+
+    return retv;
+}
+
+int test_concurrent(const char *tag_base, const char *db_file, int table_size, int n_readers,
+        int n_writers, int n_selects, int n_transactions)
+{
+    return run_workers(tag_base, db_file, table_size, n_readers, n_writers, n_selects,
+            n_transactions, false);
+}
+
+int test_multiprocess(const char *tag_base, const char *db_file, int table_size,
+        const int *process_counts, int n_process_counts, int n_readers, int n_writers,
+        int n_selects, int n_transactions)
+{
+    int retv = EXIT_SUCCESS;
+    int i;
+
+    // each connection to an in-memory database is a database of its own
+    if (db_is_in_memory(db_file)) {
+        BLTS_DEBUG("%s: Processes require a file-backed database, skipped\n", __FUNCTION__);
+        return EXIT_SUCCESS;
+    }
+
+    // each step splits its processes between the roles in the proportion of n_readers:n_writers
+    for (i = 0; i < n_process_counts; ++i) {
+        int n_processes = process_counts[i];
+        int step_writers = n_readers + n_writers > 0
+            ? (n_processes * n_writers * 2 + n_readers + n_writers) / ((n_readers + n_writers) * 2)
+            : 0;
+        if (step_writers == 0 && n_writers > 0) {
+            step_writers = 1;
+        }
+        if (step_writers > n_processes) {
+            step_writers = n_processes;
+        }
+
+        char step_tag[32];
+        char step_tag_base[TAG_MAX];
+        snprintf(step_tag, sizeof(step_tag), "processes_%d", n_processes);
+        format_tag(step_tag_base, tag_base, step_tag);
+
+        if (run_workers(step_tag_base, db_file, table_size, n_processes - step_writers,
+                    step_writers, n_selects, n_transactions, true) != EXIT_SUCCESS) {
+            retv = EXIT_FAILURE;
+        }
+    }
+
+    return retv;
+}
@@ -0,0 +1,501 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Utilities shared by all test families, see db.h.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <blts_log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "report.h"
+
+// set by db_reopen_cold(), the first timed statement after it is reported as '<tag>.first_row'
+static bool first_row_armed = false;
+static uint64_t first_row_ns = 0;
+
+void sql_sprintf(char *str, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int n_written = vsnprintf(str, SQL_MAX, format, ap);
+    va_end(ap);
+    assert(n_written < SQL_MAX);
+}
+
+// applies test_opts.db, page_size goes first as it must be set before the database is written
+bool db_configure_(sqlite3 *db, caller_info caller)
+{
+    const db_config *config = &test_opts.db;
+    const struct {
+        const char *name;
+        const char *value;
+    } pragmas[] = {
+        { "page_size", config->page_size },
+        { "journal_mode", config->journal_mode },
+        { "synchronous", config->synchronous },
+        { "cache_size", config->cache_size },
+        { "mmap_size", config->mmap_size },
+        { "temp_store", config->temp_store },
+        { "locking_mode", config->locking_mode },
+    };
+
+    unsigned i;
+    for (i = 0; i < sizeof(pragmas) / sizeof(pragmas[0]); ++i) {
+        if (pragmas[i].value == NULL) {
+            continue;
+        }
+
+        char sql[SQL_MAX];
+        sql_sprintf(sql, "PRAGMA %s=%s;", pragmas[i].name, pragmas[i].value);
+
+        sqlite3_stmt *stmt = NULL;
+        if (!db_prepare_(db, &stmt, sql, caller)) {
+            return false;
+        }
+
+        int rc = sqlite3_step(stmt);
+
+        // sqlite silently keeps the old journal mode if the requested one is not possible here
+        bool refused = rc == SQLITE_ROW && strcmp(pragmas[i].name, "journal_mode") == 0
+            && strcasecmp((const char *)sqlite3_column_text(stmt, 0), pragmas[i].value) != 0;
+        if (refused) {
+            BLTS_ERROR("%s:%d: %s: \"%s\" refused, journal mode is '%s'\n", caller.file,
+                    caller.file_line, caller.function, sql, sqlite3_column_text(stmt, 0));
+        } else if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            BLTS_ERROR("%s:%d: %s: sqlite3_step(\"%s\") failed: %s\n", caller.file,
+                    caller.file_line, caller.function, sql, sqlite3_errstr(rc));
+        }
+
+        sqlite3_finalize(stmt);
+
+        if (refused || (rc != SQLITE_ROW && rc != SQLITE_DONE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool db_open_flags_(sqlite3 **db, const char *db_file, int flags, caller_info caller)
+{
+    int rc;
+
+    rc = sqlite3_open_v2(db_file, db, flags | SQLITE_OPEN_URI, 0);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_open_v2(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, db_file, sqlite3_errstr(rc));
+        return false;
+    }
+
+    return db_configure_(*db, caller);
+}
+
+bool db_remove_(const char *db_file, caller_info caller)
+{
+    static const char *const suffixes[] = { "", "-journal", "-wal", "-shm" };
+    int rc;
+
+    unsigned i;
+    for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s%s", db_file, suffixes[i]);
+
+        if (access(path, F_OK) == 0) {
+            rc = unlink(path);
+            if (rc != 0) {
+                BLTS_ERROR("%s:%d: %s: unlink(\"%s\") failed: %s\n", caller.file,
+                        caller.file_line, caller.function, path, strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool db_open_truncate_(sqlite3 **db, const char *db_file, caller_info caller)
+{
+    // stale journal or WAL files left behind would otherwise be applied to the new database
+    if (!db_remove_(db_file, caller)) {
+        return false;
+    }
+
+    return db_open_flags_(db, db_file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, caller);
+}
+
+bool db_open_(sqlite3 **db, const char *db_file, caller_info caller)
+{
+    return db_open_flags_(db, db_file, SQLITE_OPEN_READWRITE, caller);
+}
+
+bool db_is_in_memory(const char *db_file)
+{
+    return strcmp(db_file, ":memory:") == 0 || strstr(db_file, "vfs=memdb") != NULL;
+}
+
+bool db_evict_cache_(const char *db_file, caller_info caller)
+{
+    static const char *const suffixes[] = { "", "-journal", "-wal" };
+
+    unsigned i;
+    for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s%s", db_file, suffixes[i]);
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT && i > 0) {
+                continue;
+            }
+            BLTS_ERROR("%s:%d: %s: open(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                    caller.function, path, strerror(errno));
+            return false;
+        }
+
+        // dirty pages are not dropped
+        int rc = fdatasync(fd);
+        if (rc == 0) {
+            rc = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        } else {
+            rc = errno;
+        }
+        close(fd);
+
+        if (rc != 0) {
+            BLTS_ERROR("%s:%d: %s: evicting \"%s\" failed: %s\n", caller.file, caller.file_line,
+                    caller.function, path, strerror(rc));
+            return false;
+        }
+    }
+
+    // posix_fadvise() is only a hint, when privileged drop clean caches of the whole system too
+    if (geteuid() == 0) {
+        sync();
+        FILE *drop_caches = fopen("/proc/sys/vm/drop_caches", "w");
+        if (drop_caches != NULL) {
+            fputs("1", drop_caches);
+            fclose(drop_caches);
+        }
+    }
+
+    return true;
+}
+
+bool db_reopen_cold_(sqlite3 **db, const char *db_file, const char *tag_base,
+        caller_info caller)
+{
+    if (db_is_in_memory(db_file)) {
+        return true;
+    }
+
+    db_close_(*db, caller);
+    *db = NULL;
+
+    if (!db_evict_cache_(db_file, caller)) {
+        return false;
+    }
+
+    uint64_t start = histogram_now();
+    if (!db_open_(db, db_file, caller)) {
+        return false;
+    }
+    uint64_t opened = histogram_now();
+
+    // the schema is read on first use
+    if (!db_exec_(*db, "SELECT count(*) FROM sqlite_master;", caller)) {
+        return false;
+    }
+    uint64_t schema_read = histogram_now();
+
+    report_extended_result(tag_base, "open_time", (opened - start) / 1e9, "s");
+    report_extended_result(tag_base, "schema_time", (schema_read - opened) / 1e9, "s");
+
+    first_row_armed = true;
+    first_row_ns = 0;
+
+    if (test_opts.mmap_fraction < 0) {
+        return true;
+    }
+
+    struct stat st;
+    if (stat(db_file, &st) != 0) {
+        BLTS_ERROR("%s:%d: %s: stat(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, db_file, strerror(errno));
+        return false;
+    }
+
+    char sql[SQL_MAX];
+    sql_sprintf(sql, "PRAGMA mmap_size=%lld;", (long long)(st.st_size * test_opts.mmap_fraction));
+
+    return db_exec_(*db, sql, caller);
+}
+
+void db_close_(sqlite3 *db, caller_info caller)
+{
+    int rc;
+
+    rc = sqlite3_close(db);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_close() failed: %s\n", caller.file, caller.file_line,
+                caller.function, sqlite3_errstr(rc));
+    }
+}
+
+bool db_create_table_(sqlite3 *db, const char *name, int n_rows, caller_info caller)
+{
+    bool retv = false;
+    int rc = 0;
+    sqlite3_stmt *stmt = NULL;
+    test_data_row row;
+    uint64_t state = generator_seed();
+
+    char create_table_sql[SQL_MAX];
+    sql_sprintf(create_table_sql, "CREATE TABLE %s (a INTEGER, b INTEGER, c VARCHAR(100));", name);
+    if (!db_exec_(db, create_table_sql, caller)) {
+        goto fail;
+    }
+
+    // create an empty table?
+    if (n_rows != 0) {
+        if (!db_exec_(db, "BEGIN", caller)) {
+            goto fail;
+        }
+
+        char insert_sql[SQL_MAX];
+        sql_sprintf(insert_sql, "INSERT INTO %s VALUES(?1, ?2, ?3);", name);
+        rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
+        if (rc != SQLITE_OK) {
+            BLTS_ERROR("%s:%d: %s: sqlite3_prepare(\"%s\") failed: %s\n", caller.file,
+                    caller.file_line, caller.function, insert_sql, sqlite3_errstr(rc));
+            goto fail;
+        }
+
+        // rows are generated one at a time so that tables larger than memory can be populated
+        int i;
+        for (i = 0; i < n_rows; ++i) {
+            generate_test_row(&row, &state);
+
+            sqlite3_bind_int(stmt, 1, i);
+            sqlite3_bind_int(stmt, 2, row.number);
+            sqlite3_bind_text(stmt, 3, row.string, -1, SQLITE_STATIC);
+
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                BLTS_ERROR("%s:%d: %s: sqlite3_step(\"%s\") failed: %s\n", caller.file,
+                        caller.file_line, caller.function, insert_sql, sqlite3_errstr(rc));
+                goto fail;
+            }
+        }
+
+        if (!db_exec_(db, "COMMIT", caller)) {
+            goto fail;
+        }
+    }
+
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+bool db_create_index_(sqlite3 *db, const char *spec, caller_info caller)
+{
+    char sql[SQL_MAX];
+    sql_sprintf(sql, "CREATE INDEX %s;", spec);
+
+    return db_exec_(db, sql, caller);
+}
+
+bool db_exec_(sqlite3 *db, const char *sql, caller_info caller)
+{
+    int rc;
+    char *errstr;
+
+    rc = sqlite3_exec(db, sql, NULL, NULL, &errstr);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_exec(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, sql, sqlite3_errstr(rc));
+        sqlite3_free(errstr);
+        return false;
+    }
+
+    return true;
+}
+
+// latency of the first timed statement after db_reopen_cold()
+static void record_first_row(uint64_t latency)
+{
+    if (first_row_armed) {
+        first_row_armed = false;
+        first_row_ns = latency;
+    }
+}
+
+bool db_exec_timed_(sqlite3 *db, const char *sql, histogram *latencies, caller_info caller)
+{
+    uint64_t start = histogram_now();
+    bool retv = db_exec_(db, sql, caller);
+    uint64_t latency = histogram_now() - start;
+    histogram_record(latencies, latency);
+    record_first_row(latency);
+
+    return retv;
+}
+
+bool db_step_reset_timed_(sqlite3_stmt *stmt, histogram *latencies, caller_info caller)
+{
+    uint64_t start = histogram_now();
+    bool retv = db_step_reset_(stmt, caller);
+    uint64_t latency = histogram_now() - start;
+    histogram_record(latencies, latency);
+    record_first_row(latency);
+
+    return retv;
+}
+
+bool db_begin_transaction_(sqlite3 *db, caller_info caller)
+{
+    return db_exec_(db, "BEGIN", caller);
+}
+
+bool db_commit_transaction_(sqlite3 *db, caller_info caller)
+{
+    return db_exec_(db, "COMMIT", caller);
+}
+
+bool db_prepare_(sqlite3 *db, sqlite3_stmt **stmt, const char *sql, caller_info caller)
+{
+    int rc;
+
+    rc = sqlite3_prepare_v2(db, sql, -1, stmt, NULL);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_prepare(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, sql, sqlite3_errstr(rc));
+        return false;
+    }
+
+    return true;
+}
+
+// steps through all result rows like sqlite3_exec() does and resets the statement for reuse
+bool db_step_reset_(sqlite3_stmt *stmt, caller_info caller)
+{
+    int rc;
+
+    do {
+        rc = sqlite3_step(stmt);
+    } while (rc == SQLITE_ROW);
+
+    if (rc != SQLITE_DONE) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_step(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, sqlite3_sql(stmt), sqlite3_errstr(rc));
+        sqlite3_reset(stmt);
+        return false;
+    }
+
+    sqlite3_reset(stmt);
+
+    return true;
+}
+
+static const struct {
+    int op;
+    char *tag;
+    // report the high-water mark instead of the current value
+    bool highwater;
+} db_status_counters[] = {
+    { SQLITE_DBSTATUS_CACHE_HIT, "cache_hit", false },
+    { SQLITE_DBSTATUS_CACHE_MISS, "cache_miss", false },
+    { SQLITE_DBSTATUS_CACHE_WRITE, "cache_write", false },
+    { SQLITE_DBSTATUS_CACHE_SPILL, "cache_spill", false },
+    { SQLITE_DBSTATUS_LOOKASIDE_USED, "lookaside_used", true },
+    { SQLITE_DBSTATUS_SCHEMA_USED, "schema_used", false },
+};
+
+void db_reset_status(sqlite3 *db)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(db_status_counters) / sizeof(db_status_counters[0]); ++i) {
+        int current, highwater;
+        sqlite3_db_status(db, db_status_counters[i].op, &current, &highwater, 1);
+    }
+}
+
+void db_report_status(const char *tag_base, sqlite3 *db)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(db_status_counters) / sizeof(db_status_counters[0]); ++i) {
+        int current, highwater;
+        if (sqlite3_db_status(db, db_status_counters[i].op, &current, &highwater, 0)
+                == SQLITE_OK) {
+            report_extended_result(tag_base, db_status_counters[i].tag,
+                    db_status_counters[i].highwater ? highwater : current, "");
+        }
+    }
+
+    if (first_row_ns != 0) {
+        report_extended_result(tag_base, "first_row", first_row_ns / 1e3, "us");
+        first_row_ns = 0;
+    }
+    first_row_armed = false;
+}
+
+void db_report_stmt_status(const char *tag_base, sqlite3_stmt *stmt)
+{
+    static const struct {
+        int op;
+        char *tag;
+    } counters[] = {
+        { SQLITE_STMTSTATUS_FULLSCAN_STEP, "fullscan_steps" },
+        { SQLITE_STMTSTATUS_SORT, "sorts" },
+        { SQLITE_STMTSTATUS_AUTOINDEX, "autoindexes" },
+        { SQLITE_STMTSTATUS_VM_STEP, "vm_steps" },
+        { SQLITE_STMTSTATUS_REPREPARE, "reprepares" },
+        { SQLITE_STMTSTATUS_MEMUSED, "stmt_memused" },
+    };
+
+    if (stmt == NULL) {
+        return;
+    }
+
+    unsigned i;
+    for (i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+        report_extended_result(tag_base, counters[i].tag,
+                sqlite3_stmt_status(stmt, counters[i].op, 0),
+                counters[i].op == SQLITE_STMTSTATUS_MEMUSED ? "B" : "");
+    }
+}
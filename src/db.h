@@ -0,0 +1,103 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DB_H
+#define DB_H
+
+#include <sqlite3.h>
+#include <stdbool.h>
+
+#include "histogram.h"
+
+enum { SQL_MAX = 256 };
+
+void sql_sprintf(char *str, const char *format, ...);
+
+/*
+ * Logging-friendly encapsulation of common db manipulation routines.
+ */
+
+typedef struct {
+    const char *file;
+    const char *function;
+    int file_line;
+} caller_info;
+#define CALLER_INFO ((caller_info){__FILE__, __FUNCTION__, __LINE__})
+
+#define db_open_truncate(db, db_file) db_open_truncate_(db, db_file, CALLER_INFO)
+#define db_open(db, db_file) db_open_(db, db_file, CALLER_INFO)
+#define db_remove(db_file) db_remove_(db_file, CALLER_INFO)
+#define db_evict_cache(db_file) db_evict_cache_(db_file, CALLER_INFO)
+#define db_reopen_cold(db, db_file, tag_base) db_reopen_cold_(db, db_file, tag_base, CALLER_INFO)
+#define db_close(db) db_close_(db, CALLER_INFO)
+#define db_create_table(db, name, n_rows) db_create_table_(db, name, n_rows, CALLER_INFO)
+#define db_create_index(db, spec) db_create_index_(db, spec, CALLER_INFO)
+#define db_exec(db, sql) db_exec_(db, sql, CALLER_INFO)
+#define db_prepare(db, stmt, sql) db_prepare_(db, stmt, sql, CALLER_INFO)
+#define db_step_reset(stmt) db_step_reset_(stmt, CALLER_INFO)
+#define db_exec_timed(db, sql, latencies) db_exec_timed_(db, sql, latencies, CALLER_INFO)
+#define db_step_reset_timed(stmt, latencies) db_step_reset_timed_(stmt, latencies, CALLER_INFO)
+#define db_begin_transaction(db) db_begin_transaction_(db, CALLER_INFO)
+#define db_commit_transaction(db) db_commit_transaction_(db, CALLER_INFO)
+
+// applies test_opts.db, done by the functions opening databases
+bool db_configure_(sqlite3 *db, caller_info caller);
+bool db_open_truncate_(sqlite3 **db, const char *db_file, caller_info caller);
+// opens an existing database, e.g. to get another connection to it
+bool db_open_(sqlite3 **db, const char *db_file, caller_info caller);
+// true for ':memory:' and memdb VFS URIs
+bool db_is_in_memory(const char *db_file);
+// deletes the database file and its journals, where they exist
+bool db_remove_(const char *db_file, caller_info caller);
+// drops the database and its journals from the OS page cache
+bool db_evict_cache_(const char *db_file, caller_info caller);
+/*
+ * Closes the connection, evicts the database from the OS page cache and opens it again, applying
+ * test_opts.mmap_fraction. The time spent opening and reading the schema is reported as
+ * '<tag_base>.open_time' and '<tag_base>.schema_time', the latency of the first timed statement
+ * that follows as '<tag>.first_row' by db_report_status(). In-memory databases are left as they
+ * are.
+ */
+bool db_reopen_cold_(sqlite3 **db, const char *db_file, const char *tag_base,
+        caller_info caller);
+void db_close_(sqlite3 *db, caller_info caller);
+bool db_create_table_(sqlite3 *db, const char *name, int n_rows, caller_info caller);
+bool db_create_index_(sqlite3 *db, const char *spec, caller_info caller);
+bool db_exec_(sqlite3 *db, const char *sql, caller_info caller);
+bool db_prepare_(sqlite3 *db, sqlite3_stmt **stmt, const char *sql, caller_info caller);
+bool db_step_reset_(sqlite3_stmt *stmt, caller_info caller);
+bool db_begin_transaction_(sqlite3 *db, caller_info caller);
+bool db_commit_transaction_(sqlite3 *db, caller_info caller);
+
+// variants of db_exec() and db_step_reset() recording the time spent in latencies
+bool db_exec_timed_(sqlite3 *db, const char *sql, histogram *latencies, caller_info caller);
+bool db_step_reset_timed_(sqlite3_stmt *stmt, histogram *latencies, caller_info caller);
+
+/*
+ * Connection and statement internals: db_reset_status() zeroes the sqlite3_db_status() counters
+ * (cache hits, misses, writes and spills) and the lookaside high-water mark at the start of a
+ * timed section, the rest report them, and sqlite3_stmt_status() counters of a statement used
+ * throughout the section, as '<tag_base>.<counter>'. A NULL stmt is ignored.
+ */
+void db_reset_status(sqlite3 *db);
+void db_report_status(const char *tag_base, sqlite3 *db);
+void db_report_stmt_status(const char *tag_base, sqlite3_stmt *stmt);
+
+#endif // DB_H
@@ -0,0 +1,319 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Fixture cache, see fixture.h. Restored files are byte for byte copies of the built database,
+ * so the tests work on the same page layout as if they had populated it themselves.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "histogram.h"
+
+enum { FIXTURE_KEY_MAX = 512, COPY_BUFFER_SIZE = 64 * 1024 };
+
+typedef struct {
+    char key[FIXTURE_KEY_MAX];
+    // the process that made the copy, children of -jobs inherit their parent's entries
+    pid_t owner;
+    // copy of a database file
+    char path[PATH_MAX];
+    // or serialization of an in-memory database, allocated with malloc() so that it survives
+    // sqlite being reinitialized by memory_configure()
+    unsigned char *data;
+    sqlite3_int64 size;
+} cache_entry;
+
+static cache_entry *entries = NULL;
+static int n_entries = 0;
+
+// false if the key does not fit, a truncated one could match another fixture
+static bool format_key(char *key, const fixture *f, int n_rows)
+{
+    const db_config *config = &test_opts.db;
+    int length;
+    int i;
+
+    length = snprintf(key, FIXTURE_KEY_MAX, "%d;%s;%s", n_rows,
+            config->page_size ? config->page_size : "",
+            config->journal_mode ? config->journal_mode : "");
+
+    for (i = 0; i < FIXTURE_TABLES_MAX && f->tables[i] != NULL && length < FIXTURE_KEY_MAX;
+            ++i) {
+        length += snprintf(key + length, FIXTURE_KEY_MAX - length, ";%s", f->tables[i]);
+    }
+    for (i = 0; i < FIXTURE_INDEXES_MAX && f->indexes[i] != NULL && length < FIXTURE_KEY_MAX;
+            ++i) {
+        length += snprintf(key + length, FIXTURE_KEY_MAX - length, ";%s", f->indexes[i]);
+    }
+
+    return length < FIXTURE_KEY_MAX;
+}
+
+static cache_entry *find_entry(const char *key)
+{
+    int i;
+    for (i = 0; i < n_entries; ++i) {
+        if (strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool build(sqlite3 **db, const char *db_file, const fixture *f, int n_rows,
+        caller_info caller)
+{
+    int i;
+
+    if (!db_open_truncate_(db, db_file, caller)) {
+        return false;
+    }
+
+    for (i = 0; i < FIXTURE_TABLES_MAX && f->tables[i] != NULL; ++i) {
+        if (!db_create_table_(*db, f->tables[i], n_rows, caller)) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < FIXTURE_INDEXES_MAX && f->indexes[i] != NULL; ++i) {
+        if (!db_create_index_(*db, f->indexes[i], caller)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool save_file(cache_entry *entry, sqlite3 *db, const char *db_file, caller_info caller)
+{
+    sqlite3 *copy = NULL;
+    int rc;
+
+    int n_written = snprintf(entry->path, PATH_MAX, "%s.fixture%d", db_file, n_entries);
+    if (n_written >= PATH_MAX) {
+        BLTS_ERROR("%s: PATH_MAX exceeded\n", db_file);
+        return false;
+    }
+
+    if (!db_remove_(entry->path, caller)) {
+        return false;
+    }
+
+    rc = sqlite3_open_v2(entry->path, &copy, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_backup *backup = sqlite3_backup_init(copy, "main", db, "main");
+        if (backup == NULL) {
+            rc = sqlite3_errcode(copy);
+        } else {
+            // copying all pages in one step is done unless it failed
+            rc = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        BLTS_ERROR("%s:%d: %s: Backup to \"%s\" failed: %s\n", caller.file, caller.file_line,
+                caller.function, entry->path, sqlite3_errstr(rc));
+    }
+    sqlite3_close(copy);
+
+    return rc == SQLITE_DONE;
+}
+
+static bool save_memory(cache_entry *entry, sqlite3 *db, caller_info caller)
+{
+    unsigned char *data = sqlite3_serialize(db, "main", &entry->size, 0);
+    if (data == NULL) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_serialize() failed\n", caller.file, caller.file_line,
+                caller.function);
+        return false;
+    }
+
+    entry->data = malloc(entry->size);
+    if (entry->data != NULL) {
+        memcpy(entry->data, data, entry->size);
+    } else {
+        BLTS_ERROR("Out of memory\n");
+    }
+    sqlite3_free(data);
+
+    return entry->data != NULL;
+}
+
+static bool save(const char *key, sqlite3 *db, const char *db_file, caller_info caller)
+{
+    cache_entry *new_entries = realloc(entries, (n_entries + 1) * sizeof(cache_entry));
+    if (new_entries == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        return false;
+    }
+    entries = new_entries;
+
+    cache_entry *entry = &entries[n_entries];
+    memset(entry, 0, sizeof(cache_entry));
+    snprintf(entry->key, FIXTURE_KEY_MAX, "%s", key);
+    entry->owner = getpid();
+
+    bool saved = db_is_in_memory(db_file) ? save_memory(entry, db, caller)
+        : save_file(entry, db, db_file, caller);
+    if (saved) {
+        ++n_entries;
+    }
+
+    return saved;
+}
+
+static bool copy_file(const char *from, const char *to, caller_info caller)
+{
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    bool retv = false;
+    ssize_t n_read = 0;
+
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (buffer == NULL || in < 0 || out < 0) {
+        goto fail;
+    }
+
+    while ((n_read = read(in, buffer, COPY_BUFFER_SIZE)) > 0) {
+        if (write(out, buffer, n_read) != n_read) {
+            goto fail;
+        }
+    }
+
+    retv = n_read == 0;
+
+fail:
+    if (!retv) {
+        BLTS_ERROR("%s:%d: %s: Copying \"%s\" to \"%s\" failed: %s\n", caller.file,
+                caller.file_line, caller.function, from, to, strerror(errno));
+    }
+    if (out >= 0 && close(out) != 0 && retv) {
+        BLTS_ERROR("%s:%d: %s: close(\"%s\") failed: %s\n", caller.file, caller.file_line,
+                caller.function, to, strerror(errno));
+        retv = false;
+    }
+    if (in >= 0) {
+        close(in);
+    }
+    free(buffer);
+
+    return retv;
+}
+
+static bool restore(const cache_entry *entry, sqlite3 **db, const char *db_file,
+        caller_info caller)
+{
+    if (entry->data == NULL) {
+        return db_remove_(db_file, caller) && copy_file(entry->path, db_file, caller)
+            && db_open_(db, db_file, caller);
+    }
+
+    if (!db_open_truncate_(db, db_file, caller)) {
+        return false;
+    }
+
+    unsigned char *data = sqlite3_malloc64(entry->size);
+    if (data == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        return false;
+    }
+    memcpy(data, entry->data, entry->size);
+
+    int rc = sqlite3_deserialize(*db, "main", data, entry->size, entry->size,
+            SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s:%d: %s: sqlite3_deserialize() failed: %s\n", caller.file,
+                caller.file_line, caller.function, sqlite3_errstr(rc));
+        return false;
+    }
+
+    // the database was replaced along with its settings
+    return db_configure_(*db, caller);
+}
+
+bool db_open_fixture_(sqlite3 **db, const char *db_file, const fixture *f, int n_rows,
+        caller_info caller)
+{
+    char key[FIXTURE_KEY_MAX];
+
+    if (!test_opts.fixture_cache) {
+        return build(db, db_file, f, n_rows, caller);
+    }
+
+    if (!format_key(key, f, n_rows)) {
+        BLTS_DEBUG("Fixture key too long, not cached\n");
+        return build(db, db_file, f, n_rows, caller);
+    }
+
+    uint64_t start = histogram_now();
+
+    const cache_entry *entry = find_entry(key);
+    if (entry != NULL) {
+        bool retv = restore(entry, db, db_file, caller);
+        BLTS_DEBUG("Fixture '%s' restored in %f s\n", key, (histogram_now() - start) / 1e9);
+        return retv;
+    }
+
+    if (!build(db, db_file, f, n_rows, caller) || !save(key, *db, db_file, caller)) {
+        return false;
+    }
+    BLTS_DEBUG("Fixture '%s' built in %f s\n", key, (histogram_now() - start) / 1e9);
+
+    return true;
+}
+
+void fixture_cache_clear(void)
+{
+    int i, n_kept = 0;
+
+    for (i = 0; i < n_entries; ++i) {
+        if (entries[i].owner != getpid()) {
+            entries[n_kept++] = entries[i];
+            continue;
+        }
+        if (entries[i].data == NULL) {
+            db_remove(entries[i].path);
+        }
+        free(entries[i].data);
+    }
+
+    n_entries = n_kept;
+    if (n_entries == 0) {
+        free(entries);
+        entries = NULL;
+    }
+}
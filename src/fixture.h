@@ -0,0 +1,56 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <sqlite3.h>
+#include <stdbool.h>
+
+#include "db.h"
+
+/*
+ * Populated databases the tests start from. With test_opts.fixture_cache each distinct fixture
+ * is built once per process and copied page by page (sqlite3_backup) to a file next to the
+ * database, '<db-file>.fixture<N>', or serialized (sqlite3_serialize) for in-memory databases.
+ * Later requests for the same fixture restore that copy instead of populating the tables again.
+ * Fixtures differ by their tables, indexes and table size as well as the page size and journal
+ * mode they were built with.
+ */
+
+enum { FIXTURE_TABLES_MAX = 3, FIXTURE_INDEXES_MAX = 3 };
+
+typedef struct {
+    // tables are created with db_create_table(), then the indexes with db_create_index()
+    const char *tables[FIXTURE_TABLES_MAX + 1];
+    const char *indexes[FIXTURE_INDEXES_MAX + 1];
+} fixture;
+
+#define db_open_fixture(db, db_file, f, n_rows) db_open_fixture_(db, db_file, f, n_rows, \
+        CALLER_INFO)
+
+// opens a new database at db_file holding the fixture with n_rows rows in each table
+bool db_open_fixture_(sqlite3 **db, const char *db_file, const fixture *f, int n_rows,
+        caller_info caller);
+
+// deletes the copies of fixtures made by this process
+void fixture_cache_clear(void);
+
+#endif // FIXTURE_H
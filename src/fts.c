@@ -0,0 +1,335 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Full-text search: the test_select_compare_strings() phrase queries answered by an FTS5 index
+ * (external content, over t1.c) instead of LIKE full scans, along with prefix, boolean and
+ * bm25-ranked top-k queries, and the cost of maintaining the index: the initial build, its size,
+ * incremental inserts, merging the segments they add and a final 'optimize'. The LIKE queries
+ * are run as well and the phrase queries report their speedup over them. Requires sqlite built
+ * with SQLITE_ENABLE_FTS5.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "generator.h"
+#include "histogram.h"
+#include "report.h"
+
+enum {
+    // LIKE queries are full scans, run one per this many FTS queries
+    LIKE_QUERY_RATIO = 10,
+    // pages processed per 'merge' command
+    MERGE_PAGES = 16,
+};
+
+typedef void (*query_format_fn)(char *query, int index);
+
+typedef struct {
+    const char *tag;
+    const char *sql;
+    query_format_fn format;
+} query_kind;
+
+static const char *word(int index, int position)
+{
+    static const int divisors[] = { 100, 10, 1, 1000 };
+
+    return digits[(index / divisors[position]) % 10];
+}
+
+// the patterns of test_select_compare_strings(), repeating after 1000 queries
+static void format_like(char *query, int index)
+{
+    sql_sprintf(query, "%%%s %s %s%%", word(index, 0), word(index, 1), word(index, 2));
+}
+
+static void format_phrase(char *query, int index)
+{
+    sql_sprintf(query, "\"%s %s %s\"", word(index, 0), word(index, 1), word(index, 2));
+}
+
+// the last word of the phrase abbreviated to two letters
+static void format_prefix(char *query, int index)
+{
+    sql_sprintf(query, "\"%s %s %.2s\" *", word(index, 0), word(index, 1), word(index, 2));
+}
+
+static void format_boolean(char *query, int index)
+{
+    sql_sprintf(query, "%s AND (%s OR %s) NOT %s", word(index, 0), word(index, 1),
+            word(index, 2), word(index, 3));
+}
+
+static void format_top_k(char *query, int index)
+{
+    sql_sprintf(query, "%s %s", word(index, 0), word(index, 1));
+}
+
+static const query_kind like_query = {
+    "like", "SELECT count(*), avg(b) FROM t1 WHERE c LIKE ?1;", format_like
+};
+
+static const query_kind fts_queries[] = {
+    { "phrase", "SELECT count(*), avg(b) FROM t1 JOIN f ON f.rowid = t1.rowid WHERE f MATCH ?1;",
+        format_phrase },
+    { "prefix", "SELECT count(*), avg(b) FROM t1 JOIN f ON f.rowid = t1.rowid WHERE f MATCH ?1;",
+        format_prefix },
+    { "boolean", "SELECT count(*), avg(b) FROM t1 JOIN f ON f.rowid = t1.rowid WHERE f MATCH ?1;",
+        format_boolean },
+    { "top_k", "SELECT rowid, bm25(f) FROM f WHERE f MATCH ?1 ORDER BY rank LIMIT 10;",
+        format_top_k },
+};
+
+static bool query_db_size(sqlite3 *db, double *size)
+{
+    sqlite3_stmt *stmt = NULL;
+    bool ok = db_prepare(db, &stmt, "SELECT page_count * page_size FROM pragma_page_count(), "
+            "pragma_page_size();") && sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *size = sqlite3_column_double(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+// runs n_queries queries of the kind and reports their latencies, the mean one is stored in mean
+static bool query_pass(const char *tag_base, sqlite3 *db, const query_kind *kind, int n_queries,
+        double *mean)
+{
+    bool retv = false;
+    sqlite3_stmt *stmt = NULL;
+    histogram *latencies = histogram_create();
+    char query[SQL_MAX];
+    int i;
+
+    if (latencies == NULL || !db_prepare(db, &stmt, kind->sql)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_queries; ++i) {
+        kind->format(query, i);
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_TRANSIENT);
+        if (!db_step_reset_timed(stmt, latencies)) {
+            goto fail;
+        }
+    }
+
+    char kind_tag_base[TAG_MAX];
+    format_tag(kind_tag_base, tag_base, kind->tag);
+    report_latencies(kind_tag_base, latencies, latencies->sum / 1e9);
+    db_report_stmt_status(kind_tag_base, stmt);
+
+    *mean = latencies->count ? (double)latencies->sum / latencies->count : 0;
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+    histogram_destroy(latencies);
+
+    return retv;
+}
+
+static bool timed_exec(const char *tag_base, const char *tag, sqlite3 *db, const char *sql)
+{
+    char step_tag_base[TAG_MAX];
+    format_tag(step_tag_base, tag_base, tag);
+
+    uint64_t start = histogram_now();
+    if (!db_exec(db, sql)) {
+        return false;
+    }
+    report_extended_result(step_tag_base, "elapsed", (histogram_now() - start) / 1e9, "s");
+
+    return true;
+}
+
+// inserts n_rows rows into t1 and the index, reporting the latencies of the latter
+static bool incremental_insert(const char *tag_base, sqlite3 *db, int first_index, int n_rows)
+{
+    bool retv = false;
+    sqlite3_stmt *insert = NULL;
+    sqlite3_stmt *index = NULL;
+    histogram *latencies = histogram_create();
+    const generated_row *row;
+
+    row_generator *rows = row_generator_create(first_index, n_rows, NULL);
+
+    if (latencies == NULL || rows == NULL) {
+        goto fail;
+    }
+
+    if (!db_prepare(db, &insert, "INSERT INTO t1 VALUES(?1, ?2, ?3);")
+            || !db_prepare(db, &index,
+                "INSERT INTO f(rowid, c) VALUES(last_insert_rowid(), ?1);")) {
+        goto fail;
+    }
+
+    uint64_t start = histogram_now();
+
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    while ((row = row_generator_next(rows)) != NULL) {
+        sqlite3_bind_int(insert, 1, row->index);
+        sqlite3_bind_int(insert, 2, row->row.number);
+        sqlite3_bind_text(insert, 3, row->row.string, -1, SQLITE_STATIC);
+        sqlite3_bind_text(index, 1, row->row.string, -1, SQLITE_STATIC);
+        if (!db_step_reset(insert) || !db_step_reset_timed(index, latencies)) {
+            goto fail;
+        }
+    }
+
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+
+    char insert_tag_base[TAG_MAX];
+    format_tag(insert_tag_base, tag_base, "insert");
+    double elapsed = (histogram_now() - start) / 1e9 - row_generator_overhead(rows);
+    report_extended_result(insert_tag_base, "elapsed", elapsed, "s");
+    report_latencies(insert_tag_base, latencies, elapsed);
+
+    retv = true;
+
+fail:
+    if (!retv) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_finalize(insert);
+    sqlite3_finalize(index);
+    histogram_destroy(latencies);
+    row_generator_destroy(rows);
+
+    return retv;
+}
+
+// runs 'merge' until there is no more work to do, as told by sqlite3_total_changes()
+static bool merge(const char *tag_base, sqlite3 *db)
+{
+    char sql[SQL_MAX];
+    int n_steps = 0;
+    int changes;
+
+    sql_sprintf(sql, "INSERT INTO f(f, rank) VALUES('merge', %d);", MERGE_PAGES);
+
+    uint64_t start = histogram_now();
+    do {
+        int total_changes = sqlite3_total_changes(db);
+        if (!db_exec(db, sql)) {
+            return false;
+        }
+        changes = sqlite3_total_changes(db) - total_changes;
+        ++n_steps;
+    } while (changes >= 2);
+
+    char merge_tag_base[TAG_MAX];
+    format_tag(merge_tag_base, tag_base, "merge");
+    report_extended_result(merge_tag_base, "elapsed", (histogram_now() - start) / 1e9, "s");
+    report_extended_result(merge_tag_base, "steps", n_steps, "");
+
+    return true;
+}
+
+int test_fts(const char *tag_base, const char *db_file, int table_size, int n_selects)
+{
+    BLTS_DEBUG("START %s(table_size=%d, n_selects=%d)\n", __FUNCTION__, table_size, n_selects);
+
+    int retv = EXIT_FAILURE;
+    sqlite3 *db = NULL;
+    double size_before;
+    double size_after;
+    double like_mean;
+    double mean;
+    unsigned i;
+
+    static const fixture t1 = { { "t1" }, { NULL } };
+    if (!db_open_fixture(&db, db_file, &t1, table_size)) {
+        goto fail;
+    }
+
+    if (!query_db_size(db, &size_before)) {
+        goto fail;
+    }
+
+    if (!db_exec(db, "CREATE VIRTUAL TABLE f USING fts5(c, content='t1');")) {
+        goto fail;
+    }
+
+    if (!timed_exec(tag_base, "build", db, "INSERT INTO f(f) VALUES('rebuild');")) {
+        goto fail;
+    }
+
+    if (!query_db_size(db, &size_after)) {
+        goto fail;
+    }
+    report_extended_result(tag_base, "index_size", size_after - size_before, "B");
+
+    int n_like = n_selects / LIKE_QUERY_RATIO > 0 ? n_selects / LIKE_QUERY_RATIO : 1;
+    if (!query_pass(tag_base, db, &like_query, n_like, &like_mean)) {
+        goto fail;
+    }
+
+    for (i = 0; i < sizeof(fts_queries) / sizeof(fts_queries[0]); ++i) {
+        if (!query_pass(tag_base, db, &fts_queries[i], n_selects, &mean)) {
+            goto fail;
+        }
+
+        // the phrase queries find the same rows as the LIKE ones
+        if (i == 0 && mean > 0) {
+            char phrase_tag_base[TAG_MAX];
+            format_tag(phrase_tag_base, tag_base, fts_queries[i].tag);
+            report_extended_result(phrase_tag_base, "speedup", like_mean / mean, "");
+        }
+    }
+
+    if (!incremental_insert(tag_base, db, table_size, table_size / 10 > 0 ? table_size / 10 : 1)) {
+        goto fail;
+    }
+
+    if (!merge(tag_base, db)) {
+        goto fail;
+    }
+
+    if (!timed_exec(tag_base, "optimize", db, "INSERT INTO f(f) VALUES('optimize');")) {
+        goto fail;
+    }
+
+    if (!query_db_size(db, &size_after)) {
+        goto fail;
+    }
+    report_extended_result(tag_base, "db_size", size_after, "B");
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    db_close(db);
+
+    return retv;
+}
@@ -0,0 +1,123 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "generator.h"
+#include "histogram.h"
+
+const char *digits[] = {
+    "zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"
+};
+
+uint64_t generator_seed(void)
+{
+    uint64_t seed = ((uint64_t)random() << 32) ^ (uint64_t)random();
+
+    // xorshift gets stuck at zero
+    return seed != 0 ? seed : 1;
+}
+
+uint64_t generator_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// fills row->string with the digits of row->number spelled out, e.g. "zero one two three four five"
+void generate_test_row(test_data_row *row, uint64_t *state)
+{
+    row->number = generator_random(state) % 1000000;
+
+    char *p = row->string;
+    int divisor;
+    for (divisor = 100000; divisor > 0; divisor /= 10) {
+        const char *digit = digits[(row->number / divisor) % 10];
+        size_t len = strlen(digit);
+        memcpy(p, digit, len);
+        p += len;
+        *p++ = ' ';
+    }
+    p[-1] = '\0';
+}
+
+row_generator *row_generator_create(int first_index, int n_rows, generator_format_fn format)
+{
+    row_generator *g = calloc(1, sizeof(row_generator));
+    if (g == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    g->state = generator_seed();
+    g->format = format;
+    g->next_index = first_index;
+    g->end_index = first_index + n_rows;
+
+    return g;
+}
+
+void row_generator_destroy(row_generator *g)
+{
+    free(g);
+}
+
+static void refill(row_generator *g)
+{
+    uint64_t start = histogram_now();
+
+    g->n_batch = 0;
+    g->batch_pos = 0;
+    while (g->n_batch < GENERATOR_BATCH_ROWS && g->next_index < g->end_index) {
+        generated_row *r = &g->batch[g->n_batch++];
+        r->index = g->next_index++;
+        generate_test_row(&r->row, &g->state);
+        if (g->format != NULL) {
+            g->format(r->sql, r->index, &r->row);
+        }
+    }
+
+    g->overhead_ns += histogram_now() - start;
+}
+
+const generated_row *row_generator_next(row_generator *g)
+{
+    if (g->batch_pos == g->n_batch) {
+        refill(g);
+        if (g->n_batch == 0) {
+            return NULL;
+        }
+    }
+
+    return &g->batch[g->batch_pos++];
+}
+
+double row_generator_overhead(const row_generator *g)
+{
+    return g != NULL ? g->overhead_ns / 1e9 : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+
+#include "db.h"
+
+/*
+ * Test data generation. Rows hold random values drawn from a fast xorshift64* PRNG.
+ *
+ * row_generator produces a sequence of n_rows rows in small batches, optionally together with an
+ * SQL statement built from each row by the given format function. The batch buffer is reused, so
+ * memory use does not depend on the number of rows and the data stay cache-hot while consumed.
+ * The time spent refilling the batch is accounted separately, so it can be excluded from (and
+ * reported next to) measured time.
+ */
+
+enum { TEST_DATA_STRING_MAX = 256 };
+
+typedef struct {
+    int number;
+    char string[TEST_DATA_STRING_MAX];
+} test_data_row;
+
+extern const char *digits[];
+
+uint64_t generator_seed(void);
+uint64_t generator_random(uint64_t *state);
+
+void generate_test_row(test_data_row *row, uint64_t *state);
+
+enum { GENERATOR_BATCH_ROWS = 64 };
+
+typedef void (*generator_format_fn)(char *sql, int index, const test_data_row *row);
+
+typedef struct {
+    int index;
+    test_data_row row;
+    char sql[SQL_MAX];
+} generated_row;
+
+typedef struct {
+    uint64_t state;
+    generator_format_fn format;
+    int next_index;
+    int end_index;
+    int n_batch;
+    int batch_pos;
+    uint64_t overhead_ns;
+    generated_row batch[GENERATOR_BATCH_ROWS];
+} row_generator;
+
+// format may be NULL when only the row data are needed
+row_generator *row_generator_create(int first_index, int n_rows, generator_format_fn format);
+void row_generator_destroy(row_generator *g);
+
+// returns NULL after n_rows rows; the returned row is valid until the next call
+const generated_row *row_generator_next(row_generator *g);
+
+// time spent generating rows so far, in seconds; gen may be NULL
+double row_generator_overhead(const row_generator *g);
+
+#endif // GENERATOR_H
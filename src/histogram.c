@@ -0,0 +1,140 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "histogram.h"
+
+static int bucket_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return shift * HISTOGRAM_SUB_BUCKETS + (int)(value >> shift);
+}
+
+static uint64_t bucket_upper_bound(int index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+histogram *histogram_create(void)
+{
+    histogram *h = malloc(sizeof(histogram));
+    if (h == NULL) {
+        BLTS_ERROR("%s: Out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    histogram_reset(h);
+
+    return h;
+}
+
+void histogram_destroy(histogram *h)
+{
+    free(h);
+}
+
+void histogram_reset(histogram *h)
+{
+    memset(h, 0, sizeof(histogram));
+    h->min = UINT64_MAX;
+}
+
+void histogram_record(histogram *h, uint64_t value)
+{
+    ++h->buckets[bucket_index(value)];
+    ++h->count;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void histogram_merge(histogram *into, const histogram *from)
+{
+    int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        into->buckets[i] += from->buckets[i];
+    }
+
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+uint64_t histogram_percentile(const histogram *h, double percentile)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+
+    uint64_t seen = 0;
+    int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_upper_bound(i);
+            return value > h->max ? h->max : value;
+        }
+    }
+
+    return h->max;
+}
+
+uint64_t histogram_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
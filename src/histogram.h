@@ -0,0 +1,60 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Latency histogram with HDR-style log-linear buckets: values below HISTOGRAM_SUB_BUCKETS are
+ * counted exactly, above that each power of two range is split into HISTOGRAM_SUB_BUCKETS linear
+ * buckets, giving a relative error of at most 1 / HISTOGRAM_SUB_BUCKETS over the whole uint64_t
+ * range. All storage is part of the structure, so recording never allocates.
+ */
+
+enum {
+    HISTOGRAM_SUB_BUCKET_BITS = 5,
+    HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS,
+    HISTOGRAM_BUCKETS = (65 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_SUB_BUCKETS
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram;
+
+histogram *histogram_create(void);
+void histogram_destroy(histogram *h);
+void histogram_reset(histogram *h);
+
+void histogram_record(histogram *h, uint64_t value);
+void histogram_merge(histogram *into, const histogram *from);
+
+// returns the (upper bound of the bucket holding the) value at given percentile (0-100)
+uint64_t histogram_percentile(const histogram *h, double percentile);
+
+// monotonic clock in nanoseconds, the time base for latency values recorded in histograms
+uint64_t histogram_now(void);
+
+#endif // HISTOGRAM_H
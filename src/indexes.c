@@ -0,0 +1,369 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Index variants: the same table (with an integer primary key and a low-cardinality column d) is
+ * indexed in turn by a single-column, composite, covering, partial and expression index, and
+ * stored as a WITHOUT ROWID table, then loaded, queried, updated and deleted from. Results are
+ * reported as '<tag_base>.<variant>.<phase>.*'. Each query is reported with the plan sqlite
+ * chose for it (EXPLAIN QUERY PLAN), logged and attached to its results in the JSON output, and
+ * the write phases with the bytes written and time taken relative to the unindexed table
+ * ('write_amplification', 'slowdown').
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <blts_timing.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "json.h"
+#include "report.h"
+
+enum {
+    PLAN_MAX = 512,
+    // width of the ranges of b queried, about 25 rows of 25000
+    RANGE_WIDTH = 1000,
+    // rows updated and deleted, in percents of the table size
+    CHANGED_PERCENT = 10,
+};
+
+typedef struct {
+    const char *tag;
+    bool without_rowid;
+    // NULL for no index
+    const char *index_sql;
+} index_variant;
+
+static const index_variant variants[] = {
+    { "none", false, NULL },
+    { "single", false, "CREATE INDEX i1 ON t1(b);" },
+    { "composite", false, "CREATE INDEX i1 ON t1(d, b);" },
+    { "covering", false, "CREATE INDEX i1 ON t1(b, c);" },
+    { "partial", false, "CREATE INDEX i1 ON t1(b) WHERE d = 0;" },
+    { "expression", false, "CREATE INDEX i1 ON t1(b / 1000);" },
+    { "without_rowid", true, "CREATE INDEX i1 ON t1(b);" },
+};
+
+// ?1 and ?2 delimit a range of b, ?3 is a value of d and ?4 a key
+static const struct {
+    const char *tag;
+    const char *sql;
+} queries[] = {
+    { "range", "SELECT count(*), avg(a) FROM t1 WHERE b >= ?1 AND b < ?2;" },
+    { "projection", "SELECT c FROM t1 WHERE b >= ?1 AND b < ?2;" },
+    { "composite", "SELECT count(*) FROM t1 WHERE d = ?3 AND b >= ?1 AND b < ?2;" },
+    { "partial", "SELECT count(*) FROM t1 WHERE d = 0 AND b >= ?1 AND b < ?2;" },
+    { "expression", "SELECT count(*) FROM t1 WHERE b / 1000 = ?1 / 1000;" },
+    { "key", "SELECT b, c FROM t1 WHERE a = ?4;" },
+};
+
+// results of the unindexed table the others are compared with
+typedef struct {
+    double write_bytes;
+    double elapsed;
+} write_baseline;
+
+static void report_query_plan(const char *tag_base, sqlite3 *db, const char *sql)
+{
+    char explain_sql[SQL_MAX];
+    char plan[PLAN_MAX] = "";
+    size_t len = 0;
+    sqlite3_stmt *stmt = NULL;
+
+    sql_sprintf(explain_sql, "EXPLAIN QUERY PLAN %s", sql);
+    if (!db_prepare(db, &stmt, explain_sql)) {
+        return;
+    }
+
+    // the detail column, e.g. 'SEARCH t1 USING COVERING INDEX i1 (b>? AND b<?)'
+    while (sqlite3_step(stmt) == SQLITE_ROW && len < sizeof(plan)) {
+        len += snprintf(plan + len, sizeof(plan) - len, "%s%s", len ? "; " : "",
+                sqlite3_column_text(stmt, 3));
+    }
+    sqlite3_finalize(stmt);
+
+    BLTS_DEBUG("%s: query plan: %s\n", tag_base, plan);
+    json_annotation(tag_base, "query_plan", plan);
+}
+
+static void write_phase_start(sqlite3 *db)
+{
+    db_reset_status(db);
+    io_accounting_start();
+    timing_start();
+}
+
+// reports a write phase, the first variant's results are the baseline of the others
+static void write_phase_stop(const char *tag_base, sqlite3 *db, int n_rows,
+        write_baseline *baseline, bool is_baseline)
+{
+    char tag[TAG_MAX];
+    double write_bytes = 0;
+
+    timing_stop();
+    io_accounting_stop();
+
+    double elapsed = timing_elapsed();
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    if (elapsed > 0) {
+        report_extended_result(tag_base, "rows_per_sec", n_rows / elapsed, "1/s");
+    }
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
+
+    format_tag(tag, tag_base, "vfs_write_bytes");
+    find_extended_result(tag, &write_bytes);
+
+    if (is_baseline) {
+        baseline->write_bytes = write_bytes;
+        baseline->elapsed = elapsed;
+        return;
+    }
+
+    // in-memory databases do not write through the VFS
+    if (baseline->write_bytes > 0) {
+        report_extended_result(tag_base, "write_amplification",
+                write_bytes / baseline->write_bytes, "");
+    }
+    if (baseline->elapsed > 0) {
+        report_extended_result(tag_base, "slowdown", elapsed / baseline->elapsed, "");
+    }
+}
+
+static bool load(const char *tag_base, sqlite3 *db, int table_size, write_baseline *baseline,
+        bool is_baseline)
+{
+    bool retv = false;
+    sqlite3_stmt *insert = NULL;
+    const generated_row *row;
+    row_generator *rows = row_generator_create(0, table_size, NULL);
+
+    if (rows == NULL || !db_prepare(db, &insert, "INSERT INTO t1 VALUES(?1, ?2, ?3, ?4);")) {
+        goto fail;
+    }
+
+    write_phase_start(db);
+
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    while ((row = row_generator_next(rows)) != NULL) {
+        sqlite3_bind_int(insert, 1, row->index);
+        sqlite3_bind_int(insert, 2, row->row.number);
+        sqlite3_bind_text(insert, 3, row->row.string, -1, SQLITE_STATIC);
+        sqlite3_bind_int(insert, 4, row->row.number % 100);
+        if (!db_step_reset(insert)) {
+            goto fail;
+        }
+    }
+
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+
+    write_phase_stop(tag_base, db, table_size, baseline, is_baseline);
+    retv = true;
+
+fail:
+    sqlite3_finalize(insert);
+    row_generator_destroy(rows);
+
+    return retv;
+}
+
+static bool query(const char *tag_base, sqlite3 *db, int table_size, int n_selects)
+{
+    unsigned q;
+    int i;
+
+    for (q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        char query_tag_base[TAG_MAX];
+        sqlite3_stmt *stmt = NULL;
+        histogram *latencies = histogram_create();
+        bool ok = latencies != NULL && db_prepare(db, &stmt, queries[q].sql);
+
+        format_tag(query_tag_base, tag_base, queries[q].tag);
+
+        // spread over the whole range of b and the keys, parameters not in the query are ignored
+        for (i = 0; ok && i < n_selects; ++i) {
+            int low = (int)((long long)i * 1000003 % 1000000);
+            sqlite3_bind_int(stmt, 1, low);
+            sqlite3_bind_int(stmt, 2, low + RANGE_WIDTH);
+            sqlite3_bind_int(stmt, 3, i % 100);
+            sqlite3_bind_int(stmt, 4, (int)((long long)i * 7919 % table_size));
+            ok = db_step_reset_timed(stmt, latencies);
+        }
+
+        if (ok) {
+            report_query_plan(query_tag_base, db, queries[q].sql);
+            report_latencies(query_tag_base, latencies, latencies->sum / 1e9);
+            db_report_stmt_status(query_tag_base, stmt);
+        }
+
+        sqlite3_finalize(stmt);
+        histogram_destroy(latencies);
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// b and d of every CHANGED_PERCENT-th row, the indexed columns of all the variants, are changed
+static bool update(const char *tag_base, sqlite3 *db, int table_size, write_baseline *baseline,
+        bool is_baseline)
+{
+    bool retv = false;
+    sqlite3_stmt *stmt = NULL;
+    int n_rows = 0;
+    int i;
+    uint64_t state = generator_seed();
+
+    if (!db_prepare(db, &stmt, "UPDATE t1 SET b = ?2, d = ?2 % 100 WHERE a = ?1;")) {
+        goto fail;
+    }
+
+    write_phase_start(db);
+
+    if (!db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    for (i = 0; i < table_size; i += 100 / CHANGED_PERCENT, ++n_rows) {
+        sqlite3_bind_int(stmt, 1, i);
+        sqlite3_bind_int(stmt, 2, generator_random(&state) % 1000000);
+        if (!db_step_reset(stmt)) {
+            goto fail;
+        }
+    }
+
+    if (!db_commit_transaction(db)) {
+        goto fail;
+    }
+
+    write_phase_stop(tag_base, db, n_rows, baseline, is_baseline);
+    retv = true;
+
+fail:
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+static bool delete(const char *tag_base, sqlite3 *db, int table_size, write_baseline *baseline,
+        bool is_baseline)
+{
+    char sql[SQL_MAX];
+    sql_sprintf(sql, "DELETE FROM t1 WHERE a %% %d = 1;", 100 / CHANGED_PERCENT);
+
+    write_phase_start(db);
+
+    if (!db_exec(db, sql)) {
+        timing_stop();
+        io_accounting_stop();
+        return false;
+    }
+
+    write_phase_stop(tag_base, db, table_size * CHANGED_PERCENT / 100, baseline, is_baseline);
+
+    return true;
+}
+
+static int index_variant_run(const char *tag_base, const char *db_file, int table_size,
+        int n_selects, const index_variant *variant, write_baseline *baselines, bool is_baseline)
+{
+    BLTS_DEBUG("START %s(variant=%s, table_size=%d, n_selects=%d)\n", __FUNCTION__, variant->tag,
+            table_size, n_selects);
+
+    int retv = EXIT_FAILURE;
+    sqlite3 *db = NULL;
+    char phase_tag_base[TAG_MAX];
+    char create_sql[SQL_MAX];
+
+    sql_sprintf(create_sql, "CREATE TABLE t1 (a INTEGER PRIMARY KEY, b INTEGER, "
+            "c VARCHAR(100), d INTEGER)%s;", variant->without_rowid ? " WITHOUT ROWID" : "");
+
+    if (!db_open_truncate(&db, db_file) || !db_exec(db, create_sql)) {
+        goto fail;
+    }
+
+    if (variant->index_sql != NULL && !db_exec(db, variant->index_sql)) {
+        goto fail;
+    }
+
+    format_tag(phase_tag_base, tag_base, "insert");
+    if (!load(phase_tag_base, db, table_size, &baselines[0], is_baseline)) {
+        goto fail;
+    }
+
+    format_tag(phase_tag_base, tag_base, "select");
+    if (!query(phase_tag_base, db, table_size, n_selects)) {
+        goto fail;
+    }
+
+    format_tag(phase_tag_base, tag_base, "update");
+    if (!update(phase_tag_base, db, table_size, &baselines[1], is_baseline)) {
+        goto fail;
+    }
+
+    format_tag(phase_tag_base, tag_base, "delete");
+    if (!delete(phase_tag_base, db, table_size, &baselines[2], is_baseline)) {
+        goto fail;
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    db_close(db);
+
+    return retv;
+}
+
+int test_indexes(const char *tag_base, const char *db_file, int table_size, int n_selects)
+{
+    write_baseline baselines[3];
+    int retv = EXIT_SUCCESS;
+    unsigned i;
+
+    memset(baselines, 0, sizeof(baselines));
+
+    for (i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i) {
+        char variant_tag_base[TAG_MAX];
+        format_tag(variant_tag_base, tag_base, variants[i].tag);
+
+        if (index_variant_run(variant_tag_base, db_file, table_size, n_selects, &variants[i],
+                    baselines, i == 0) != EXIT_SUCCESS) {
+            retv = EXIT_FAILURE;
+        }
+    }
+
+    return retv;
+}
@@ -0,0 +1,456 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The counting VFS forwards everything to the VFS that was the default before it was installed,
+ * counting xRead, xWrite, xSync and xTruncate calls on files and the bytes read and written. It
+ * covers all files sqlite opens through the default VFS, i.e. journals and temporary files too.
+ *
+ * Counters and /proc/self/io are process wide and getrusage() is called with RUSAGE_SELF, so
+ * sections doing work in several threads are accounted as a whole.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "io.h"
+#include "perf.h"
+#include "report.h"
+
+typedef struct {
+    uint64_t reads;
+    uint64_t read_bytes;
+    uint64_t writes;
+    uint64_t write_bytes;
+    uint64_t syncs;
+    uint64_t truncates;
+} vfs_counters;
+
+typedef struct {
+    vfs_counters vfs;
+    // from /proc/self/io, valid only if have_proc_io
+    bool have_proc_io;
+    uint64_t storage_read_bytes;
+    uint64_t storage_write_bytes;
+    struct rusage usage;
+} io_snapshot;
+
+typedef struct {
+    sqlite3_file base;
+    // the file opened by the wrapped VFS, allocated right after this structure
+    sqlite3_file *real;
+} counting_file;
+
+static vfs_counters counters;
+static sqlite3_vfs *real_vfs = NULL;
+static sqlite3_vfs counting_vfs;
+static io_snapshot section_start;
+static io_snapshot section_end;
+
+static void count(uint64_t *counter, uint64_t n)
+{
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static sqlite3_file *real_file(sqlite3_file *file)
+{
+    return ((counting_file *)file)->real;
+}
+
+/*
+ * sqlite3_io_methods
+ */
+
+static int counting_close(sqlite3_file *file)
+{
+    return real_file(file)->pMethods->xClose(real_file(file));
+}
+
+static int counting_read(sqlite3_file *file, void *buf, int amount, sqlite3_int64 offset)
+{
+    count(&counters.reads, 1);
+    count(&counters.read_bytes, amount);
+    return real_file(file)->pMethods->xRead(real_file(file), buf, amount, offset);
+}
+
+static int counting_write(sqlite3_file *file, const void *buf, int amount, sqlite3_int64 offset)
+{
+    count(&counters.writes, 1);
+    count(&counters.write_bytes, amount);
+    return real_file(file)->pMethods->xWrite(real_file(file), buf, amount, offset);
+}
+
+static int counting_truncate(sqlite3_file *file, sqlite3_int64 size)
+{
+    count(&counters.truncates, 1);
+    return real_file(file)->pMethods->xTruncate(real_file(file), size);
+}
+
+static int counting_sync(sqlite3_file *file, int flags)
+{
+    count(&counters.syncs, 1);
+    return real_file(file)->pMethods->xSync(real_file(file), flags);
+}
+
+static int counting_file_size(sqlite3_file *file, sqlite3_int64 *size)
+{
+    return real_file(file)->pMethods->xFileSize(real_file(file), size);
+}
+
+static int counting_lock(sqlite3_file *file, int lock)
+{
+    return real_file(file)->pMethods->xLock(real_file(file), lock);
+}
+
+static int counting_unlock(sqlite3_file *file, int lock)
+{
+    return real_file(file)->pMethods->xUnlock(real_file(file), lock);
+}
+
+static int counting_check_reserved_lock(sqlite3_file *file, int *result)
+{
+    return real_file(file)->pMethods->xCheckReservedLock(real_file(file), result);
+}
+
+static int counting_file_control(sqlite3_file *file, int op, void *arg)
+{
+    return real_file(file)->pMethods->xFileControl(real_file(file), op, arg);
+}
+
+static int counting_sector_size(sqlite3_file *file)
+{
+    return real_file(file)->pMethods->xSectorSize(real_file(file));
+}
+
+static int counting_device_characteristics(sqlite3_file *file)
+{
+    return real_file(file)->pMethods->xDeviceCharacteristics(real_file(file));
+}
+
+static int counting_shm_map(sqlite3_file *file, int region, int size, int extend,
+        void volatile **p)
+{
+    return real_file(file)->pMethods->xShmMap(real_file(file), region, size, extend, p);
+}
+
+static int counting_shm_lock(sqlite3_file *file, int offset, int n, int flags)
+{
+    return real_file(file)->pMethods->xShmLock(real_file(file), offset, n, flags);
+}
+
+static void counting_shm_barrier(sqlite3_file *file)
+{
+    real_file(file)->pMethods->xShmBarrier(real_file(file));
+}
+
+static int counting_shm_unmap(sqlite3_file *file, int delete_flag)
+{
+    return real_file(file)->pMethods->xShmUnmap(real_file(file), delete_flag);
+}
+
+static int counting_fetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **p)
+{
+    return real_file(file)->pMethods->xFetch(real_file(file), offset, amount, p);
+}
+
+static int counting_unfetch(sqlite3_file *file, sqlite3_int64 offset, void *p)
+{
+    return real_file(file)->pMethods->xUnfetch(real_file(file), offset, p);
+}
+
+// one per io_methods version so that sqlite only calls what the wrapped file implements
+static const sqlite3_io_methods counting_io_methods[] = {
+#define COUNTING_IO_METHODS(version) { \
+        version, counting_close, counting_read, counting_write, counting_truncate, \
+        counting_sync, counting_file_size, counting_lock, counting_unlock, \
+        counting_check_reserved_lock, counting_file_control, counting_sector_size, \
+        counting_device_characteristics, counting_shm_map, counting_shm_lock, \
+        counting_shm_barrier, counting_shm_unmap, counting_fetch, counting_unfetch }
+    COUNTING_IO_METHODS(1),
+    COUNTING_IO_METHODS(2),
+    COUNTING_IO_METHODS(3),
+#undef COUNTING_IO_METHODS
+};
+
+/*
+ * sqlite3_vfs
+ */
+
+static int counting_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags,
+        int *out_flags)
+{
+    (void)vfs;
+    counting_file *f = (counting_file *)file;
+    f->real = (sqlite3_file *)(f + 1);
+
+    int rc = real_vfs->xOpen(real_vfs, name, f->real, flags, out_flags);
+
+    const sqlite3_io_methods *real_methods = f->real->pMethods;
+    if (real_methods == NULL) {
+        f->base.pMethods = NULL;
+    } else {
+        int version = real_methods->iVersion;
+        version = version < 1 ? 1 : version > 3 ? 3 : version;
+        f->base.pMethods = &counting_io_methods[version - 1];
+    }
+
+    return rc;
+}
+
+static int counting_delete(sqlite3_vfs *vfs, const char *name, int sync_dir)
+{
+    (void)vfs;
+    return real_vfs->xDelete(real_vfs, name, sync_dir);
+}
+
+static int counting_access(sqlite3_vfs *vfs, const char *name, int flags, int *result)
+{
+    (void)vfs;
+    return real_vfs->xAccess(real_vfs, name, flags, result);
+}
+
+static int counting_full_pathname(sqlite3_vfs *vfs, const char *name, int n_out, char *out)
+{
+    (void)vfs;
+    return real_vfs->xFullPathname(real_vfs, name, n_out, out);
+}
+
+static void *counting_dl_open(sqlite3_vfs *vfs, const char *filename)
+{
+    (void)vfs;
+    return real_vfs->xDlOpen(real_vfs, filename);
+}
+
+static void counting_dl_error(sqlite3_vfs *vfs, int n_bytes, char *msg)
+{
+    (void)vfs;
+    real_vfs->xDlError(real_vfs, n_bytes, msg);
+}
+
+static void (*counting_dl_sym(sqlite3_vfs *vfs, void *handle, const char *symbol))(void)
+{
+    (void)vfs;
+    return real_vfs->xDlSym(real_vfs, handle, symbol);
+}
+
+static void counting_dl_close(sqlite3_vfs *vfs, void *handle)
+{
+    (void)vfs;
+    real_vfs->xDlClose(real_vfs, handle);
+}
+
+static int counting_randomness(sqlite3_vfs *vfs, int n_bytes, char *out)
+{
+    (void)vfs;
+    return real_vfs->xRandomness(real_vfs, n_bytes, out);
+}
+
+static int counting_sleep(sqlite3_vfs *vfs, int microseconds)
+{
+    (void)vfs;
+    return real_vfs->xSleep(real_vfs, microseconds);
+}
+
+static int counting_current_time(sqlite3_vfs *vfs, double *now)
+{
+    (void)vfs;
+    return real_vfs->xCurrentTime(real_vfs, now);
+}
+
+static int counting_get_last_error(sqlite3_vfs *vfs, int n_bytes, char *msg)
+{
+    (void)vfs;
+    return real_vfs->xGetLastError(real_vfs, n_bytes, msg);
+}
+
+static int counting_current_time_int64(sqlite3_vfs *vfs, sqlite3_int64 *now)
+{
+    (void)vfs;
+    return real_vfs->xCurrentTimeInt64(real_vfs, now);
+}
+
+static int counting_set_system_call(sqlite3_vfs *vfs, const char *name,
+        sqlite3_syscall_ptr call)
+{
+    (void)vfs;
+    return real_vfs->xSetSystemCall(real_vfs, name, call);
+}
+
+static sqlite3_syscall_ptr counting_get_system_call(sqlite3_vfs *vfs, const char *name)
+{
+    (void)vfs;
+    return real_vfs->xGetSystemCall(real_vfs, name);
+}
+
+static const char *counting_next_system_call(sqlite3_vfs *vfs, const char *name)
+{
+    (void)vfs;
+    return real_vfs->xNextSystemCall(real_vfs, name);
+}
+
+bool io_accounting_install(void)
+{
+    // again after sqlite3_shutdown(), initialization registers the built-in VFS as the default
+    if (real_vfs != NULL) {
+        return sqlite3_vfs_register(&counting_vfs, 1) == SQLITE_OK;
+    }
+
+    sqlite3_vfs *vfs = sqlite3_vfs_find(NULL);
+    if (vfs == NULL) {
+        BLTS_ERROR("No default sqlite VFS\n");
+        return false;
+    }
+
+    sqlite3_vfs counting = {
+        .iVersion = vfs->iVersion < 3 ? vfs->iVersion : 3,
+        .szOsFile = sizeof(counting_file) + vfs->szOsFile,
+        .mxPathname = vfs->mxPathname,
+        .zName = "blts-counting",
+        .xOpen = counting_open,
+        .xDelete = counting_delete,
+        .xAccess = counting_access,
+        .xFullPathname = counting_full_pathname,
+        .xDlOpen = counting_dl_open,
+        .xDlError = counting_dl_error,
+        .xDlSym = counting_dl_sym,
+        .xDlClose = counting_dl_close,
+        .xRandomness = counting_randomness,
+        .xSleep = counting_sleep,
+        .xCurrentTime = counting_current_time,
+        .xGetLastError = counting_get_last_error,
+        .xCurrentTimeInt64 = counting_current_time_int64,
+        .xSetSystemCall = counting_set_system_call,
+        .xGetSystemCall = counting_get_system_call,
+        .xNextSystemCall = counting_next_system_call,
+    };
+    counting_vfs = counting;
+    real_vfs = vfs;
+
+    int rc = sqlite3_vfs_register(&counting_vfs, 1);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("sqlite3_vfs_register() failed: %s\n", sqlite3_errstr(rc));
+        real_vfs = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Accounting of sections
+ */
+
+static bool read_proc_io(uint64_t *read_bytes, uint64_t *write_bytes)
+{
+    FILE *file = fopen("/proc/self/io", "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[128];
+    int n_found = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        n_found += sscanf(line, "read_bytes: %" SCNu64, read_bytes) == 1;
+        n_found += sscanf(line, "write_bytes: %" SCNu64, write_bytes) == 1;
+    }
+
+    fclose(file);
+
+    return n_found == 2;
+}
+
+static void take_snapshot(io_snapshot *snapshot)
+{
+    snapshot->vfs.reads = __atomic_load_n(&counters.reads, __ATOMIC_RELAXED);
+    snapshot->vfs.read_bytes = __atomic_load_n(&counters.read_bytes, __ATOMIC_RELAXED);
+    snapshot->vfs.writes = __atomic_load_n(&counters.writes, __ATOMIC_RELAXED);
+    snapshot->vfs.write_bytes = __atomic_load_n(&counters.write_bytes, __ATOMIC_RELAXED);
+    snapshot->vfs.syncs = __atomic_load_n(&counters.syncs, __ATOMIC_RELAXED);
+    snapshot->vfs.truncates = __atomic_load_n(&counters.truncates, __ATOMIC_RELAXED);
+
+    snapshot->have_proc_io = read_proc_io(&snapshot->storage_read_bytes,
+            &snapshot->storage_write_bytes);
+
+    getrusage(RUSAGE_SELF, &snapshot->usage);
+}
+
+void io_accounting_start(void)
+{
+    take_snapshot(&section_start);
+    section_end = section_start;
+    perf_counters_start();
+}
+
+void io_accounting_stop(void)
+{
+    perf_counters_stop();
+    take_snapshot(&section_end);
+}
+
+static double timeval_diff(const struct timeval *end, const struct timeval *start)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_usec - start->tv_usec) / 1e6;
+}
+
+void report_io_accounting(const char *tag_base)
+{
+    const io_snapshot *s = &section_start;
+    const io_snapshot *e = &section_end;
+
+    const struct {
+        char *tag;
+        double value;
+        char *unit;
+    } values[] = {
+        { "vfs_reads", e->vfs.reads - s->vfs.reads, "" },
+        { "vfs_read_bytes", e->vfs.read_bytes - s->vfs.read_bytes, "B" },
+        { "vfs_writes", e->vfs.writes - s->vfs.writes, "" },
+        { "vfs_write_bytes", e->vfs.write_bytes - s->vfs.write_bytes, "B" },
+        { "vfs_syncs", e->vfs.syncs - s->vfs.syncs, "" },
+        { "vfs_truncates", e->vfs.truncates - s->vfs.truncates, "" },
+        { "major_faults", e->usage.ru_majflt - s->usage.ru_majflt, "" },
+        { "minor_faults", e->usage.ru_minflt - s->usage.ru_minflt, "" },
+        { "voluntary_switches", e->usage.ru_nvcsw - s->usage.ru_nvcsw, "" },
+        { "involuntary_switches", e->usage.ru_nivcsw - s->usage.ru_nivcsw, "" },
+        { "user_cpu", timeval_diff(&e->usage.ru_utime, &s->usage.ru_utime), "s" },
+        { "sys_cpu", timeval_diff(&e->usage.ru_stime, &s->usage.ru_stime), "s" },
+    };
+
+    unsigned i;
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        report_extended_result(tag_base, values[i].tag, values[i].value, values[i].unit);
+    }
+
+    if (s->have_proc_io && e->have_proc_io) {
+        report_extended_result(tag_base, "storage_read_bytes",
+                e->storage_read_bytes - s->storage_read_bytes, "B");
+        report_extended_result(tag_base, "storage_write_bytes",
+                e->storage_write_bytes - s->storage_write_bytes, "B");
+    }
+
+    report_perf_counters(tag_base);
+}
@@ -0,0 +1,42 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IO_H
+#define IO_H
+
+#include <stdbool.h>
+
+/*
+ * I/O accounting of timed sections: calls into a counting VFS wrapped around the default one,
+ * storage I/O of the process as seen in /proc/self/io, resource usage from getrusage() and,
+ * where available, hardware performance counters (see perf.h).
+ */
+
+// registers the counting VFS as the default one, to be called before opening any database and
+// again whenever sqlite is reinitialized
+bool io_accounting_install(void);
+
+void io_accounting_start(void);
+void io_accounting_stop(void);
+
+// reports what was accounted between the last io_accounting_start() and io_accounting_stop()
+void report_io_accounting(const char *tag_base);
+
+#endif // IO_H
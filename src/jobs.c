@@ -0,0 +1,270 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Concurrent runs of a test case in child processes, see jobs.h. Each run writes its results to
+ * a temporary file of its own, replayed once all runs are done.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "jobs.h"
+#include "json.h"
+#include "report.h"
+
+typedef struct {
+    pid_t pid;
+    int slot;
+    FILE *results;
+    uint64_t start;
+    double wall_time;
+    long switches;
+    bool failed;
+} job;
+
+// number of CPUs the calling process may run on, 0 when unknown
+static int available_cpus(void)
+{
+    cpu_set_t cpus;
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+        BLTS_DEBUG("sched_getaffinity() failed: %s\n", strerror(errno));
+        return 0;
+    }
+
+    return CPU_COUNT(&cpus);
+}
+
+// pins the calling process to the slot-th of the CPUs it may run on, modulo their number
+static void pin_to_cpu(int slot)
+{
+    cpu_set_t cpus;
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+        BLTS_DEBUG("sched_getaffinity() failed: %s\n", strerror(errno));
+        return;
+    }
+
+    int n = slot % CPU_COUNT(&cpus);
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpus) && n-- == 0) {
+            break;
+        }
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        BLTS_DEBUG("sched_setaffinity() failed: %s\n", strerror(errno));
+    }
+}
+
+static bool start_job(job *j, int run_index, job_fn run, void *ctx)
+{
+    j->results = tmpfile();
+    if (j->results == NULL) {
+        BLTS_ERROR("tmpfile() failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    // or buffered output would be written by both processes
+    fflush(NULL);
+
+    j->start = histogram_now();
+    j->pid = fork();
+    if (j->pid < 0) {
+        BLTS_ERROR("fork() failed: %s\n", strerror(errno));
+        j->pid = 0;
+        return false;
+    }
+
+    if (j->pid == 0) {
+        pin_to_cpu(j->slot);
+        json_detach();
+        forward_results(fileno(j->results));
+        _exit(run(ctx, run_index, j->slot) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+// waits for one of the first n_jobs jobs to finish, returns its index or -1 on error
+static int wait_job(job *jobs, int n_jobs)
+{
+    struct rusage usage;
+    int status;
+    int i;
+
+    for (;;) {
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0 && errno == EINTR) {
+            continue;
+        }
+        if (pid < 0) {
+            BLTS_ERROR("wait4() failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < n_jobs && jobs[i].pid != pid; ++i) {
+        }
+        if (i == n_jobs) {
+            continue;
+        }
+
+        jobs[i].pid = 0;
+        jobs[i].wall_time = (histogram_now() - jobs[i].start) / 1e9;
+        jobs[i].switches = usage.ru_nivcsw;
+        jobs[i].failed = !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS;
+        return i;
+    }
+}
+
+int jobs_run(int n_jobs, int n_runs, job_fn run, void *ctx, jobs_stats *stats)
+{
+    // runs sharing a CPU would measure each other more than the code under test
+    int n_cpus = available_cpus();
+    if (n_cpus > 0 && n_jobs > n_cpus) {
+        BLTS_DEBUG("Running %d jobs at a time, as many as there are CPUs available\n", n_cpus);
+        n_jobs = n_cpus;
+    }
+
+    job *jobs = calloc(n_runs, sizeof(job));
+    bool *busy = calloc(n_jobs, sizeof(bool));
+    int n_started = 0;
+    int n_running = 0;
+    int rc = 0;
+    int i;
+
+    memset(stats, 0, sizeof(jobs_stats));
+
+    if (jobs == NULL || busy == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        rc = -1;
+        goto done;
+    }
+
+    // the reference run, alone
+    if (!start_job(&jobs[n_started++], 0, run, ctx) || wait_job(jobs, n_started) < 0) {
+        rc = -1;
+        goto done;
+    }
+
+    uint64_t parallel_start = histogram_now();
+
+    while (n_started < n_runs || n_running > 0) {
+        if (n_started < n_runs && n_running < n_jobs && rc == 0) {
+            for (i = 0; busy[i]; ++i) {
+            }
+            job *j = &jobs[n_started];
+            j->slot = i;
+            if (!start_job(j, n_started, run, ctx)) {
+                // wait for the running ones, but start no more
+                n_runs = n_started;
+                rc = -1;
+                continue;
+            }
+            busy[i] = true;
+            ++n_started;
+            ++n_running;
+            continue;
+        }
+
+        int finished = wait_job(jobs, n_started);
+        if (finished < 0) {
+            rc = -1;
+            goto done;
+        }
+        busy[jobs[finished].slot] = false;
+        --n_running;
+    }
+
+    double parallel_elapsed = (histogram_now() - parallel_start) / 1e9;
+
+    stats->solo_time = jobs[0].wall_time;
+    stats->solo_switches = jobs[0].switches;
+    for (i = 1; i < n_started; ++i) {
+        stats->parallel_time += jobs[i].wall_time / (n_started - 1);
+        stats->parallel_switches += (double)jobs[i].switches / (n_started - 1);
+        stats->speedup += jobs[i].wall_time / parallel_elapsed;
+    }
+
+done:
+    for (i = 0; jobs != NULL && i < n_started; ++i) {
+        if (jobs[i].failed) {
+            BLTS_ERROR("Run %d of %d failed\n", i + 1, n_runs);
+            rc = -1;
+        }
+        if (jobs[i].pid == 0 && jobs[i].results != NULL) {
+            rewind(jobs[i].results);
+            if (!replay_results(jobs[i].results)) {
+                BLTS_ERROR("Failed to read results of run %d\n", i + 1);
+                rc = -1;
+            }
+        }
+        if (jobs[i].results != NULL) {
+            fclose(jobs[i].results);
+        }
+    }
+
+    free(busy);
+    free(jobs);
+
+    return rc;
+}
+
+double jobs_interference(const jobs_stats *stats)
+{
+    if (stats->solo_time <= 0 || stats->parallel_time <= 0) {
+        return 0;
+    }
+
+    return (stats->parallel_time / stats->solo_time - 1) * 100;
+}
+
+void report_jobs(const char *tag_base, const jobs_stats *stats)
+{
+    char jobs_tag_base[TAG_MAX];
+    format_tag(jobs_tag_base, tag_base, "jobs");
+
+    if (stats->solo_time <= 0 || stats->parallel_time <= 0) {
+        return;
+    }
+
+    report_extended_result(jobs_tag_base, "solo_time", stats->solo_time, "s");
+    report_extended_result(jobs_tag_base, "parallel_time", stats->parallel_time, "s");
+    report_extended_result(jobs_tag_base, "interference", jobs_interference(stats), "%");
+    report_extended_result(jobs_tag_base, "solo_involuntary_switches", stats->solo_switches, "");
+    report_extended_result(jobs_tag_base, "parallel_involuntary_switches",
+            stats->parallel_switches, "");
+    report_extended_result(jobs_tag_base, "speedup", stats->speedup, "");
+}
@@ -0,0 +1,59 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/*
+ * Concurrent runs of a test case, each in a child process of its own pinned to one of the CPUs
+ * the process may run on. Results of the runs are forwarded to the parent (see
+ * forward_results()) and reported there in the order of the runs as if they had been run one
+ * after another.
+ *
+ * The first run is done alone, as a reference for how much slower the runs are when sharing the
+ * machine with each other.
+ */
+
+typedef int (*job_fn)(void *ctx, int run, int slot);
+
+typedef struct {
+    // wall time of the first run
+    double solo_time;
+    // mean wall time of the others
+    double parallel_time;
+    // mean involuntary context switches of the first run and of the others
+    double solo_switches;
+    double parallel_switches;
+    // sum of the wall times of the runs divided by the time it took to complete all of them
+    double speedup;
+} jobs_stats;
+
+// calls run(ctx, run, slot) for run 0 to n_runs - 1, up to n_jobs (but no more than there are
+// CPUs available) at a time; slot is less than n_jobs and not used by any other run at the same
+// time; returns 0 if all runs returned 0
+int jobs_run(int n_jobs, int n_runs, job_fn run, void *ctx, jobs_stats *stats);
+
+// how many percents longer the runs done in parallel took than the first one, 0 if unknown
+double jobs_interference(const jobs_stats *stats);
+
+// reports stats as '<tag_base>.jobs.*'
+void report_jobs(const char *tag_base, const jobs_stats *stats);
+
+#endif // JOBS_H
@@ -0,0 +1,448 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <mntent.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <sys/sysinfo.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "json.h"
+
+static FILE *json_file = NULL;
+static bool first_result = true;
+// nesting level of the object written by write_key()
+static int depth = 0;
+
+static void write_string(const char *value)
+{
+    if (value == NULL) {
+        fputs("null", json_file);
+        return;
+    }
+
+    fputc('"', json_file);
+    for (; *value != '\0'; ++value) {
+        unsigned char c = *value;
+        if (c == '"' || c == '\\') {
+            fprintf(json_file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(json_file, "\\u%04x", c);
+        } else {
+            fputc(c, json_file);
+        }
+    }
+    fputc('"', json_file);
+}
+
+static void write_number(double value)
+{
+    if (isfinite(value)) {
+        fprintf(json_file, "%.15g", value);
+    } else {
+        fputs("null", json_file);
+    }
+}
+
+static void begin_object(void)
+{
+    fputs("{", json_file);
+    ++depth;
+}
+
+static void end_object(void)
+{
+    --depth;
+    fprintf(json_file, "\n%*s}", 2 * depth, "");
+}
+
+// writes '"key": ' preceded by a separator unless first
+static void write_key(const char *key, bool first)
+{
+    fprintf(json_file, "%s\n%*s", first ? "" : ",", 2 * depth, "");
+    write_string(key);
+    fputs(": ", json_file);
+}
+
+// reads the first line of a file with the trailing newline removed
+static bool read_line(const char *path, char *line, int size)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fgets(line, size, file) != NULL;
+    fclose(file);
+    if (ok) {
+        line[strcspn(line, "\n")] = '\0';
+    }
+
+    return ok;
+}
+
+// value of the first '<key> : <value>' line of /proc/cpuinfo with one of the given keys
+static bool read_cpu_model(char *model, int size)
+{
+    static const char *const keys[] = { "model name", "Hardware", "Processor", "cpu model" };
+    char line[256];
+    bool found = false;
+    unsigned i;
+
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]) && !found; ++i) {
+        FILE *file = fopen("/proc/cpuinfo", "r");
+        if (file == NULL) {
+            return false;
+        }
+
+        while (!found && fgets(line, sizeof(line), file) != NULL) {
+            size_t key_len = strlen(keys[i]);
+            char *colon = strchr(line, ':');
+            if (colon == NULL || strncmp(line, keys[i], key_len) != 0
+                    || strspn(line + key_len, " \t") != (size_t)(colon - line - key_len)) {
+                continue;
+            }
+
+            snprintf(model, size, "%s", colon + 1 + strspn(colon + 1, " \t"));
+            model[strcspn(model, "\n")] = '\0';
+            found = true;
+        }
+
+        fclose(file);
+    }
+
+    return found;
+}
+
+// the mount entry with the longest mount point containing path
+static bool find_mount(const char *path, char *fs_type, int size)
+{
+    FILE *mounts = setmntent("/proc/self/mounts", "r");
+    if (mounts == NULL) {
+        return false;
+    }
+
+    size_t best_len = 0;
+    struct mntent *entry;
+    while ((entry = getmntent(mounts)) != NULL) {
+        size_t len = strlen(entry->mnt_dir);
+        bool contains = strncmp(path, entry->mnt_dir, len) == 0
+            && (path[len] == '/' || path[len] == '\0' || strcmp(entry->mnt_dir, "/") == 0);
+        if (contains && len >= best_len) {
+            best_len = len;
+            snprintf(fs_type, size, "%s", entry->mnt_type);
+        }
+    }
+
+    endmntent(mounts);
+
+    return best_len > 0;
+}
+
+static void write_storage(const char *db_file)
+{
+    char dir[PATH_MAX];
+    char real_dir[PATH_MAX];
+    char fs_type[64];
+
+    if (db_is_in_memory(db_file)) {
+        fputs("null", json_file);
+        return;
+    }
+
+    snprintf(dir, sizeof(dir), "%s", db_file);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else if (slash == dir) {
+        dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+
+    begin_object();
+
+    write_key("directory", true);
+    write_string(realpath(dir, real_dir) != NULL ? real_dir : dir);
+
+    write_key("filesystem", false);
+    write_string(realpath(dir, real_dir) != NULL && find_mount(real_dir, fs_type, sizeof(fs_type))
+            ? fs_type : NULL);
+
+    struct statvfs vfs;
+    bool have_vfs = statvfs(dir, &vfs) == 0;
+    write_key("free_bytes", false);
+    write_number(have_vfs ? (double)vfs.f_bavail * vfs.f_frsize : NAN);
+    write_key("total_bytes", false);
+    write_number(have_vfs ? (double)vfs.f_blocks * vfs.f_frsize : NAN);
+
+    end_object();
+}
+
+// effective values of the configuration pragmas on a connection opened the way test cases do,
+// to a scratch database next to db_file so that the user's one is left alone
+static void write_db_config(const char *db_file)
+{
+    static const char *const pragmas[] = {
+        "page_size", "journal_mode", "synchronous", "cache_size", "mmap_size", "temp_store",
+        "locking_mode",
+    };
+    char config_file[PATH_MAX];
+    sqlite3 *db = NULL;
+    unsigned i;
+
+    int n_written = db_is_in_memory(db_file) ? snprintf(config_file, PATH_MAX, "%s", db_file)
+        : snprintf(config_file, PATH_MAX, "%s.config", db_file);
+    if (n_written >= PATH_MAX || !db_open_truncate(&db, config_file)) {
+        db_close(db);
+        fputs("null", json_file);
+        return;
+    }
+
+    begin_object();
+
+    for (i = 0; i < sizeof(pragmas) / sizeof(pragmas[0]); ++i) {
+        char sql[SQL_MAX];
+        sql_sprintf(sql, "PRAGMA %s", pragmas[i]);
+
+        sqlite3_stmt *stmt = NULL;
+        const char *value = NULL;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK
+                && sqlite3_step(stmt) == SQLITE_ROW) {
+            value = (const char *)sqlite3_column_text(stmt, 0);
+        }
+
+        write_key(pragmas[i], i == 0);
+        write_string(value);
+        sqlite3_finalize(stmt);
+    }
+
+    end_object();
+
+    db_close(db);
+    if (!db_is_in_memory(config_file)) {
+        db_remove(config_file);
+    }
+}
+
+static void write_environment(const char *db_file)
+{
+    char buf[256];
+    int i;
+
+    begin_object();
+
+    write_key("sqlite_version", true);
+    write_string(sqlite3_libversion());
+    write_key("sqlite_source_id", false);
+    write_string(sqlite3_sourceid());
+
+    write_key("sqlite_compile_options", false);
+    fputs("[", json_file);
+    const char *option;
+    for (i = 0; (option = sqlite3_compileoption_get(i)) != NULL; ++i) {
+        fputs(i ? ", " : "", json_file);
+        write_string(option);
+    }
+    fputs("]", json_file);
+
+    write_key("db_file", false);
+    write_string(db_file);
+    write_key("db_config", false);
+    write_db_config(db_file);
+    write_key("storage", false);
+    write_storage(db_file);
+
+    write_key("cpu_model", false);
+    write_string(read_cpu_model(buf, sizeof(buf)) ? buf : NULL);
+    write_key("cpu_count", false);
+    write_number(sysconf(_SC_NPROCESSORS_ONLN));
+    write_key("cpu_governor", false);
+    write_string(read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", buf,
+                sizeof(buf)) ? buf : NULL);
+
+    struct sysinfo info;
+    bool have_info = sysinfo(&info) == 0;
+    write_key("memory_total_bytes", false);
+    write_number(have_info ? (double)info.totalram * info.mem_unit : NAN);
+    write_key("memory_free_bytes", false);
+    write_number(have_info ? (double)info.freeram * info.mem_unit : NAN);
+
+    struct utsname uts;
+    bool have_uts = uname(&uts) == 0;
+    write_key("hostname", false);
+    write_string(have_uts ? uts.nodename : NULL);
+    write_key("kernel", false);
+    write_string(have_uts ? uts.release : NULL);
+    write_key("machine", false);
+    write_string(have_uts ? uts.machine : NULL);
+
+    end_object();
+}
+
+bool json_open(const char *path, int argc, char **argv, const char *db_file)
+{
+    int i;
+
+    json_file = fopen(path, "w");
+    if (json_file == NULL) {
+        BLTS_ERROR("%s: Failed to open: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char start_time[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(start_time, sizeof(start_time), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+
+    depth = 0;
+    begin_object();
+
+    write_key("format_version", true);
+    write_number(1);
+    write_key("start_time", false);
+    write_string(start_time);
+
+    write_key("command_line", false);
+    fputs("[", json_file);
+    for (i = 0; i < argc; ++i) {
+        fputs(i ? ", " : "", json_file);
+        write_string(argv[i]);
+    }
+    fputs("]", json_file);
+
+    write_key("environment", false);
+    write_environment(db_file);
+
+    write_key("results", false);
+    fputs("[", json_file);
+    first_result = true;
+    fflush(json_file);
+
+    return true;
+}
+
+static void begin_result(const char *full_tag, const char *unit)
+{
+    fprintf(json_file, "%s\n    {\"tag\": ", first_result ? "" : ",");
+    write_string(full_tag);
+    fputs(", \"unit\": ", json_file);
+    write_string(unit);
+    first_result = false;
+}
+
+void json_result(const char *full_tag, const char *unit, double value)
+{
+    if (json_file == NULL) {
+        return;
+    }
+
+    begin_result(full_tag, unit);
+    fputs(", \"value\": ", json_file);
+    write_number(value);
+    fputs("}", json_file);
+    fflush(json_file);
+}
+
+void json_summary(const char *full_tag, const char *unit, const sample_stats *stats,
+        const double *values)
+{
+    const struct {
+        const char *key;
+        double value;
+    } fields[] = {
+        { "value", stats->mean },
+        { "stddev", stats->stddev },
+        { "median", stats->median },
+        { "min", stats->min },
+        { "max", stats->max },
+        { "ci95", stats->ci95 },
+    };
+    unsigned i;
+    int j;
+
+    if (json_file == NULL) {
+        return;
+    }
+
+    begin_result(full_tag, unit);
+
+    fprintf(json_file, ", \"iterations\": %d", stats->n);
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        fprintf(json_file, ", \"%s\": ", fields[i].key);
+        write_number(fields[i].value);
+    }
+
+    fputs(", \"values\": [", json_file);
+    for (j = 0; j < stats->n; ++j) {
+        fputs(j ? ", " : "", json_file);
+        write_number(values[j]);
+    }
+    fputs("]}", json_file);
+    fflush(json_file);
+}
+
+void json_annotation(const char *full_tag, const char *key, const char *text)
+{
+    if (json_file == NULL) {
+        return;
+    }
+
+    fprintf(json_file, "%s\n    {\"tag\": ", first_result ? "" : ",");
+    write_string(full_tag);
+    fputs(", ", json_file);
+    write_string(key);
+    fputs(": ", json_file);
+    write_string(text);
+    fputs("}", json_file);
+    first_result = false;
+    fflush(json_file);
+}
+
+void json_close(void)
+{
+    if (json_file == NULL) {
+        return;
+    }
+
+    fputs("\n  ]", json_file);
+    end_object();
+    fputs("\n", json_file);
+    if (fclose(json_file) != 0) {
+        BLTS_ERROR("Failed to write JSON results: %s\n", strerror(errno));
+    }
+    json_file = NULL;
+}
+
+void json_detach(void)
+{
+    json_file = NULL;
+}
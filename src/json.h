@@ -0,0 +1,49 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+
+#include "stats.h"
+
+/*
+ * Results sink writing a JSON document describing the run: the command line, the environment
+ * (sqlite version and compile options, effective database configuration, file system and free
+ * space of the database location, CPU, memory, kernel) and every result reported, along with
+ * annotations of results.
+ *
+ * Results are appended as they are reported, the document is complete once json_close() is
+ * called.
+ */
+
+bool json_open(const char *path, int argc, char **argv, const char *db_file);
+void json_result(const char *full_tag, const char *unit, double value);
+// a result summarized over stats->n iterations, values are in the order they were measured
+void json_summary(const char *full_tag, const char *unit, const sample_stats *stats,
+        const double *values);
+// text attached to the results under full_tag, e.g. the query plan they were measured with
+void json_annotation(const char *full_tag, const char *key, const char *text);
+void json_close(void);
+// forgets the document without completing it, in a child process sharing it with its parent
+void json_detach(void);
+
+#endif // JSON_H
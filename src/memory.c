@@ -0,0 +1,243 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+#include "memory.h"
+#include "pool.h"
+#include "report.h"
+
+// buffers handed over to sqlite by the current configuration
+static void *pagecache_buffer = NULL;
+static void *heap_buffer = NULL;
+static bool heap_configured = false;
+
+// the allocator in effect before the first memory_configure() and the one wrapped now
+static sqlite3_mem_methods system_methods;
+static bool have_system_methods = false;
+static sqlite3_mem_methods wrapped_methods;
+static uint64_t n_allocations = 0;
+
+static void *counting_malloc(int n)
+{
+    __atomic_add_fetch(&n_allocations, 1, __ATOMIC_RELAXED);
+    return wrapped_methods.xMalloc(n);
+}
+
+static void counting_free(void *p)
+{
+    wrapped_methods.xFree(p);
+}
+
+static void *counting_realloc(void *p, int n)
+{
+    __atomic_add_fetch(&n_allocations, 1, __ATOMIC_RELAXED);
+    return wrapped_methods.xRealloc(p, n);
+}
+
+static int counting_size(void *p)
+{
+    return wrapped_methods.xSize(p);
+}
+
+static int counting_roundup(int n)
+{
+    return wrapped_methods.xRoundup(n);
+}
+
+static int counting_init(void *app_data)
+{
+    (void)app_data;
+    return wrapped_methods.xInit(wrapped_methods.pAppData);
+}
+
+static void counting_shutdown(void *app_data)
+{
+    (void)app_data;
+    wrapped_methods.xShutdown(wrapped_methods.pAppData);
+}
+
+static const sqlite3_mem_methods counting_methods = {
+    counting_malloc, counting_free, counting_realloc, counting_size, counting_roundup,
+    counting_init, counting_shutdown, NULL
+};
+
+static void reset_peak_rss(void)
+{
+    // '5' resets the peak resident set size (VmHWM), since Linux 4.0
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file != NULL) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+static bool read_peak_rss(double *bytes)
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[128];
+    uint64_t kib;
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        found = sscanf(line, "VmHWM: %" SCNu64 " kB", &kib) == 1;
+    }
+    fclose(file);
+
+    if (found) {
+        *bytes = kib * 1024.0;
+    }
+
+    return found;
+}
+
+static bool config_rc(int rc, const char *option)
+{
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("sqlite3_config(%s) failed: %s\n", option, sqlite3_errstr(rc));
+        return false;
+    }
+
+    return true;
+}
+
+bool memory_configure(const memory_config *config)
+{
+    int rc = sqlite3_shutdown();
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("sqlite3_shutdown() failed: %s\n", sqlite3_errstr(rc));
+        return false;
+    }
+
+    free(pagecache_buffer);
+    free(heap_buffer);
+    pagecache_buffer = NULL;
+    heap_buffer = NULL;
+
+    bool ok = config_rc(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1), "SQLITE_CONFIG_MEMSTATUS");
+
+    if (ok && !have_system_methods) {
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &system_methods),
+                "SQLITE_CONFIG_GETMALLOC");
+        have_system_methods = ok;
+    }
+
+    if (ok && heap_configured) {
+        // leave memsys5, the allocator is set below
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_HEAP, NULL, 0, 0), "SQLITE_CONFIG_HEAP");
+        heap_configured = !ok;
+    }
+
+    if (ok) {
+        switch (config->allocator) {
+        case ALLOCATOR_SYSTEM:
+            wrapped_methods = system_methods;
+            break;
+        case ALLOCATOR_MEMSYS5: {
+            long heap_bytes = config->heap_bytes ? config->heap_bytes : DEFAULT_HEAP_BYTES;
+            heap_buffer = malloc(heap_bytes);
+            // minimum allocation size of 64 bytes as recommended for memsys5
+            ok = heap_buffer != NULL && config_rc(sqlite3_config(SQLITE_CONFIG_HEAP, heap_buffer,
+                        (int)heap_bytes, 64), "SQLITE_CONFIG_HEAP");
+            heap_configured = ok;
+            ok = ok && config_rc(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &wrapped_methods),
+                    "SQLITE_CONFIG_GETMALLOC");
+            break;
+        }
+        case ALLOCATOR_POOL:
+            wrapped_methods = *pool_mem_methods();
+            break;
+        }
+    }
+
+    if (ok) {
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_MALLOC, &counting_methods),
+                "SQLITE_CONFIG_MALLOC");
+    }
+
+    if (ok && config->pagecache_bytes > 0) {
+        int header_size = 0;
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &header_size),
+                "SQLITE_CONFIG_PCACHE_HDRSZ");
+
+        int slot_size = config->page_size + header_size;
+        int n_slots = config->pagecache_bytes / slot_size;
+        pagecache_buffer = ok ? malloc((size_t)slot_size * n_slots) : NULL;
+        ok = pagecache_buffer != NULL && config_rc(sqlite3_config(SQLITE_CONFIG_PAGECACHE,
+                    pagecache_buffer, slot_size, n_slots), "SQLITE_CONFIG_PAGECACHE");
+    } else if (ok) {
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_PAGECACHE, NULL, 0, 0),
+                "SQLITE_CONFIG_PAGECACHE");
+    }
+
+    if (ok && config->lookaside_slot_size > 0) {
+        ok = config_rc(sqlite3_config(SQLITE_CONFIG_LOOKASIDE, config->lookaside_slot_size,
+                    config->lookaside_slots), "SQLITE_CONFIG_LOOKASIDE");
+    }
+
+    rc = sqlite3_initialize();
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("sqlite3_initialize() failed: %s\n", sqlite3_errstr(rc));
+        return false;
+    }
+
+    int current, highwater;
+    sqlite3_memory_highwater(1);
+    sqlite3_status(SQLITE_STATUS_PAGECACHE_USED, &current, &highwater, 1);
+    sqlite3_status(SQLITE_STATUS_PAGECACHE_OVERFLOW, &current, &highwater, 1);
+    __atomic_store_n(&n_allocations, 0, __ATOMIC_RELAXED);
+    reset_peak_rss();
+
+    // initialization makes the built-in VFS the default again
+    return ok && io_accounting_install();
+}
+
+void report_memory_usage(const char *tag_base)
+{
+    report_extended_result(tag_base, "memory_highwater", sqlite3_memory_highwater(1), "B");
+
+    int current, highwater;
+    if (sqlite3_status(SQLITE_STATUS_PAGECACHE_USED, &current, &highwater, 1) == SQLITE_OK) {
+        report_extended_result(tag_base, "pagecache_used", highwater, "");
+    }
+    if (sqlite3_status(SQLITE_STATUS_PAGECACHE_OVERFLOW, &current, &highwater, 1) == SQLITE_OK) {
+        report_extended_result(tag_base, "pagecache_overflow", highwater, "B");
+    }
+
+    double peak_rss;
+    if (read_peak_rss(&peak_rss)) {
+        report_extended_result(tag_base, "peak_rss", peak_rss, "B");
+    }
+    reset_peak_rss();
+
+    report_extended_result(tag_base, "allocations",
+            __atomic_exchange_n(&n_allocations, 0, __ATOMIC_RELAXED), "");
+}
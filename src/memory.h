@@ -0,0 +1,68 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdbool.h>
+
+/*
+ * Process wide sqlite memory configuration. Applied by shutting sqlite down, calling
+ * sqlite3_config() and initializing it again, so no connection may be open at that time.
+ * Memory statistics are always enabled so that sqlite3_memory_highwater() can be reported, the
+ * high-water marks are reset by memory_configure().
+ */
+
+typedef enum {
+    ALLOCATOR_SYSTEM,
+    // sqlite's memsys5 on a SQLITE_CONFIG_HEAP buffer of heap_bytes
+    ALLOCATOR_MEMSYS5,
+    // see pool.h
+    ALLOCATOR_POOL,
+} allocator;
+
+typedef struct {
+    allocator allocator;
+    // size of the buffer given to SQLITE_CONFIG_PAGECACHE, 0 lets sqlite allocate pages itself
+    long pagecache_bytes;
+    // page size the page cache buffer is divided for
+    int page_size;
+    // size of the buffer given to SQLITE_CONFIG_HEAP, DEFAULT_HEAP_BYTES when 0
+    long heap_bytes;
+    // SQLITE_CONFIG_LOOKASIDE, the setting in effect is kept when 0
+    int lookaside_slot_size;
+    int lookaside_slots;
+} memory_config;
+
+enum { DEFAULT_HEAP_BYTES = 64 * 1024 * 1024 };
+
+// all allocators are wrapped to count allocations reported by report_memory_usage()
+bool memory_configure(const memory_config *config);
+
+/*
+ * Reports and resets the high-water marks of sqlite3_memory_highwater(), pages used in the page
+ * cache buffer, bytes of page cache allocations that did not fit in it and the resident set size
+ * of the process (where /proc/self/clear_refs allows resetting it), and the number of allocations
+ * as '<tag_base>.memory_highwater', '.pagecache_used', '.pagecache_overflow', '.peak_rss' and
+ * '.allocations'.
+ */
+void report_memory_usage(const char *tag_base);
+
+#endif // MEMORY_H
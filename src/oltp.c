@@ -0,0 +1,408 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Mixed OLTP workload: a stream of point selects and range scans by key, updates, inserts and
+ * deletes drawn at random in given proportions, grouped in transactions of a given number of
+ * operations, on a table of sequential keys. Inserts append new keys and deletes remove the
+ * oldest ones, other operations pick keys from the live range uniformly, by a (scrambled) zipfian
+ * distribution or favouring the latest keys. Latencies are reported for each operation type under
+ * '<tag_base>.<op>' and over all operations under tag_base itself, commits under
+ * '<tag_base>.commit'. Statements are always prepared, as an application would do.
+ *
+ * With test_opts.duration the workload runs for a fixed time instead of a fixed number of
+ * operations. With test_opts.rate it runs open loop: operations are due at a constant rate no
+ * matter how long the previous ones took, and latency is measured from when an operation was due
+ * rather than when it actually started, so that stalls are not hidden by the operations they
+ * delayed (coordinated omission).
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <blts_timing.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "fixture.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+
+// rows visited by a range scan
+enum { RANGE_SCAN_ROWS = 100 };
+
+// skew of the zipfian distributions, as in YCSB
+static const double ZIPFIAN_THETA = 0.99;
+
+const char *const oltp_op_names[OLTP_OPS] = {
+    "point_select", "range_select", "update", "insert", "delete"
+};
+
+static const char *const op_sql[OLTP_OPS] = {
+    "SELECT b, c FROM t1 WHERE a = ?1;",
+    "SELECT count(*), avg(b) FROM t1 WHERE a >= ?1 AND a < ?2;",
+    "UPDATE t1 SET b = ?2 WHERE a = ?1;",
+    "INSERT INTO t1 VALUES(?1, ?2, ?3);",
+    "DELETE FROM t1 WHERE a = ?1;",
+};
+
+typedef struct {
+    uint64_t state;
+    oltp_keys distribution;
+    // live keys are [first_key, next_key)
+    int first_key;
+    int next_key;
+    // zipfian generator (Gray et al., "Quickly Generating Billion-Record Synthetic Databases")
+    // over the initial number of keys
+    int n_items;
+    double alpha;
+    double zetan;
+    double eta;
+} key_chooser;
+
+static double zeta(int n, double theta)
+{
+    double sum = 0;
+    int i;
+
+    for (i = 1; i <= n; ++i) {
+        sum += 1 / pow(i, theta);
+    }
+
+    return sum;
+}
+
+static void key_chooser_init(key_chooser *k, oltp_keys distribution, int n_keys)
+{
+    k->state = generator_seed();
+    k->distribution = distribution;
+    k->first_key = 0;
+    k->next_key = n_keys;
+    k->n_items = n_keys;
+
+    if (distribution != OLTP_KEYS_UNIFORM && n_keys >= 2) {
+        k->alpha = 1 / (1 - ZIPFIAN_THETA);
+        k->zetan = zeta(n_keys, ZIPFIAN_THETA);
+        k->eta = (1 - pow(2.0 / n_keys, 1 - ZIPFIAN_THETA))
+            / (1 - zeta(2, ZIPFIAN_THETA) / k->zetan);
+    }
+}
+
+static double uniform_random(uint64_t *state)
+{
+    return (generator_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+// rank 0 is the most popular one
+static int zipfian_rank(key_chooser *k)
+{
+    if (k->n_items < 2) {
+        return 0;
+    }
+
+    double u = uniform_random(&k->state);
+    double uz = u * k->zetan;
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < 1 + pow(0.5, ZIPFIAN_THETA)) {
+        return 1;
+    }
+
+    return k->n_items * pow(k->eta * u - k->eta + 1, k->alpha);
+}
+
+// FNV-1a, spreads popular ranks over the key range instead of clustering them at its start
+static uint64_t scramble(uint64_t value)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static int choose_key(key_chooser *k)
+{
+    int n_live = k->next_key - k->first_key;
+    if (n_live <= 0) {
+        return k->first_key;
+    }
+
+    switch (k->distribution) {
+    case OLTP_KEYS_ZIPFIAN:
+        return k->first_key + scramble(zipfian_rank(k)) % n_live;
+    case OLTP_KEYS_LATEST:
+        return k->next_key - 1 - zipfian_rank(k) % n_live;
+    default:
+        return k->first_key + generator_random(&k->state) % n_live;
+    }
+}
+
+static oltp_op choose_op(const oltp_workload *workload, int total_weight, uint64_t *state)
+{
+    int roll = generator_random(state) % total_weight;
+    int op;
+
+    for (op = 0; op < OLTP_OPS - 1; ++op) {
+        roll -= workload->weights[op];
+        if (roll < 0) {
+            break;
+        }
+    }
+
+    return op;
+}
+
+static bool exec_op(sqlite3_stmt *stmt, oltp_op op, key_chooser *keys, row_generator *rows)
+{
+    const generated_row *row;
+    int key;
+
+    switch (op) {
+    case OLTP_POINT_SELECT:
+        sqlite3_bind_int(stmt, 1, choose_key(keys));
+        break;
+    case OLTP_RANGE_SELECT:
+        key = choose_key(keys);
+        sqlite3_bind_int(stmt, 1, key);
+        sqlite3_bind_int(stmt, 2, key + RANGE_SCAN_ROWS);
+        break;
+    case OLTP_UPDATE:
+        row = row_generator_next(rows);
+        sqlite3_bind_int(stmt, 1, choose_key(keys));
+        sqlite3_bind_int(stmt, 2, row->row.number);
+        break;
+    case OLTP_INSERT:
+        row = row_generator_next(rows);
+        sqlite3_bind_int(stmt, 1, keys->next_key++);
+        sqlite3_bind_int(stmt, 2, row->row.number);
+        sqlite3_bind_text(stmt, 3, row->row.string, -1, SQLITE_STATIC);
+        break;
+    case OLTP_DELETE:
+        sqlite3_bind_int(stmt, 1, keys->first_key);
+        if (keys->first_key < keys->next_key) {
+            ++keys->first_key;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    return db_step_reset(stmt);
+}
+
+// sleeps until the given histogram_now() time
+static void sleep_until(uint64_t due)
+{
+    struct timespec ts = { .tv_sec = due / 1000000000, .tv_nsec = due % 1000000000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static bool commit(sqlite3 *db, histogram *commits)
+{
+    uint64_t start = histogram_now();
+    if (!db_commit_transaction(db)) {
+        return false;
+    }
+    histogram_record(commits, histogram_now() - start);
+
+    return true;
+}
+
+int test_oltp(const char *tag_base, const char *db_file, int table_size, int n_ops,
+        const oltp_workload *workload)
+{
+    BLTS_DEBUG("START %s(table_size=%d, n_ops=%d, transaction_ops=%d, duration=%g, rate=%g)\n",
+            __FUNCTION__, table_size, n_ops, workload->transaction_ops, test_opts.duration,
+            test_opts.rate);
+
+    int retv = EXIT_FAILURE;
+    int i;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmts[OLTP_OPS] = { NULL };
+    histogram *latencies[OLTP_OPS] = { NULL };
+    histogram *all = histogram_create();
+    histogram *commits = histogram_create();
+    key_chooser keys;
+    int total_weight = 0;
+    int n_transactions = 0;
+    bool in_transaction = false;
+
+    bool timed = test_opts.duration > 0;
+
+    // rows for inserts and updates
+    row_generator *rows = row_generator_create(table_size, timed ? INT_MAX - table_size : n_ops,
+            NULL);
+
+    for (i = 0; i < OLTP_OPS; ++i) {
+        latencies[i] = histogram_create();
+        if (latencies[i] == NULL) {
+            goto fail;
+        }
+        total_weight += workload->weights[i];
+    }
+
+    if (all == NULL || commits == NULL || rows == NULL) {
+        goto fail;
+    }
+
+    if (total_weight <= 0) {
+        BLTS_ERROR("%s: Empty operation mix\n", __FUNCTION__);
+        goto fail;
+    }
+
+    static const fixture t1_i1a = { { "t1" }, { "i1a on t1(a)" } };
+    if (!db_open_fixture(&db, db_file, &t1_i1a, table_size)) {
+        goto fail;
+    }
+
+    if (test_opts.cold && !db_reopen_cold(&db, db_file, tag_base)) {
+        goto fail;
+    }
+
+    for (i = 0; i < OLTP_OPS; ++i) {
+        if (workload->weights[i] > 0 && !db_prepare(db, &stmts[i], op_sql[i])) {
+            goto fail;
+        }
+    }
+
+    key_chooser_init(&keys, workload->keys, table_size);
+    uint64_t op_state = generator_seed();
+
+    db_reset_status(db);
+    io_accounting_start();
+    timing_start();
+
+    uint64_t start = histogram_now();
+    uint64_t deadline = start + (uint64_t)(test_opts.duration * 1e9);
+    double interval = test_opts.rate > 0 ? 1e9 / test_opts.rate : 0;
+
+    // time spent generating test data is excluded from both latencies and elapsed time
+    for (i = 0; timed ? histogram_now() < deadline : i < n_ops; ++i) {
+        uint64_t op_start = histogram_now();
+        if (interval > 0) {
+            uint64_t due = start + (uint64_t)(i * interval);
+            if (timed && due >= deadline) {
+                break;
+            }
+            if (due > op_start) {
+                sleep_until(due);
+            }
+            op_start = due;
+        }
+
+        if (workload->transaction_ops > 1 && !in_transaction) {
+            if (!db_begin_transaction(db)) {
+                goto fail;
+            }
+            in_transaction = true;
+        }
+
+        oltp_op op = choose_op(workload, total_weight, &op_state);
+        uint64_t overhead_start = rows->overhead_ns;
+        if (!exec_op(stmts[op], op, &keys, rows)) {
+            goto fail;
+        }
+        uint64_t latency = histogram_now() - op_start - (rows->overhead_ns - overhead_start);
+        histogram_record(latencies[op], latency);
+
+        if (in_transaction && (i + 1) % workload->transaction_ops == 0) {
+            if (!commit(db, commits)) {
+                goto fail;
+            }
+            in_transaction = false;
+            ++n_transactions;
+        } else if (!in_transaction) {
+            ++n_transactions;
+        }
+    }
+
+    if (in_transaction) {
+        if (!commit(db, commits)) {
+            goto fail;
+        }
+        in_transaction = false;
+        ++n_transactions;
+    }
+
+    timing_stop();
+    io_accounting_stop();
+
+    double elapsed = timing_elapsed() - row_generator_overhead(rows);
+
+    report_extended_result(tag_base, "elapsed", elapsed, "s");
+    report_extended_result(tag_base, "generator_overhead", row_generator_overhead(rows), "s");
+    report_io_accounting(tag_base);
+    db_report_status(tag_base, db);
+
+    for (i = 0; i < OLTP_OPS; ++i) {
+        char op_tag_base[TAG_MAX];
+        format_tag(op_tag_base, tag_base, oltp_op_names[i]);
+        report_latencies(op_tag_base, latencies[i], elapsed);
+        histogram_merge(all, latencies[i]);
+    }
+
+    char commit_tag_base[TAG_MAX];
+    format_tag(commit_tag_base, tag_base, "commit");
+    report_latencies(commit_tag_base, commits, 0);
+
+    report_latencies(tag_base, all, elapsed);
+    if (elapsed > 0) {
+        report_extended_result(tag_base, "transactions_per_sec", n_transactions / elapsed, "1/s");
+    }
+    if (test_opts.rate > 0) {
+        report_extended_result(tag_base, "target_ops_per_sec", test_opts.rate, "1/s");
+        if (elapsed > 0) {
+            report_extended_result(tag_base, "rate_achieved",
+                    all->count / elapsed / test_opts.rate * 100, "%");
+        }
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    if (in_transaction) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    for (i = 0; i < OLTP_OPS; ++i) {
+        sqlite3_finalize(stmts[i]);
+        histogram_destroy(latencies[i]);
+    }
+    db_close(db);
+    histogram_destroy(all);
+    histogram_destroy(commits);
+    row_generator_destroy(rows);
+
+    return retv;
+}
@@ -0,0 +1,207 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The counters form one perf event group so that they are scheduled onto the PMU together and
+ * their ratios are meaningful. When the group has to share the PMU with other events, counts are
+ * scaled by the time the group was enabled over the time it actually ran.
+ *
+ * The group is opened on first use and again after a fork(), as it counts the thread that
+ * opened it.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "report.h"
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_COUNTERS
+} perf_counter;
+
+static const struct {
+    char *tag;
+    char *per_op_tag;
+    uint32_t type;
+    uint64_t config;
+} counter_events[PERF_COUNTERS] = {
+    { "cycles", "cycles_per_op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", "instructions_per_op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache_misses", "cache_misses_per_op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch_misses", "branch_misses_per_op", PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_BRANCH_MISSES },
+    { "dtlb_misses", "dtlb_misses_per_op", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+// the group leader, -1 when no counter is available
+static int group_fd = -1;
+static int fds[PERF_COUNTERS] = { -1, -1, -1, -1, -1 };
+// the process the group was opened in, 0 before the first attempt
+static pid_t opened_by = 0;
+// counts of the last section, valid when counted[] is set
+static uint64_t counts[PERF_COUNTERS];
+static bool counted[PERF_COUNTERS];
+
+static int perf_event_open(struct perf_event_attr *attr, int group)
+{
+    return syscall(__NR_perf_event_open, attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void close_group(void)
+{
+    int i;
+    for (i = 0; i < PERF_COUNTERS; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    group_fd = -1;
+}
+
+static void open_group(void)
+{
+    int i;
+
+    close_group();
+    opened_by = getpid();
+
+    for (i = 0; i < PERF_COUNTERS; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = group_fd < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds[i] = perf_event_open(&attr, group_fd);
+        if (fds[i] < 0) {
+            BLTS_DEBUG("perf counter '%s' not available: %s\n", counter_events[i].tag,
+                    strerror(errno));
+            continue;
+        }
+        if (group_fd < 0) {
+            group_fd = fds[i];
+        }
+    }
+}
+
+void perf_counters_start(void)
+{
+    memset(counted, 0, sizeof(counted));
+
+    if (opened_by != getpid()) {
+        open_group();
+    }
+    if (group_fd < 0) {
+        return;
+    }
+
+    ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_counters_stop(void)
+{
+    struct {
+        uint64_t nr;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        struct {
+            uint64_t value;
+            uint64_t id;
+        } values[PERF_COUNTERS];
+    } group;
+    uint64_t ids[PERF_COUNTERS];
+    uint64_t i, j;
+
+    if (group_fd < 0) {
+        return;
+    }
+
+    ioctl(group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    if (read(group_fd, &group, sizeof(group)) < (ssize_t)(3 * sizeof(uint64_t))
+            || group.time_running == 0) {
+        return;
+    }
+
+    for (i = 0; i < PERF_COUNTERS; ++i) {
+        if (fds[i] < 0 || ioctl(fds[i], PERF_EVENT_IOC_ID, &ids[i]) != 0) {
+            continue;
+        }
+        for (j = 0; j < group.nr && j < PERF_COUNTERS; ++j) {
+            if (group.values[j].id == ids[i]) {
+                counts[i] = (double)group.values[j].value * group.time_enabled
+                    / group.time_running;
+                counted[i] = true;
+            }
+        }
+    }
+}
+
+void report_perf_counters(const char *tag_base)
+{
+    int i;
+
+    for (i = 0; i < PERF_COUNTERS; ++i) {
+        if (counted[i]) {
+            report_extended_result(tag_base, counter_events[i].tag, counts[i], "");
+        }
+    }
+
+    if (counted[PERF_CYCLES] && counted[PERF_INSTRUCTIONS] && counts[PERF_CYCLES] > 0) {
+        report_extended_result(tag_base, "ipc",
+                (double)counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES], "");
+    }
+}
+
+void report_perf_counters_per_op(const char *tag_base, uint64_t n_ops)
+{
+    int i;
+
+    for (i = 0; i < PERF_COUNTERS && n_ops > 0; ++i) {
+        if (counted[i]) {
+            report_extended_result(tag_base, counter_events[i].per_op_tag,
+                    (double)counts[i] / n_ops, "");
+        }
+    }
+}
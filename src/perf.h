@@ -0,0 +1,47 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/*
+ * Hardware performance counters of timed sections read with perf_event_open(): CPU cycles,
+ * instructions, cache misses, branch misses and data TLB misses, counted in user space for the
+ * thread running the section. Counters the CPU, the kernel or its perf_event_paranoid setting
+ * do not provide are left out, when none is available nothing is reported.
+ *
+ * Driven by io_accounting_start() and io_accounting_stop(), reported by report_io_accounting().
+ */
+
+void perf_counters_start(void);
+void perf_counters_stop(void);
+
+// reports the counts between the last perf_counters_start() and perf_counters_stop() as
+// '<tag_base>.cycles', '.instructions', '.ipc', '.cache_misses', '.branch_misses' and
+// '.dtlb_misses'
+void report_perf_counters(const char *tag_base);
+
+// reports the counts divided by the number of operations done in the section as
+// '<tag_base>.<counter>_per_op'
+void report_perf_counters_per_op(const char *tag_base, uint64_t n_ops);
+
+#endif // PERF_H
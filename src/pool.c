@@ -0,0 +1,211 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+enum {
+    POOL_MIN_SHIFT = 4,
+    POOL_MAX_SHIFT = 12,
+    POOL_N_CLASSES = POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1,
+    POOL_SLAB_BYTES = 64 * 1024,
+    // keeps blocks 8-byte aligned as sqlite requires, 16 for good measure
+    POOL_HEADER_BYTES = 16,
+};
+
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block;
+
+typedef struct pool_slab {
+    struct pool_slab *next;
+} pool_slab;
+
+typedef struct {
+    pool_block *free[POOL_N_CLASSES];
+    // free lists are stale once the pool was shut down since they were filled
+    unsigned generation;
+} thread_cache;
+
+static __thread thread_cache cache;
+
+static pthread_mutex_t slabs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pool_slab *slabs = NULL;
+static unsigned generation = 1;
+
+// block headers hold the usable size, at most POOL_MAX_BLOCK for pooled blocks
+static uint64_t *header(void *p)
+{
+    return (uint64_t *)((char *)p - POOL_HEADER_BYTES);
+}
+
+static int size_class(int n)
+{
+    int shift = POOL_MIN_SHIFT;
+    while ((1 << shift) < n) {
+        ++shift;
+    }
+
+    return shift - POOL_MIN_SHIFT;
+}
+
+static thread_cache *current_cache(void)
+{
+    unsigned current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    if (cache.generation != current) {
+        memset(cache.free, 0, sizeof(cache.free));
+        cache.generation = current;
+    }
+
+    return &cache;
+}
+
+static bool refill(thread_cache *c, int class)
+{
+    pool_slab *slab = malloc(POOL_SLAB_BYTES);
+    if (slab == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&slabs_mutex);
+    slab->next = slabs;
+    slabs = slab;
+    pthread_mutex_unlock(&slabs_mutex);
+
+    uint64_t block_size = (uint64_t)1 << (class + POOL_MIN_SHIFT);
+    size_t stride = POOL_HEADER_BYTES + block_size;
+    char *p = (char *)slab + POOL_HEADER_BYTES;
+    char *end = (char *)slab + POOL_SLAB_BYTES;
+    for (; p + stride <= end; p += stride) {
+        void *block = p + POOL_HEADER_BYTES;
+        *header(block) = block_size;
+        ((pool_block *)block)->next = c->free[class];
+        c->free[class] = block;
+    }
+
+    return true;
+}
+
+static void *pool_malloc(int n)
+{
+    if (n > POOL_MAX_BLOCK) {
+        char *p = malloc(POOL_HEADER_BYTES + n);
+        if (p == NULL) {
+            return NULL;
+        }
+        *(uint64_t *)p = n;
+        return p + POOL_HEADER_BYTES;
+    }
+
+    thread_cache *c = current_cache();
+    int class = size_class(n);
+    if (c->free[class] == NULL && !refill(c, class)) {
+        return NULL;
+    }
+
+    pool_block *block = c->free[class];
+    c->free[class] = block->next;
+
+    return block;
+}
+
+static void pool_free(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    uint64_t size = *header(p);
+    if (size > POOL_MAX_BLOCK) {
+        free(header(p));
+        return;
+    }
+
+    thread_cache *c = current_cache();
+    int class = size_class(size);
+    ((pool_block *)p)->next = c->free[class];
+    c->free[class] = p;
+}
+
+static void *pool_realloc(void *p, int n)
+{
+    uint64_t size = *header(p);
+    if (size <= POOL_MAX_BLOCK && (uint64_t)n <= size) {
+        return p;
+    }
+
+    void *new_p = pool_malloc(n);
+    if (new_p == NULL) {
+        return NULL;
+    }
+
+    memcpy(new_p, p, size < (uint64_t)n ? size : (uint64_t)n);
+    pool_free(p);
+
+    return new_p;
+}
+
+static int pool_size(void *p)
+{
+    return *header(p);
+}
+
+static int pool_roundup(int n)
+{
+    return n > POOL_MAX_BLOCK ? (n + 7) & ~7 : 1 << (size_class(n) + POOL_MIN_SHIFT);
+}
+
+static int pool_init(void *app_data)
+{
+    (void)app_data;
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+
+    return SQLITE_OK;
+}
+
+static void pool_shutdown(void *app_data)
+{
+    (void)app_data;
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&slabs_mutex);
+    while (slabs != NULL) {
+        pool_slab *next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+    pthread_mutex_unlock(&slabs_mutex);
+}
+
+const sqlite3_mem_methods *pool_mem_methods(void)
+{
+    static const sqlite3_mem_methods methods = {
+        pool_malloc, pool_free, pool_realloc, pool_size, pool_roundup, pool_init, pool_shutdown,
+        NULL
+    };
+
+    return &methods;
+}
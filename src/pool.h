@@ -0,0 +1,37 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <sqlite3.h>
+
+/*
+ * Size-class pool allocator for sqlite3_config(SQLITE_CONFIG_MALLOC). Requests of up to
+ * POOL_MAX_BLOCK bytes are served from per-thread free lists of power-of-two sized blocks carved
+ * out of larger slabs, bigger ones go to malloc(). Freed blocks go to the free list of the thread
+ * freeing them. Slabs are only returned to the system on sqlite3_shutdown().
+ */
+
+enum { POOL_MAX_BLOCK = 4096 };
+
+const sqlite3_mem_methods *pool_mem_methods(void);
+
+#endif // POOL_H
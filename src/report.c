@@ -0,0 +1,330 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Results are passed to blts_report_extended_result() immediately. Additionally they are
+ * remembered so that derived values (e.g. difference between two execution modes) can be
+ * computed once all the inputs are known.
+ *
+ * Between begin_collecting_results() and end_collecting_results() results are only remembered,
+ * marked pending, to be either discarded, reported as they are or summarized per tag.
+ *
+ * A child process running a test case on behalf of its parent (see jobs.h) forwards its results
+ * to a file the parent replays them from instead of reporting them itself.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <blts_log.h>
+#include <blts_reporting.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "baseline.h"
+#include "json.h"
+#include "report.h"
+#include "stats.h"
+
+typedef struct {
+    char tag[TAG_MAX];
+    char unit[UNIT_MAX];
+    double value;
+    bool pending;
+} recorded_result;
+
+static recorded_result *results = NULL;
+static int n_results = 0;
+static int results_capacity = 0;
+static bool collecting = false;
+static int forward_fd = -1;
+
+static void record_result(const char *full_tag, double value, const char *unit, bool pending)
+{
+    if (n_results == results_capacity) {
+        int new_capacity = results_capacity ? results_capacity * 2 : 64;
+        recorded_result *new_results = realloc(results, new_capacity * sizeof(recorded_result));
+        if (new_results == NULL) {
+            BLTS_ERROR("%s: Out of memory, result %s not recorded\n", __FUNCTION__, full_tag);
+            return;
+        }
+        results = new_results;
+        results_capacity = new_capacity;
+    }
+
+    snprintf(results[n_results].tag, TAG_MAX, "%s", full_tag);
+    snprintf(results[n_results].unit, UNIT_MAX, "%s", unit);
+    results[n_results].value = value;
+    results[n_results].pending = pending;
+    ++n_results;
+}
+
+static int report_unrecorded(const char *full_tag, double value, const char *unit)
+{
+    char full_tag_copy[TAG_MAX];
+    char unit_copy[UNIT_MAX];
+    snprintf(full_tag_copy, TAG_MAX, "%s", full_tag);
+    snprintf(unit_copy, UNIT_MAX, "%s", unit);
+
+    return blts_report_extended_result(full_tag_copy, value, unit_copy, 0);
+}
+
+static int report_full_tag(const char *full_tag, double value, const char *unit)
+{
+    record_result(full_tag, value, unit, false);
+
+    return report_unrecorded(full_tag, value, unit);
+}
+
+static void drop_pending_results(void)
+{
+    int i, n_kept = 0;
+
+    for (i = 0; i < n_results; ++i) {
+        if (!results[i].pending) {
+            results[n_kept++] = results[i];
+        }
+    }
+    n_results = n_kept;
+}
+
+// moves the pending results out of the results array into a newly allocated one, NULL when out
+// of memory, leaving them in place
+static recorded_result *take_pending_results(int *n_pending)
+{
+    recorded_result *pending = malloc((n_results + 1) * sizeof(recorded_result));
+    int i;
+
+    *n_pending = 0;
+    if (pending == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < n_results; ++i) {
+        if (results[i].pending) {
+            pending[(*n_pending)++] = results[i];
+        }
+    }
+    drop_pending_results();
+
+    return pending;
+}
+
+static void report_summary(const char *full_tag, const char *unit, const sample_stats *stats,
+        const double *iteration_values)
+{
+    static const char *const suffixes[] = { "stddev", "median", "min", "ci95" };
+    const double values[] = { stats->stddev, stats->median, stats->min, stats->ci95 };
+    char tag[TAG_MAX];
+
+    report_full_tag(full_tag, stats->mean, unit);
+    baseline_check(full_tag, unit, stats);
+    json_summary(full_tag, unit, stats, iteration_values);
+
+    unsigned i;
+    for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        format_tag(tag, full_tag, suffixes[i]);
+        report_full_tag(tag, values[i], unit);
+    }
+}
+
+void format_tag(char *full_tag, const char *tag_base, const char *tag)
+{
+    int n_written = snprintf(full_tag, TAG_MAX, "%s.%s", tag_base, tag);
+    assert(n_written < TAG_MAX);
+}
+
+static int report_result(const char *full_tag, double value, const char *unit)
+{
+    if (forward_fd >= 0) {
+        // still remembered for find_extended_result()
+        record_result(full_tag, value, unit, false);
+
+        recorded_result forwarded = { .value = value };
+        snprintf(forwarded.tag, TAG_MAX, "%s", full_tag);
+        snprintf(forwarded.unit, UNIT_MAX, "%s", unit);
+        return write(forward_fd, &forwarded, sizeof(forwarded)) == (ssize_t)sizeof(forwarded)
+            ? 0 : -1;
+    }
+
+    if (collecting) {
+        record_result(full_tag, value, unit, true);
+        return 0;
+    }
+
+    sample_stats stats;
+    compute_stats(&value, 1, &stats);
+    baseline_check(full_tag, unit, &stats);
+    json_result(full_tag, unit, value);
+
+    return report_full_tag(full_tag, value, unit);
+}
+
+int report_extended_result(const char *tag_base, char *tag, double value, char *unit)
+{
+    char full_tag[TAG_MAX];
+    format_tag(full_tag, tag_base, tag);
+
+    return report_result(full_tag, value, unit);
+}
+
+void report_latencies(const char *tag_base, const histogram *h, double elapsed)
+{
+    static const struct {
+        char *tag;
+        double percentile;
+    } percentiles[] = {
+        { "latency_p50", 50.0 },
+        { "latency_p90", 90.0 },
+        { "latency_p99", 99.0 },
+        { "latency_p99_9", 99.9 },
+    };
+
+    if (h->count == 0) {
+        return;
+    }
+
+    report_extended_result(tag_base, "latency_min", h->min / 1000.0, "us");
+
+    unsigned i;
+    for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        report_extended_result(tag_base, percentiles[i].tag,
+                histogram_percentile(h, percentiles[i].percentile) / 1000.0, "us");
+    }
+
+    report_extended_result(tag_base, "latency_max", h->max / 1000.0, "us");
+
+    if (elapsed > 0) {
+        report_extended_result(tag_base, "ops_per_sec", h->count / elapsed, "1/s");
+    }
+}
+
+bool find_extended_result(const char *full_tag, double *value)
+{
+    int i;
+    for (i = n_results - 1; i >= 0; --i) {
+        if (strcmp(results[i].tag, full_tag) == 0) {
+            *value = results[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void clear_extended_results(void)
+{
+    free(results);
+    results = NULL;
+    n_results = 0;
+    results_capacity = 0;
+    collecting = false;
+}
+
+void begin_collecting_results(void)
+{
+    collecting = true;
+}
+
+void discard_collected_results(void)
+{
+    drop_pending_results();
+}
+
+void end_collecting_results(bool summarize)
+{
+    int n_pending;
+    recorded_result *pending = take_pending_results(&n_pending);
+    double *values = malloc((n_pending + 1) * sizeof(double));
+    double *sorted_values = malloc((n_pending + 1) * sizeof(double));
+    int i, j;
+
+    collecting = false;
+
+    if (pending == NULL) {
+        BLTS_ERROR("%s: Out of memory, reporting results without summary\n", __FUNCTION__);
+        // they stay recorded, just no longer pending
+        for (i = 0; i < n_results; ++i) {
+            if (results[i].pending) {
+                results[i].pending = false;
+                report_unrecorded(results[i].tag, results[i].value, results[i].unit);
+                json_result(results[i].tag, results[i].unit, results[i].value);
+            }
+        }
+        free(sorted_values);
+        free(values);
+        return;
+    }
+
+    if (summarize && (values == NULL || sorted_values == NULL)) {
+        BLTS_ERROR("%s: Out of memory, reporting results without summary\n", __FUNCTION__);
+        summarize = false;
+    }
+
+    for (i = 0; i < n_pending; ++i) {
+        if (!summarize) {
+            report_full_tag(pending[i].tag, pending[i].value, pending[i].unit);
+            json_result(pending[i].tag, pending[i].unit, pending[i].value);
+            continue;
+        }
+
+        // summarize each tag once, at the position it was first reported at
+        bool seen = false;
+        for (j = 0; j < i && !seen; ++j) {
+            seen = strcmp(pending[j].tag, pending[i].tag) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+
+        int n_values = 0;
+        for (j = i; j < n_pending; ++j) {
+            if (strcmp(pending[j].tag, pending[i].tag) == 0) {
+                values[n_values++] = pending[j].value;
+            }
+        }
+
+        sample_stats stats;
+        memcpy(sorted_values, values, n_values * sizeof(double));
+        compute_stats(sorted_values, n_values, &stats);
+        report_summary(pending[i].tag, pending[i].unit, &stats, values);
+    }
+
+    free(sorted_values);
+    free(values);
+    free(pending);
+}
+
+void forward_results(int fd)
+{
+    forward_fd = fd;
+}
+
+bool replay_results(FILE *file)
+{
+    recorded_result forwarded;
+
+    while (fread(&forwarded, sizeof(forwarded), 1, file) == 1) {
+        report_result(forwarded.tag, forwarded.value, forwarded.unit);
+    }
+
+    return !ferror(file);
+}
@@ -0,0 +1,62 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "histogram.h"
+
+enum { TAG_MAX = 256, UNIT_MAX = 16 };
+
+// combines tag_base with tag the same way report_extended_result() does
+void format_tag(char *full_tag, const char *tag_base, const char *tag);
+
+// wrapper around blts_report_extended_result() combining tag_base with tag
+int report_extended_result(const char *tag_base, char *tag, double value, char *unit);
+
+// reports percentiles of per-operation latencies (in nanoseconds) collected in h as
+// '<tag_base>.latency_*' and the operation rate over elapsed seconds as '<tag_base>.ops_per_sec'
+void report_latencies(const char *tag_base, const histogram *h, double elapsed);
+
+// looks up the value most recently reported with report_extended_result() under full_tag
+bool find_extended_result(const char *full_tag, double *value);
+
+// forgets all results recorded so far
+void clear_extended_results(void);
+
+/*
+ * Collecting results of repeated runs. Once collecting, results are not reported until
+ * end_collecting_results(), which either reports them as they are or, if summarize is true,
+ * reports for each distinct tag the mean (under the tag itself) and '<tag>.stddev',
+ * '<tag>.median', '<tag>.min' and '<tag>.ci95' (half-width of the 95% confidence interval).
+ */
+void begin_collecting_results(void);
+void discard_collected_results(void);
+void end_collecting_results(bool summarize);
+
+// makes results be written to fd, to be passed to replay_results() by another process
+void forward_results(int fd);
+// reports the results forwarded to file as if they were reported by this process
+bool replay_results(FILE *file);
+
+#endif // REPORT_H
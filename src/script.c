@@ -0,0 +1,508 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Workloads described by SQL scripts, see script.h for the format. The statements of a section
+ * are prepared one at a time during its first repetition, so that they may refer to tables
+ * created by the statements before them, and are reused by the following repetitions.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "io.h"
+#include "report.h"
+#include "script.h"
+
+enum { SCRIPT_STATEMENTS_MAX = 64 };
+
+static const char DIRECTIVE[] = "-- @";
+
+// indexed by script_section_kind
+static const char *const section_kinds[] = { "setup", "timed", "teardown" };
+
+typedef struct {
+    sqlite3 *db;
+    int table_size;
+    int n_selects;
+    // rows 0 to next_index - 1 were generated by the sections run so far
+    int next_index;
+    uint64_t random_state;
+} script_run;
+
+static bool is_blank(const char *line)
+{
+    return line[strspn(line, " \t\r\n")] == '\0';
+}
+
+static bool append_sql(script_section *section, const char *line)
+{
+    size_t length = section->sql != NULL ? strlen(section->sql) : 0;
+    char *sql = realloc(section->sql, length + strlen(line) + 1);
+    if (sql == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        return false;
+    }
+
+    strcpy(sql + length, line);
+    section->sql = sql;
+    return true;
+}
+
+static bool parse_repeat(script_section *section, const char *value)
+{
+    if (strcmp(value, "rows") == 0) {
+        section->repeat = SCRIPT_REPEAT_ROWS;
+        return true;
+    }
+    if (strcmp(value, "selects") == 0) {
+        section->repeat = SCRIPT_REPEAT_SELECTS;
+        return true;
+    }
+
+    char *end;
+    long count = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || count < 1 || count > INT_MAX) {
+        return false;
+    }
+
+    section->repeat = SCRIPT_REPEAT_COUNT;
+    section->count = count;
+    return true;
+}
+
+// parses the words following DIRECTIVE on a line
+static bool parse_directive(workload_script *script, char *directive, int line_no)
+{
+    char *saveptr;
+    char *word = strtok_r(directive, " \t\r\n", &saveptr);
+    if (word == NULL) {
+        goto invalid;
+    }
+
+    if (strcmp(word, "name") == 0) {
+        word = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (word == NULL || strtok_r(NULL, " \t\r\n", &saveptr) != NULL
+                || strlen(word) >= SCRIPT_NAME_MAX) {
+            goto invalid;
+        }
+        snprintf(script->name, SCRIPT_NAME_MAX, "%s", word);
+        return true;
+    }
+
+    int kind;
+    for (kind = SCRIPT_SETUP; kind <= SCRIPT_TEARDOWN && strcmp(word, section_kinds[kind]) != 0;
+            ++kind) {
+    }
+
+    if (kind > SCRIPT_TEARDOWN) {
+        goto invalid;
+    }
+
+    if (script->n_sections == SCRIPT_SECTIONS_MAX) {
+        BLTS_ERROR("%s:%d: Too many sections\n", script->path, line_no);
+        return false;
+    }
+
+    script_section *section = &script->sections[script->n_sections++];
+    section->kind = kind;
+    section->count = 1;
+    snprintf(section->label, SCRIPT_NAME_MAX, "%s", section_kinds[kind]);
+
+    bool has_label = false;
+    while ((word = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL) {
+        if (strncmp(word, "repeat=", strlen("repeat=")) == 0) {
+            if (!parse_repeat(section, word + strlen("repeat="))) {
+                goto invalid;
+            }
+        } else if (strcmp(word, "transaction") == 0) {
+            section->transaction = true;
+        } else if (kind == SCRIPT_TIMED && !has_label && strchr(word, '=') == NULL
+                && strlen(word) < SCRIPT_NAME_MAX) {
+            snprintf(section->label, SCRIPT_NAME_MAX, "%s", word);
+            has_label = true;
+        } else {
+            goto invalid;
+        }
+    }
+
+    // the labels tag the results
+    int i;
+    for (i = 0; kind == SCRIPT_TIMED && i < script->n_sections - 1; ++i) {
+        if (script->sections[i].kind == SCRIPT_TIMED
+                && strcmp(script->sections[i].label, section->label) == 0) {
+            BLTS_ERROR("%s:%d: Duplicate label '%s'\n", script->path, line_no, section->label);
+            return false;
+        }
+    }
+
+    return true;
+
+invalid:
+    BLTS_ERROR("%s:%d: Invalid directive\n", script->path, line_no);
+    return false;
+}
+
+workload_script *script_load(const char *path)
+{
+    workload_script *script = NULL;
+    char *line = NULL;
+    size_t line_size = 0;
+    int line_no = 0;
+    int i;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        BLTS_ERROR("%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    script = calloc(1, sizeof(workload_script));
+    if (script == NULL) {
+        BLTS_ERROR("Out of memory\n");
+        goto fail;
+    }
+
+    int n_written = snprintf(script->path, PATH_MAX, "%s", path);
+    if (n_written >= PATH_MAX) {
+        BLTS_ERROR("%s: PATH_MAX exceeded\n", path);
+        goto fail;
+    }
+
+    // named after the file unless told otherwise
+    const char *base = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    snprintf(script->name, SCRIPT_NAME_MAX, "%.*s", (int)strcspn(base, "."), base);
+
+    while (getline(&line, &line_size, file) != -1) {
+        ++line_no;
+
+        char *start = line + strspn(line, " \t");
+        if (strncmp(start, DIRECTIVE, strlen(DIRECTIVE)) == 0) {
+            if (!parse_directive(script, start + strlen(DIRECTIVE), line_no)) {
+                goto fail;
+            }
+            continue;
+        }
+
+        if (script->n_sections == 0) {
+            if (is_blank(start) || strncmp(start, "--", 2) == 0) {
+                continue;
+            }
+            BLTS_ERROR("%s:%d: Statement outside of a section\n", path, line_no);
+            goto fail;
+        }
+
+        if (!append_sql(&script->sections[script->n_sections - 1], line)) {
+            goto fail;
+        }
+    }
+
+    if (ferror(file)) {
+        BLTS_ERROR("%s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+
+    for (i = 0; i < script->n_sections && script->sections[i].kind != SCRIPT_TIMED; ++i) {
+    }
+
+    if (i == script->n_sections) {
+        BLTS_ERROR("%s: No timed section\n", path);
+        goto fail;
+    }
+
+    if (script->name[0] == '\0') {
+        BLTS_ERROR("%s: Invalid test case name\n", path);
+        goto fail;
+    }
+
+    free(line);
+    fclose(file);
+
+    return script;
+
+fail:
+    free(line);
+    fclose(file);
+    script_destroy(script);
+
+    return NULL;
+}
+
+void script_destroy(workload_script *script)
+{
+    int i;
+
+    if (script == NULL) {
+        return;
+    }
+
+    for (i = 0; i < script->n_sections; ++i) {
+        free(script->sections[i].sql);
+    }
+    free(script);
+}
+
+static bool bind_parameters(sqlite3_stmt *stmt, const script_run *run, const generated_row *row,
+        int random_index)
+{
+    int i;
+
+    for (i = 1; i <= sqlite3_bind_parameter_count(stmt); ++i) {
+        const char *name = sqlite3_bind_parameter_name(stmt, i);
+
+        if (name == NULL) {
+            BLTS_ERROR("\"%s\": Only named parameters are supported\n", sqlite3_sql(stmt));
+            return false;
+        } else if (strcmp(name, ":index") == 0) {
+            sqlite3_bind_int(stmt, i, row->index);
+        } else if (strcmp(name, ":number") == 0) {
+            sqlite3_bind_int(stmt, i, row->row.number);
+        } else if (strcmp(name, ":string") == 0) {
+            sqlite3_bind_text(stmt, i, row->row.string, -1, SQLITE_STATIC);
+        } else if (strcmp(name, ":random") == 0) {
+            sqlite3_bind_int(stmt, i, random_index);
+        } else if (strcmp(name, ":rows") == 0) {
+            sqlite3_bind_int(stmt, i, run->table_size);
+        } else {
+            BLTS_ERROR("\"%s\": Unknown parameter %s\n", sqlite3_sql(stmt), name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// steps stmt to completion, adding the time it took to latency
+static bool exec_statement(sqlite3_stmt *stmt, const script_run *run, const generated_row *row,
+        int random_index, uint64_t *latency)
+{
+    if (!bind_parameters(stmt, run, row, random_index)) {
+        return false;
+    }
+
+    uint64_t start = histogram_now();
+    bool retv = db_step_reset(stmt);
+    *latency += histogram_now() - start;
+
+    return retv;
+}
+
+// prepares and executes the statements of the section one at a time, storing them in stmts
+static bool prepare_statements(const script_run *run, const script_section *section,
+        sqlite3_stmt **stmts, int *n_stmts, const generated_row *row, int random_index,
+        uint64_t *latency)
+{
+    const char *tail = section->sql;
+
+    while (!is_blank(tail)) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(run->db, tail, -1, &stmt, &tail) != SQLITE_OK) {
+            BLTS_ERROR("%s: sqlite3_prepare(\"%s\") failed: %s\n", __FUNCTION__, tail,
+                    sqlite3_errmsg(run->db));
+            return false;
+        }
+        // only comments were left
+        if (stmt == NULL) {
+            break;
+        }
+        if (*n_stmts == SCRIPT_STATEMENTS_MAX) {
+            BLTS_ERROR("%s: Too many statements in a section\n", __FUNCTION__);
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        stmts[(*n_stmts)++] = stmt;
+
+        if (!exec_statement(stmt, run, row, random_index, latency)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int section_repeats(const script_run *run, const script_section *section)
+{
+    switch (section->repeat) {
+    case SCRIPT_REPEAT_ROWS:
+        return run->table_size;
+    case SCRIPT_REPEAT_SELECTS:
+        return run->n_selects;
+    default:
+        return section->count;
+    }
+}
+
+// runs the repetitions of a section, recording the latency of each in latencies (may be NULL)
+// and the time spent in all of them, without generating rows, in elapsed
+static bool run_section(script_run *run, const script_section *section, histogram *latencies,
+        double *elapsed)
+{
+    bool retv = false;
+    sqlite3_stmt *stmts[SCRIPT_STATEMENTS_MAX];
+    int n_stmts = 0;
+    int n_repeats = section_repeats(run, section);
+    const generated_row *row;
+    int i;
+
+    row_generator *rows = row_generator_create(run->next_index, n_repeats, NULL);
+
+    if (rows == NULL) {
+        return false;
+    }
+
+    uint64_t start = histogram_now();
+
+    if (section->transaction && !db_begin_transaction(run->db)) {
+        goto fail;
+    }
+
+    while (section->sql != NULL && (row = row_generator_next(rows)) != NULL) {
+        int random_index = row->index > 0 ? generator_random(&run->random_state) % row->index : 0;
+        uint64_t latency = 0;
+
+        if (row->index == run->next_index) {
+            if (!prepare_statements(run, section, stmts, &n_stmts, row, random_index,
+                        &latency)) {
+                goto fail;
+            }
+        } else {
+            for (i = 0; i < n_stmts; ++i) {
+                if (!exec_statement(stmts[i], run, row, random_index, &latency)) {
+                    goto fail;
+                }
+            }
+        }
+
+        if (latencies != NULL) {
+            histogram_record(latencies, latency);
+        }
+    }
+
+    if (section->transaction && !db_commit_transaction(run->db)) {
+        goto fail;
+    }
+
+    *elapsed = (histogram_now() - start) / 1e9 - row_generator_overhead(rows);
+    run->next_index += n_repeats;
+    retv = true;
+
+fail:
+    if (!retv && section->transaction) {
+        sqlite3_exec(run->db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    for (i = 0; i < n_stmts; ++i) {
+        sqlite3_finalize(stmts[i]);
+    }
+    row_generator_destroy(rows);
+
+    return retv;
+}
+
+static bool run_timed_section(const char *tag_base, script_run *run,
+        const script_section *section)
+{
+    histogram *latencies = histogram_create();
+    double elapsed;
+
+    if (latencies == NULL) {
+        return false;
+    }
+
+    char section_tag_base[TAG_MAX];
+    format_tag(section_tag_base, tag_base, section->label);
+
+    db_reset_status(run->db);
+    io_accounting_start();
+
+    bool retv = run_section(run, section, latencies, &elapsed);
+
+    io_accounting_stop();
+
+    if (retv) {
+        report_extended_result(section_tag_base, "elapsed", elapsed, "s");
+        report_latencies(section_tag_base, latencies, elapsed);
+        report_io_accounting(section_tag_base);
+        db_report_status(section_tag_base, run->db);
+    }
+
+    histogram_destroy(latencies);
+
+    return retv;
+}
+
+int test_script(const char *tag_base, const char *db_file, const workload_script *script,
+        int table_size, int n_selects)
+{
+    BLTS_DEBUG("START %s(script=%s, table_size=%d, n_selects=%d)\n", __FUNCTION__, script->path,
+            table_size, n_selects);
+
+    int retv = EXIT_FAILURE;
+    script_run run = {
+        .table_size = table_size,
+        .n_selects = n_selects,
+        .random_state = generator_seed(),
+    };
+    bool reopened = false;
+    double elapsed;
+    int i;
+
+    if (!db_open_truncate(&run.db, db_file)) {
+        goto fail;
+    }
+
+    for (i = 0; i < script->n_sections; ++i) {
+        const script_section *section = &script->sections[i];
+
+        if (section->kind != SCRIPT_TIMED) {
+            if (!run_section(&run, section, NULL, &elapsed)) {
+                goto fail;
+            }
+            continue;
+        }
+
+        // what setup left behind is read from storage by the first timed section
+        if (test_opts.cold && !reopened) {
+            if (!db_reopen_cold(&run.db, db_file, tag_base)) {
+                goto fail;
+            }
+            reopened = true;
+        }
+
+        if (!run_timed_section(tag_base, &run, section)) {
+            goto fail;
+        }
+    }
+
+    retv = EXIT_SUCCESS;
+
+fail:
+    db_close(run.db);
+
+    return retv;
+}
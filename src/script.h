@@ -0,0 +1,86 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <limits.h>
+#include <stdbool.h>
+
+/*
+ * Workloads described by SQL scripts given with -script, each run as a test case of its own.
+ * A script is divided into sections by directive lines:
+ *
+ *   -- @name case_name
+ *   -- @setup [repeat=R] [transaction]
+ *   -- @timed [label] [repeat=R] [transaction]
+ *   -- @teardown [repeat=R] [transaction]
+ *
+ * The statements of a section are executed R times (once by default), R being a count or
+ * 'rows' or 'selects' for the case's table size and number of queries, so that -rows, -scale
+ * and -selects apply to scripts like to the built-in cases. 'transaction' wraps all repetitions
+ * in one transaction. Only the timed sections are measured, each is reported under
+ * '<case>.<label>' ('timed' by default).
+ *
+ * Statements may use the named parameters :index, :number and :string, bound to the index and
+ * the data of a generated row (see generator.h) for each repetition, :random, a uniformly chosen
+ * index of a row generated before, and :rows, the table size. Indexes continue from one section
+ * to the next, so that rows inserted in setup can be looked up with :random later on.
+ */
+
+enum { SCRIPT_NAME_MAX = 64, SCRIPT_SECTIONS_MAX = 16 };
+
+typedef enum {
+    SCRIPT_SETUP,
+    SCRIPT_TIMED,
+    SCRIPT_TEARDOWN
+} script_section_kind;
+
+typedef enum {
+    SCRIPT_REPEAT_COUNT,
+    SCRIPT_REPEAT_ROWS,
+    SCRIPT_REPEAT_SELECTS
+} script_repeat;
+
+typedef struct {
+    script_section_kind kind;
+    char label[SCRIPT_NAME_MAX];
+    script_repeat repeat;
+    // used with SCRIPT_REPEAT_COUNT
+    int count;
+    bool transaction;
+    char *sql;
+} script_section;
+
+typedef struct {
+    char name[SCRIPT_NAME_MAX];
+    char path[PATH_MAX];
+    script_section sections[SCRIPT_SECTIONS_MAX];
+    int n_sections;
+} workload_script;
+
+// returns NULL when the file cannot be read or is not a valid script
+workload_script *script_load(const char *path);
+void script_destroy(workload_script *script);
+
+int test_script(const char *tag_base, const char *db_file, const workload_script *script,
+        int table_size, int n_selects);
+
+#endif // SCRIPT_H
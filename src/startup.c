@@ -0,0 +1,429 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Connection startup: databases with a schema of each of schema_sizes tables (with an index
+ * each) are opened n_opens times, timing sqlite3_open_v2(), the first prepare (which parses the
+ * schema) and the first query apart, with private and shared caches. Results are tagged
+ * '<tag_base>.tables_<N>.<cache>.<phase>.*', and '.cold' / '.warm' when test_opts.cold is set.
+ * Queries on a connection kept open, as a pool would, are compared with reopening for each one
+ * under '<tag_base>.tables_<N>.pool' and '.reopen'. Attaching ATTACH_DATABASES databases and
+ * querying them is timed under '<tag_base>.attach'. Skipped on in-memory databases.
+ */
+
+#define _GNU_SOURCE
+#include <blts_log.h>
+#include <limits.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blts-sqlite-perf.h"
+#include "db.h"
+#include "generator.h"
+#include "histogram.h"
+#include "report.h"
+
+static const int schema_sizes[] = { 10, 100, 1000 };
+
+enum { ATTACH_DATABASES = 8, ATTACH_TABLES = 100 };
+
+static const struct {
+    const char *name;
+    int flag;
+} caches[] = {
+    { "private", SQLITE_OPEN_PRIVATECACHE },
+    { "shared_cache", SQLITE_OPEN_SHAREDCACHE },
+};
+
+enum { OPEN, FIRST_PREPARE, FIRST_QUERY, STARTUP, PHASES };
+
+static const char *const phase_names[PHASES] = { "open", "first_prepare", "first_query",
+    "startup" };
+
+// creates db_file with n_tables tables of a row each, with an index on each
+static bool create_schema(const char *db_file, int n_tables)
+{
+    bool retv = false;
+    sqlite3 *db = NULL;
+    char sql[SQL_MAX];
+    int i;
+
+    if (!db_open_truncate(&db, db_file) || !db_begin_transaction(db)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_tables; ++i) {
+        sql_sprintf(sql, "CREATE TABLE t%d(id INTEGER PRIMARY KEY, number INTEGER, string TEXT);",
+                i);
+        if (!db_exec(db, sql)) {
+            goto fail;
+        }
+        sql_sprintf(sql, "CREATE INDEX t%d_number ON t%d(number);", i, i);
+        if (!db_exec(db, sql)) {
+            goto fail;
+        }
+        sql_sprintf(sql, "INSERT INTO t%d VALUES(1, %d, '%s');", i, i, digits[i % 10]);
+        if (!db_exec(db, sql)) {
+            goto fail;
+        }
+    }
+
+    retv = db_commit_transaction(db);
+
+fail:
+    db_close(db);
+
+    return retv;
+}
+
+static bool open_connection(sqlite3 **db, const char *db_file, int flags)
+{
+    int rc = sqlite3_open_v2(db_file, db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_URI | flags, NULL);
+    if (rc != SQLITE_OK) {
+        BLTS_ERROR("%s: sqlite3_open_v2(\"%s\") failed: %s\n", __FUNCTION__, db_file,
+                sqlite3_errstr(rc));
+        sqlite3_close(*db);
+        *db = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// a query on the last table, so that the whole schema has to be parsed to find it
+static void format_query(char *sql, int n_tables)
+{
+    sql_sprintf(sql, "SELECT string FROM t%d WHERE number = %d;", n_tables - 1, n_tables - 1);
+}
+
+static bool query(sqlite3 *db, const char *sql, uint64_t *prepared)
+{
+    sqlite3_stmt *stmt = NULL;
+
+    if (!db_prepare(db, &stmt, sql)) {
+        return false;
+    }
+    *prepared = histogram_now();
+
+    bool retv = db_step_reset(stmt);
+    sqlite3_finalize(stmt);
+
+    return retv;
+}
+
+// opens the database n_opens times, timing each phase apart
+static bool open_pass(const char *tag_base, const char *db_file, int n_tables, int cache,
+        bool cold, int n_opens)
+{
+    bool retv = false;
+    sqlite3 *holder = NULL;
+    sqlite3 *db = NULL;
+    histogram *latencies[PHASES] = { NULL };
+    uint64_t total[PHASES] = { 0 };
+    char sql[SQL_MAX];
+    int i, p;
+
+    format_query(sql, n_tables);
+
+    for (p = 0; p < PHASES; ++p) {
+        latencies[p] = histogram_create();
+        if (latencies[p] == NULL) {
+            goto fail;
+        }
+    }
+
+    // the shared cache, and the schema parsed into it, lives as long as a connection uses it
+    if (caches[cache].flag == SQLITE_OPEN_SHAREDCACHE) {
+        uint64_t prepared;
+        if (!open_connection(&holder, db_file, caches[cache].flag)
+                || !query(holder, sql, &prepared)) {
+            goto fail;
+        }
+    }
+
+    for (i = 0; i < n_opens; ++i) {
+        if (cold && !db_evict_cache(db_file)) {
+            goto fail;
+        }
+
+        uint64_t start = histogram_now();
+        if (!open_connection(&db, db_file, caches[cache].flag)) {
+            goto fail;
+        }
+        uint64_t opened = histogram_now();
+        uint64_t prepared;
+        if (!query(db, sql, &prepared)) {
+            goto fail;
+        }
+        uint64_t queried = histogram_now();
+
+        db_close(db);
+        db = NULL;
+
+        uint64_t durations[PHASES] = {
+            [OPEN] = opened - start,
+            [FIRST_PREPARE] = prepared - opened,
+            [FIRST_QUERY] = queried - prepared,
+            [STARTUP] = queried - start,
+        };
+        for (p = 0; p < PHASES; ++p) {
+            histogram_record(latencies[p], durations[p]);
+            total[p] += durations[p];
+        }
+    }
+
+    char cache_tag_base[TAG_MAX];
+    char pass_tag_base[TAG_MAX];
+    format_tag(cache_tag_base, tag_base, caches[cache].name);
+    if (test_opts.cold) {
+        format_tag(pass_tag_base, cache_tag_base, cold ? "cold" : "warm");
+    } else {
+        snprintf(pass_tag_base, TAG_MAX, "%s", cache_tag_base);
+    }
+
+    for (p = 0; p < PHASES; ++p) {
+        char phase_tag_base[TAG_MAX];
+        format_tag(phase_tag_base, pass_tag_base, phase_names[p]);
+        report_latencies(phase_tag_base, latencies[p], total[p] / 1e9);
+    }
+
+    retv = true;
+
+fail:
+    db_close(db);
+    db_close(holder);
+    for (p = 0; p < PHASES; ++p) {
+        histogram_destroy(latencies[p]);
+    }
+
+    return retv;
+}
+
+// runs n_queries queries, each on a connection of its own when reopen is set
+static bool pool_pass(const char *tag_base, const char *db_file, int n_tables, bool reopen,
+        int n_queries, double *elapsed)
+{
+    bool retv = false;
+    sqlite3 *db = NULL;
+    histogram *latencies = histogram_create();
+    uint64_t state = generator_seed();
+    char sql[SQL_MAX];
+    int i;
+
+    if (latencies == NULL) {
+        goto fail;
+    }
+
+    uint64_t start = histogram_now();
+    for (i = 0; i < n_queries; ++i) {
+        uint64_t query_start = histogram_now();
+        uint64_t prepared;
+        int table = generator_random(&state) % n_tables;
+
+        if (db == NULL && !open_connection(&db, db_file, 0)) {
+            goto fail;
+        }
+        sql_sprintf(sql, "SELECT string FROM t%d WHERE number = %d;", table, table);
+        if (!query(db, sql, &prepared)) {
+            goto fail;
+        }
+        if (reopen) {
+            db_close(db);
+            db = NULL;
+        }
+
+        histogram_record(latencies, histogram_now() - query_start);
+    }
+    *elapsed = (histogram_now() - start) / 1e9;
+
+    char pass_tag_base[TAG_MAX];
+    format_tag(pass_tag_base, tag_base, reopen ? "reopen" : "pool");
+    report_extended_result(pass_tag_base, "elapsed", *elapsed, "s");
+    report_latencies(pass_tag_base, latencies, *elapsed);
+
+    retv = true;
+
+fail:
+    db_close(db);
+    histogram_destroy(latencies);
+
+    return retv;
+}
+
+static bool schema_pass(const char *tag_base, const char *db_file, int n_tables, int n_opens)
+{
+    unsigned cache;
+    int cold;
+
+    char schema_tag[32];
+    char schema_tag_base[TAG_MAX];
+    snprintf(schema_tag, sizeof(schema_tag), "tables_%d", n_tables);
+    format_tag(schema_tag_base, tag_base, schema_tag);
+
+    if (!create_schema(db_file, n_tables)) {
+        return false;
+    }
+
+    for (cache = 0; cache < sizeof(caches) / sizeof(caches[0]); ++cache) {
+        for (cold = test_opts.cold; cold >= 0; --cold) {
+            if (!open_pass(schema_tag_base, db_file, n_tables, cache, cold, n_opens)) {
+                return false;
+            }
+        }
+    }
+
+    double pool_elapsed, reopen_elapsed;
+    if (!pool_pass(schema_tag_base, db_file, n_tables, false, n_opens, &pool_elapsed)
+            || !pool_pass(schema_tag_base, db_file, n_tables, true, n_opens, &reopen_elapsed)) {
+        return false;
+    }
+    if (pool_elapsed > 0) {
+        report_extended_result(schema_tag_base, "pool_speedup", reopen_elapsed / pool_elapsed,
+                "");
+    }
+
+    return true;
+}
+
+static bool format_attach_file(char *path, const char *db_file, int i)
+{
+    int n_written = snprintf(path, PATH_MAX, "%s-attach%d", db_file, i);
+    if (n_written >= PATH_MAX) {
+        BLTS_ERROR("%s: PATH_MAX exceeded\n", db_file);
+        return false;
+    }
+
+    return true;
+}
+
+// attaches ATTACH_DATABASES databases to a connection and queries each, n_opens times
+static bool attach_pass(const char *tag_base, const char *db_file, int n_opens)
+{
+    bool retv = false;
+    sqlite3 *db = NULL;
+    histogram *attach_latencies = histogram_create();
+    histogram *query_latencies = histogram_create();
+    histogram *detach_latencies = histogram_create();
+    uint64_t attach_total = 0, query_total = 0, detach_total = 0;
+    char path[PATH_MAX];
+    char sql[SQL_MAX + PATH_MAX];
+    int i, a;
+
+    if (attach_latencies == NULL || query_latencies == NULL || detach_latencies == NULL) {
+        goto fail;
+    }
+
+    for (a = 0; a < ATTACH_DATABASES; ++a) {
+        if (!format_attach_file(path, db_file, a) || !create_schema(path, ATTACH_TABLES)) {
+            goto fail;
+        }
+    }
+
+    if (!open_connection(&db, db_file, 0)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n_opens; ++i) {
+        for (a = 0; a < ATTACH_DATABASES; ++a) {
+            uint64_t start = histogram_now();
+            format_attach_file(path, db_file, a);
+            snprintf(sql, sizeof(sql), "ATTACH DATABASE '%s' AS a%d;", path, a);
+            if (!db_exec(db, sql)) {
+                goto fail;
+            }
+            uint64_t attached = histogram_now();
+
+            // reads the schema of the attached database
+            snprintf(sql, sizeof(sql), "SELECT string FROM a%d.t%d WHERE number = %d;", a,
+                    ATTACH_TABLES - 1, ATTACH_TABLES - 1);
+            if (!db_exec(db, sql)) {
+                goto fail;
+            }
+            uint64_t queried = histogram_now();
+
+            histogram_record(attach_latencies, attached - start);
+            histogram_record(query_latencies, queried - attached);
+            attach_total += attached - start;
+            query_total += queried - attached;
+        }
+
+        for (a = 0; a < ATTACH_DATABASES; ++a) {
+            uint64_t start = histogram_now();
+            snprintf(sql, sizeof(sql), "DETACH DATABASE a%d;", a);
+            if (!db_exec(db, sql)) {
+                goto fail;
+            }
+            uint64_t detached = histogram_now() - start;
+            histogram_record(detach_latencies, detached);
+            detach_total += detached;
+        }
+    }
+
+    char attach_tag_base[TAG_MAX];
+    char phase_tag_base[TAG_MAX];
+    format_tag(attach_tag_base, tag_base, "attach");
+    format_tag(phase_tag_base, attach_tag_base, "attach");
+    report_latencies(phase_tag_base, attach_latencies, attach_total / 1e9);
+    format_tag(phase_tag_base, attach_tag_base, "first_query");
+    report_latencies(phase_tag_base, query_latencies, query_total / 1e9);
+    format_tag(phase_tag_base, attach_tag_base, "detach");
+    report_latencies(phase_tag_base, detach_latencies, detach_total / 1e9);
+
+    retv = true;
+
+fail:
+    db_close(db);
+    for (a = 0; a < ATTACH_DATABASES; ++a) {
+        if (format_attach_file(path, db_file, a) && !db_remove(path)) {
+            retv = false;
+        }
+    }
+    histogram_destroy(attach_latencies);
+    histogram_destroy(query_latencies);
+    histogram_destroy(detach_latencies);
+
+    return retv;
+}
+
+int test_startup(const char *tag_base, const char *db_file, int n_opens)
+{
+    BLTS_DEBUG("START %s(n_opens=%d)\n", __FUNCTION__, n_opens);
+
+    unsigned i;
+
+    // each connection to an in-memory database is a database of its own, there is no open
+    if (db_is_in_memory(db_file)) {
+        BLTS_DEBUG("%s: Requires a file-backed database, skipped\n", __FUNCTION__);
+        return EXIT_SUCCESS;
+    }
+
+    for (i = 0; i < sizeof(schema_sizes) / sizeof(schema_sizes[0]); ++i) {
+        if (!schema_pass(tag_base, db_file, schema_sizes[i], n_opens)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!attach_pass(tag_base, db_file, n_opens)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
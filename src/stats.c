@@ -0,0 +1,95 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+void compute_stats(double *values, int n, sample_stats *stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(sample_stats));
+    stats->n = n;
+    if (n == 0) {
+        return;
+    }
+
+    qsort(values, n, sizeof(double), compare_doubles);
+
+    stats->min = values[0];
+    stats->max = values[n - 1];
+    stats->median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+
+    double sum = 0;
+    for (i = 0; i < n; ++i) {
+        sum += values[i];
+    }
+    stats->mean = sum / n;
+
+    if (n > 1) {
+        double sum_sq = 0;
+        for (i = 0; i < n; ++i) {
+            sum_sq += (values[i] - stats->mean) * (values[i] - stats->mean);
+        }
+        stats->stddev = sqrt(sum_sq / (n - 1));
+        stats->ci95 = t_critical_95(n - 1) * stats->stddev / sqrt(n);
+    }
+}
+
+double t_critical_95(double df)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    const int n_table = sizeof(table) / sizeof(table[0]);
+
+    if (df < 1) {
+        return table[0];
+    }
+    if (df <= n_table) {
+        // round down to stay on the conservative side for fractional (Welch) df
+        return table[(int)df - 1];
+    }
+    if (df <= 40) {
+        return 2.042;
+    }
+    if (df <= 60) {
+        return 2.021;
+    }
+    if (df <= 120) {
+        return 2.000;
+    }
+
+    return 1.960;
+}
@@ -0,0 +1,45 @@
+/*
+ * blts-sqlite-perf - performance test suite for sqlite3
+ *
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Martin Kampas <martin.kampas@jollamobile.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Summary statistics over repeated measurements of the same quantity.
+ */
+
+typedef struct {
+    int n;
+    double mean;
+    double stddev;
+    double median;
+    double min;
+    double max;
+    // half-width of the 95% confidence interval of the mean
+    double ci95;
+} sample_stats;
+
+// values are reordered
+void compute_stats(double *values, int n, sample_stats *stats);
+
+// two-sided 95% critical value of Student's t distribution with df degrees of freedom
+double t_critical_95(double df);
+
+#endif // STATS_H